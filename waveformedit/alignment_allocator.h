@@ -3,7 +3,9 @@
 // COURTESY TO StackOverflow.com (http://stackoverflow.com/questions/8456236/how-is-a-vectors-data-aligned)
 
 #include <stdlib.h>
+#ifdef _WIN32
 #include <malloc.h>
+#endif
 #include <new>
 
 template <typename T, std::size_t N = 16>
@@ -36,11 +38,20 @@ public:
 	}
 
 	inline pointer allocate(size_type n) {
+#ifdef _WIN32
 		return (pointer)_aligned_malloc(n*sizeof(value_type), N);
+#else
+		void *p = NULL;
+		return posix_memalign(&p, N, n*sizeof(value_type)) == 0 ? (pointer)p : NULL;
+#endif
 	}
 
 	inline void deallocate(pointer p, size_type) {
+#ifdef _WIN32
 		_aligned_free(p);
+#else
+		free(p);
+#endif
 	}
 
 	inline void construct(pointer p, const value_type & wert) {
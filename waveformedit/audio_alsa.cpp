@@ -0,0 +1,147 @@
+#if defined(__linux__) && !defined(WFEDIT_NO_ALSA) // needs libasound (-lasound)
+
+#include "audio_backend.h"
+
+#include <alsa/asoundlib.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+// Blocking snd_pcm_writei on the backend's own thread. With PipeWire or PulseAudio installed,
+// the "default" device goes through their ALSA plugin; "hw:0,0" etc. talk to the hardware directly.
+
+#define ALSA_CHECK(call) do {\
+		int err_ = (call);\
+		if (err_ < 0) {\
+			printf("audio_alsa.cpp:%d: %s failed: %s\n", __LINE__, #call, snd_strerror(err_));\
+			goto exit_err;\
+		}\
+} while(0)
+
+class ALSABackend : public AudioBackend {
+	std::string device;
+	snd_pcm_t *pcm;
+
+	wave_format_t format;
+	snd_pcm_uframes_t period;
+
+	std::thread thread;
+	std::atomic<bool> running;
+
+	audio_pull_callback_t callback;
+	void *userdata;
+
+	void thread_proc() {
+		const size_t frame_bytes = format.num_channels * format.bit_depth / 8;
+		std::vector<uint8_t> buffer(period * frame_bytes);
+
+		while (running.load(std::memory_order_relaxed)) {
+			callback(&buffer[0], (uint32_t)period, userdata);
+
+			// writei can take fewer frames than asked (e.g. when interrupted by a signal), and nothing at all
+			// on an underrun; either way the rest of the period still goes out before the next one is pulled
+			snd_pcm_uframes_t done = 0;
+			while (done < period && running.load(std::memory_order_relaxed)) {
+				snd_pcm_sframes_t written = snd_pcm_writei(pcm, &buffer[done * frame_bytes], period - done);
+
+				if (written < 0) {
+					// underrun (-EPIPE) or suspend (-ESTRPIPE): recover and retry the same frames
+					int err = snd_pcm_recover(pcm, (int)written, 0);
+					if (err < 0) {
+						printf("ALSABackend: snd_pcm_writei failed: %s\n", snd_strerror(err));
+						return;
+					}
+					continue;
+				}
+
+				done += written;
+			}
+		}
+	}
+
+public:
+	ALSABackend(const char *dev) : device(dev), pcm(NULL), period(0), running(false), callback(NULL), userdata(NULL) {}
+
+	~ALSABackend() {
+		stop();
+		if (pcm) snd_pcm_close(pcm);
+	}
+
+	const char *name() const { return "alsa"; }
+
+	int open(const wave_format_t &requested, uint32_t period_frames) {
+		snd_pcm_hw_params_t *hw = NULL;
+		unsigned int rate = requested.sample_rate;
+		snd_pcm_uframes_t buffer_size = 2 * period_frames;
+
+		format = requested;
+		period = period_frames;
+
+		snd_pcm_format_t pcm_format;
+		if (format.is_float && format.bit_depth == 32) pcm_format = SND_PCM_FORMAT_FLOAT_LE;
+		else if (!format.is_float && format.bit_depth == 16) pcm_format = SND_PCM_FORMAT_S16_LE;
+		else if (!format.is_float && format.bit_depth == 24) pcm_format = SND_PCM_FORMAT_S24_3LE;
+		else if (!format.is_float && format.bit_depth == 32) pcm_format = SND_PCM_FORMAT_S32_LE;
+		else {
+			printf("ALSABackend: unsupported sample format (%d-bit%s).\n", format.bit_depth, format.is_float ? " float" : "");
+			return 0;
+		}
+
+		ALSA_CHECK(snd_pcm_open(&pcm, device.c_str(), SND_PCM_STREAM_PLAYBACK, 0));
+		ALSA_CHECK(snd_pcm_hw_params_malloc(&hw));
+		ALSA_CHECK(snd_pcm_hw_params_any(pcm, hw));
+		ALSA_CHECK(snd_pcm_hw_params_set_access(pcm, hw, SND_PCM_ACCESS_RW_INTERLEAVED));
+		ALSA_CHECK(snd_pcm_hw_params_set_format(pcm, hw, pcm_format));
+		ALSA_CHECK(snd_pcm_hw_params_set_channels(pcm, hw, format.num_channels));
+		ALSA_CHECK(snd_pcm_hw_params_set_rate_near(pcm, hw, &rate, NULL));
+		ALSA_CHECK(snd_pcm_hw_params_set_period_size_near(pcm, hw, &period, NULL));
+		ALSA_CHECK(snd_pcm_hw_params_set_buffer_size_near(pcm, hw, &buffer_size));
+		ALSA_CHECK(snd_pcm_hw_params(pcm, hw));
+		ALSA_CHECK(snd_pcm_hw_params_get_period_size(hw, &period, NULL));
+
+		snd_pcm_hw_params_free(hw);
+
+		format.sample_rate = rate;
+
+		printf("ALSABackend: opened %s, %u Hz, %d channels, period %lu frames, buffer %lu frames\n",
+			device.c_str(), rate, format.num_channels, (unsigned long)period, (unsigned long)buffer_size);
+
+		return 1;
+
+	exit_err:
+		if (hw) snd_pcm_hw_params_free(hw);
+		if (pcm) { snd_pcm_close(pcm); pcm = NULL; }
+		return 0;
+	}
+
+	wave_format_t get_format() const { return format; }
+	uint32_t get_buffer_size() const { return (uint32_t)period; }
+
+	int start(audio_pull_callback_t cb, void *ud) {
+		callback = cb;
+		userdata = ud;
+
+		if (snd_pcm_prepare(pcm) < 0) return 0;
+
+		running = true;
+		thread = std::thread(&ALSABackend::thread_proc, this);
+		return 1;
+	}
+
+	void stop() {
+		running = false;
+		if (thread.joinable()) {
+			thread.join();
+			snd_pcm_drop(pcm);
+		}
+	}
+};
+
+AudioBackend *create_alsa_backend(const char *device) {
+	return new ALSABackend(device);
+}
+
+#endif
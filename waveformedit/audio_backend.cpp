@@ -0,0 +1,40 @@
+#include "audio_backend.h"
+
+#include <cstdio>
+#include <cstring>
+
+AudioBackend *create_audio_backend(const char *name, const char *arg) {
+
+	if (strcmp(name, "null") == 0) {
+		return create_null_backend();
+	}
+
+	if (strcmp(name, "file") == 0) {
+		return create_file_backend(arg && arg[0] ? arg : "wfedit_out.wav");
+	}
+
+#ifdef _WIN32
+	if (strcmp(name, "wasapi") == 0) {
+		return create_wasapi_backend();
+	}
+#endif
+
+#if defined(__linux__) && !defined(WFEDIT_NO_ALSA)
+	if (strcmp(name, "alsa") == 0) {
+		return create_alsa_backend(arg && arg[0] ? arg : "default");
+	}
+#endif
+
+	printf("create_audio_backend: backend \"%s\" isn't available in this build.\n", name);
+	return NULL;
+}
+
+const char *default_audio_backend_name() {
+#if defined(_WIN32)
+	return "wasapi";
+#elif defined(__linux__) && !defined(WFEDIT_NO_ALSA)
+	return "alsa";
+#else
+	return "null";
+#endif
+}
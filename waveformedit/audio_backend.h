@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+struct wave_format_t {
+	int num_channels;
+	int sample_rate;
+	int bit_depth;
+	int is_float; // 1 = IEEE float samples (bit_depth 32), 0 = signed integer PCM
+	float wave_freq;
+	float cycle_duration_ms;
+};
+
+// Called by the backend from its own (realtime) thread whenever the device wants more audio.
+// Must fill dst with num_frames interleaved frames in the format the backend negotiated, and must not block.
+typedef void(*audio_pull_callback_t)(void *dst, uint32_t num_frames, void *userdata);
+
+class AudioBackend {
+public:
+	virtual ~AudioBackend() {}
+
+	virtual const char *name() const = 0;
+
+	// Opens the device with (something close to) the requested format and period, returns 1 on success.
+	// The negotiated values are available through get_format() and get_buffer_size() afterwards.
+	virtual int open(const wave_format_t &requested, uint32_t period_frames) = 0;
+
+	virtual wave_format_t get_format() const = 0;
+	virtual uint32_t get_buffer_size() const = 0; // in frames. the pull callback is always asked for exactly this many.
+
+	virtual int start(audio_pull_callback_t callback, void *userdata) = 0;
+	virtual void stop() = 0; // blocks until the callback won't be called anymore
+};
+
+// name is one of "wasapi" (Windows), "alsa" (Linux), "null" or "file". arg is backend-specific:
+// the device name for alsa, the output path for file. Returns NULL if the backend isn't available in this build.
+AudioBackend *create_audio_backend(const char *name, const char *arg);
+
+const char *default_audio_backend_name();
+
+AudioBackend *create_wasapi_backend();
+AudioBackend *create_alsa_backend(const char *device);
+AudioBackend *create_null_backend();
+AudioBackend *create_file_backend(const char *path);
@@ -0,0 +1,112 @@
+#include "audio_backend.h"
+#include "wav.h"
+
+#include <cstdio>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+// Consumes frames on a precise timer, as a device with the requested format and period would,
+// and throws them away. Good for running and profiling the engine without any audio hardware.
+
+class NullAudioBackend : public AudioBackend {
+protected:
+	wave_format_t format;
+	uint32_t period;
+	std::vector<uint8_t> buffer;
+
+	std::thread thread;
+	std::atomic<bool> running;
+
+	audio_pull_callback_t callback;
+	void *userdata;
+
+	virtual void consume(const void * /*frames*/, uint32_t /*num_frames*/) {}
+
+	void thread_proc() {
+		using clock = std::chrono::steady_clock;
+
+		const std::chrono::duration<double> period_duration((double)period / (double)format.sample_rate);
+
+		// deadlines are accumulated from the start time rather than from "now", so sleep jitter doesn't add up into drift
+		const clock::time_point start = clock::now();
+		uint64_t periods = 0;
+
+		while (running.load(std::memory_order_relaxed)) {
+			callback(&buffer[0], period, userdata);
+			consume(&buffer[0], period);
+
+			++periods;
+			std::this_thread::sleep_until(start + std::chrono::duration_cast<clock::duration>(periods * period_duration));
+		}
+	}
+
+public:
+	NullAudioBackend() : period(0), running(false), callback(NULL), userdata(NULL) {}
+	~NullAudioBackend() { stop(); }
+
+	const char *name() const { return "null"; }
+
+	int open(const wave_format_t &requested, uint32_t period_frames) {
+		format = requested;
+		period = period_frames;
+		buffer.resize(period * format.num_channels * format.bit_depth / 8);
+		return 1;
+	}
+
+	wave_format_t get_format() const { return format; }
+	uint32_t get_buffer_size() const { return period; }
+
+	int start(audio_pull_callback_t cb, void *ud) {
+		callback = cb;
+		userdata = ud;
+		running = true;
+		thread = std::thread(&NullAudioBackend::thread_proc, this);
+		return 1;
+	}
+
+	void stop() {
+		running = false;
+		if (thread.joinable()) thread.join();
+	}
+};
+
+// The null backend, but the frames end up in a WAV file. Paced in real time like a device would be.
+
+class FileAudioBackend : public NullAudioBackend {
+	std::string path;
+	wav_writer_t wav;
+
+	void consume(const void *frames, uint32_t num_frames) {
+		wav.write(frames, num_frames);
+	}
+
+public:
+	FileAudioBackend(const char *p) : path(p) {}
+	~FileAudioBackend() { stop(); }
+
+	const char *name() const { return "file"; }
+
+	int open(const wave_format_t &requested, uint32_t period_frames) {
+		if (!NullAudioBackend::open(requested, period_frames)) return 0;
+		if (!wav.open(path.c_str(), format)) return 0;
+
+		printf("FileAudioBackend: streaming to %s\n", path.c_str());
+		return 1;
+	}
+
+	void stop() {
+		NullAudioBackend::stop();
+		wav.close();
+	}
+};
+
+AudioBackend *create_null_backend() {
+	return new NullAudioBackend();
+}
+
+AudioBackend *create_file_backend(const char *path) {
+	return new FileAudioBackend(path);
+}
@@ -0,0 +1,313 @@
+#ifdef _WIN32
+
+#include "audio_backend.h"
+
+#include <Windows.h>
+#include <Audioclient.h>
+#include <audiopolicy.h>
+#include <mmdeviceapi.h>
+#include <mmreg.h>
+#include <ksmedia.h>
+#include <Avrt.h>
+
+#include <stdio.h>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+#pragma comment(lib, "Avrt.lib")
+
+// REFERENCE_TIME time units per second and per millisecond
+#define REFTIMES_PER_SEC  10000000.0
+#define REFTIMES_PER_MILLISEC  10000.0
+
+#define IF_ERROR_EXIT(hr) do {\
+		if (FAILED(hr)){\
+			printf("audio_wasapi.cpp:%d: WASAPI code error %lX\n", __LINE__, hr);\
+			goto exit_err;\
+		}\
+} while(0)
+
+#define SAFE_RELEASE(punk)  \
+              if ((punk) != NULL)  \
+                { (punk)->Release(); (punk) = NULL; }
+
+static const CLSID CLSID_MMDeviceEnumerator = __uuidof(MMDeviceEnumerator);
+static const IID IID_IMMDeviceEnumerator = __uuidof(IMMDeviceEnumerator);
+static const IID IID_IAudioClient = __uuidof(IAudioClient);
+static const IID IID_IAudioRenderClient = __uuidof(IAudioRenderClient);
+
+static DWORD default_channel_mask(int num_channels) {
+	switch (num_channels) {
+	case 1: return KSAUDIO_SPEAKER_MONO;
+	case 2: return KSAUDIO_SPEAKER_STEREO;
+	case 4: return KSAUDIO_SPEAKER_QUAD;
+	case 6: return KSAUDIO_SPEAKER_5POINT1;
+	case 8: return KSAUDIO_SPEAKER_7POINT1_SURROUND;
+	default: return num_channels < 32 ? (1u << num_channels) - 1 : 0xFFFFFFFFu; // the first n speaker positions
+	}
+}
+
+// A plain WAVEFORMATEX is only reliable for 8/16-bit PCM in mono or stereo; exclusive mode wants
+// WAVEFORMATEXTENSIBLE for anything else, e.g. --format s24/s32/f32 or 6 channels.
+static int construct_wave_format_info(const wave_format_t &fmt, WAVEFORMATEXTENSIBLE *WFEXT) {
+
+	WAVEFORMATEX *WFEX = &WFEXT->Format;
+
+	WFEX->nChannels = fmt.num_channels;
+	WFEX->nSamplesPerSec = fmt.sample_rate;
+	WFEX->nAvgBytesPerSec = fmt.sample_rate * fmt.num_channels * fmt.bit_depth / 8;
+	WFEX->nBlockAlign = fmt.num_channels * fmt.bit_depth / 8;
+	WFEX->wBitsPerSample = fmt.bit_depth;
+
+	if (fmt.num_channels <= 2 && fmt.bit_depth <= 16 && !fmt.is_float) {
+		WFEX->wFormatTag = WAVE_FORMAT_PCM;
+		WFEX->cbSize = 0;
+		return 1;
+	}
+
+	WFEX->wFormatTag = WAVE_FORMAT_EXTENSIBLE;
+	WFEX->cbSize = sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX);
+	WFEXT->Samples.wValidBitsPerSample = fmt.bit_depth; // s24 is packed, so every bit of the container is valid
+	WFEXT->dwChannelMask = default_channel_mask(fmt.num_channels);
+	WFEXT->SubFormat = fmt.is_float ? KSDATAFORMAT_SUBTYPE_IEEE_FLOAT : KSDATAFORMAT_SUBTYPE_PCM;
+
+	return 1;
+
+}
+
+static HRESULT initialize_with_period(IAudioClient *pAudioClient, const WAVEFORMATEX *wave_format, uint32_t n) {
+
+	REFERENCE_TIME DefaultDevicePeriod = 0, MinimumDevicePeriod = 0;
+	HRESULT hr = pAudioClient->GetDevicePeriod(&DefaultDevicePeriod, &MinimumDevicePeriod);
+
+	if (FAILED(hr)) return hr;
+
+	printf("MinimumDevicePeriod: %lld, DefaultDevicePeriod: %lld\n", MinimumDevicePeriod, DefaultDevicePeriod);
+
+	REFERENCE_TIME hnsPeriod = (REFERENCE_TIME)(REFTIMES_PER_SEC * (float)n / (float)wave_format->nSamplesPerSec + 0.5);
+
+	hr = pAudioClient->Initialize(AUDCLNT_SHAREMODE_EXCLUSIVE, AUDCLNT_STREAMFLAGS_EVENTCALLBACK, hnsPeriod, hnsPeriod, wave_format, NULL);
+
+	if (FAILED(hr)) {
+		printf("IAudioClient::Initialize(): failed to set device period to %u frames (%lld === %.4f ms), aborting.\n", n, hnsPeriod, (float)hnsPeriod / 10000.0);
+		return hr;
+	}
+	else {
+		printf("IAudioClient::Initialize(): success with n = %u (period = %lld === %.4f ms)\n", n, hnsPeriod, (float)hnsPeriod / 10000.0);
+		return hr;
+	}
+	
+}
+
+// WASAPI in exclusive, event-driven mode. The whole device lifetime (COM initialization included)
+// lives on the backend's own thread, which gets "Pro Audio" scheduling priority once streaming starts.
+
+class WASAPIBackend : public AudioBackend {
+
+	enum { STATE_OPENING, STATE_OPEN, STATE_STARTED, STATE_STOPPING, STATE_FAILED };
+
+	wave_format_t format;
+	UINT32 frame_size;
+
+	std::thread thread;
+	std::mutex state_mutex;
+	std::condition_variable state_changed;
+	int state;
+
+	std::atomic<bool> running;
+	HANDLE hEvent;
+
+	audio_pull_callback_t callback;
+	void *userdata;
+
+	void set_state(int s) {
+		std::lock_guard<std::mutex> lock(state_mutex);
+		state = s;
+		state_changed.notify_all();
+	}
+
+	void thread_proc(uint32_t period_frames);
+
+	// only after the thread is gone, so stop() can always use hEvent to wake it up
+	void close_event() {
+		if (hEvent != NULL) {
+			CloseHandle(hEvent);
+			hEvent = NULL;
+		}
+	}
+
+public:
+	WASAPIBackend() : frame_size(0), state(STATE_OPENING), running(false), hEvent(NULL), callback(NULL), userdata(NULL) {}
+	~WASAPIBackend() { stop(); }
+
+	const char *name() const { return "wasapi"; }
+
+	int open(const wave_format_t &requested, uint32_t period_frames) {
+		format = requested;
+		state = STATE_OPENING;
+		thread = std::thread(&WASAPIBackend::thread_proc, this, period_frames);
+
+		std::unique_lock<std::mutex> lock(state_mutex);
+		state_changed.wait(lock, [this] { return state != STATE_OPENING; });
+
+		if (state == STATE_FAILED) {
+			lock.unlock();
+			thread.join();
+			close_event();
+			return 0;
+		}
+
+		return 1;
+	}
+
+	wave_format_t get_format() const { return format; }
+	uint32_t get_buffer_size() const { return frame_size; }
+
+	int start(audio_pull_callback_t cb, void *ud) {
+		callback = cb;
+		userdata = ud;
+		running = true;
+		set_state(STATE_STARTED);
+		return 1;
+	}
+
+	void stop() {
+		if (!thread.joinable()) return;
+
+		running = false;
+		set_state(STATE_STOPPING);
+		if (hEvent) SetEvent(hEvent);
+
+		thread.join();
+		close_event();
+	}
+};
+
+void WASAPIBackend::thread_proc(uint32_t period_frames) {
+
+	HRESULT hr;
+	IMMDeviceEnumerator *pEnumerator = NULL;
+	IMMDevice *pDevice = NULL;
+	IAudioClient *pAudioClient = NULL;
+	IAudioRenderClient *pRenderClient = NULL;
+	BYTE *pData = NULL;
+	HANDLE hTask = NULL;
+	DWORD taskIndex = 0;
+	int opened = 0;
+	int com_initialized = 0; // S_FALSE (already initialized on this thread) still needs its CoUninitialize
+
+	WAVEFORMATEXTENSIBLE wave_format = {};
+
+	hr = CoInitialize(NULL);
+	IF_ERROR_EXIT(hr);
+	com_initialized = 1;
+
+	hr = CoCreateInstance(CLSID_MMDeviceEnumerator, NULL, CLSCTX_ALL, IID_IMMDeviceEnumerator, (void**)&pEnumerator);
+	IF_ERROR_EXIT(hr);
+
+	hr = pEnumerator->GetDefaultAudioEndpoint(eRender, eConsole, &pDevice);
+	IF_ERROR_EXIT(hr);
+
+	hr = pDevice->Activate(IID_IAudioClient, CLSCTX_ALL, NULL, (void**)&pAudioClient);
+	IF_ERROR_EXIT(hr);
+
+	construct_wave_format_info(format, &wave_format);
+
+	hr = pAudioClient->IsFormatSupported(AUDCLNT_SHAREMODE_EXCLUSIVE, &wave_format.Format, NULL);
+
+	if (AUDCLNT_E_UNSUPPORTED_FORMAT == hr) {
+		printf("WASAPI: default audio device does not support the requested format (%d/%dch/%d bit%s)\n", wave_format.Format.nSamplesPerSec,
+			wave_format.Format.nChannels, wave_format.Format.wBitsPerSample, format.is_float ? " float" : "");
+		goto exit_err;
+	}
+
+	IF_ERROR_EXIT(hr);
+	hr = initialize_with_period(pAudioClient, &wave_format.Format, period_frames);
+	IF_ERROR_EXIT(hr);
+	
+	hr = pAudioClient->GetBufferSize(&frame_size);
+	IF_ERROR_EXIT(hr);
+
+	hr = pAudioClient->GetService(IID_IAudioRenderClient, (void**)&pRenderClient);
+	IF_ERROR_EXIT(hr);
+
+	hEvent = CreateEvent(nullptr, false, false, nullptr);
+	if (hEvent == NULL) { printf("CreateEvent failed\n"); goto exit_err; }
+	
+	hr = pAudioClient->SetEventHandle(hEvent);
+	IF_ERROR_EXIT(hr);
+
+	opened = 1;
+	set_state(STATE_OPEN);
+
+	{
+		std::unique_lock<std::mutex> lock(state_mutex);
+		state_changed.wait(lock, [this] { return state != STATE_OPEN; });
+		if (state != STATE_STARTED) goto exit_err;
+	}
+
+	// prefill one period before starting the stream
+	hr = pRenderClient->GetBuffer(frame_size, &pData);
+	IF_ERROR_EXIT(hr);
+
+	callback(pData, frame_size, userdata);
+
+	hr = pRenderClient->ReleaseBuffer(frame_size, 0);
+	IF_ERROR_EXIT(hr);
+
+	// increase thread priority for optimal av performance
+	hTask = AvSetMmThreadCharacteristics(TEXT("Pro Audio"), &taskIndex);
+	if (hTask == NULL) {
+		hr = E_FAIL;
+		IF_ERROR_EXIT(hr);
+	}
+
+	hr = pAudioClient->Start();  // Start playing.
+	IF_ERROR_EXIT(hr);
+
+	while (running.load(std::memory_order_relaxed)) {
+
+		WaitForSingleObject(hEvent, INFINITE);
+		if (!running.load(std::memory_order_relaxed)) break;
+
+		hr = pRenderClient->GetBuffer(frame_size, &pData);
+		IF_ERROR_EXIT(hr);
+
+		callback(pData, frame_size, userdata);
+
+		hr = pRenderClient->ReleaseBuffer(frame_size, 0);
+		IF_ERROR_EXIT(hr);
+	}
+
+	hr = pAudioClient->Stop();  // Stop playing.
+	IF_ERROR_EXIT(hr);
+
+exit_err:
+
+	if (!opened) {
+		set_state(STATE_FAILED);
+	}
+
+	SAFE_RELEASE(pEnumerator)
+	SAFE_RELEASE(pDevice)
+	SAFE_RELEASE(pAudioClient)
+	SAFE_RELEASE(pRenderClient)
+
+	if (hTask != NULL) {
+		AvRevertMmThreadCharacteristics(hTask);
+	}
+
+	if (com_initialized) {
+		CoUninitialize();
+	}
+	
+	printf("Exiting WASAPI thread...\n");
+}
+
+AudioBackend *create_wasapi_backend() {
+	return new WASAPIBackend();
+}
+
+#endif
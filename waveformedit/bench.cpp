@@ -0,0 +1,1742 @@
+#include "bench.h"
+#include "curve.h"
+#include "curve_simd.h"
+#include "curve_io.h"
+#include "wavetable.h"
+#include "oscillator.h"
+#include "block_adapter.h"
+#include "sample_convert.h"
+#include "multichannel.h"
+#include "fft_util.h"
+#include "resample.h"
+#include "spectrum.h"
+#include "stft.h"
+#include "spsc_ring.h"
+#include "timer.h"
+#include "triple_buffer.h"
+#include "snapshot_pool.h"
+#include "audio_backend.h"
+
+#ifdef WFEDIT_EGL
+#include "glad/glad.h"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <cstdlib> // setenv
+#include "gl_ring.h"
+#endif
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <cstdint>
+#include <random>
+
+template <typename F>
+static double bench_best_of_ms(int reps, F f) {
+	double best = 1e30;
+	for (int r = 0; r < reps; ++r) {
+		perf_timer_t t;
+		f();
+		best = (std::min)(best, t.get_ms());
+	}
+	return best;
+}
+
+static void bench_update_buffer() {
+	static const size_t frame_sizes[] = { 1024, 4096, 65536 };
+	const int precision = 32;
+
+	printf("\nSEGMENTED_BEZIER4::update_buffer: fixed-step t march (precision %d) vs. x(t) = x solver\n", precision);
+	printf("%8s %14s %14s %9s %12s\n", "frames", "t march (ms)", "solver (ms)", "speedup", "max |dy|");
+
+	for (size_t n : frame_sizes) {
+		SEGMENTED_BEZIER4 march = make_default_curve();
+		SEGMENTED_BEZIER4 solve = make_default_curve();
+		march.allocate_buffer(n);
+		solve.allocate_buffer(n);
+
+		int reps = (std::max)(3, (int)(65536 / n));
+
+		double t_march = bench_best_of_ms(reps, [&] { march.update_buffer_tmarch(precision); });
+		double t_solve = bench_best_of_ms(reps, [&] { solve.mark_all_dirty(); solve.update_buffer(); });
+
+		float max_dy = 0;
+		for (size_t i = 0; i < n; ++i) {
+			max_dy = (std::max)(max_dy, fabsf(march.samples[i] - solve.samples[i]));
+		}
+
+		printf("%8zu %14.4f %14.4f %8.1fx %12.3e\n", n, t_march, t_solve, t_march / t_solve, max_dy);
+
+		delete[] march.samples;
+		delete[] solve.samples;
+	}
+}
+
+// splits the default curve at i/num_segments until it has num_segments fragments. Split points that land on
+// one of the default curve's knots (0.75 = 48/64, 0.15 = 3/20, ...) are skipped: split() would leave a
+// zero-width fragment there, with tmax < tmin
+static SEGMENTED_BEZIER4 bench_segmented_curve(size_t num_segments) {
+	SEGMENTED_BEZIER4 c = make_default_curve();
+	for (size_t i = 1; i < num_segments && c.parts.size() < num_segments; ++i) {
+		const float t = (float)i / (float)num_segments;
+		if (std::binary_search(c.tmins.begin(), c.tmins.end(), t)) continue;
+		c.split(t);
+	}
+	return c;
+}
+
+// the rasterized cycle is mono; this is what the old interleaved-stereo buffer cost on top of it, i.e. the
+// duplicated store per sample, and twice the bytes to read again when the wavetable is built
+static void bench_layout() {
+	static const size_t frame_sizes[] = { 1024, 4096, 65536 };
+
+	printf("\nrasterized cycle layout: mono vs. interleaved stereo (both channels the same)\n");
+	printf("%8s %15s %15s %10s %12s %14s\n", "frames", "rasterize (ms)", "+ stereo (ms)", "overhead", "mono (KiB)", "stereo (KiB)");
+
+	for (size_t n : frame_sizes) {
+		SEGMENTED_BEZIER4 c = bench_segmented_curve(32);
+		c.allocate_buffer(n);
+
+		std::vector<float> stereo(2 * n);
+		const int reps = (std::max)(5, (int)(262144 / n));
+
+		double t_mono = bench_best_of_ms(reps, [&] { c.mark_all_dirty(); c.update_buffer(); });
+		double t_stereo = bench_best_of_ms(reps, [&] { expand_channels(c.samples, &stereo[0], n, 2); });
+
+		printf("%8zu %15.4f %15.4f %9.1f%% %12zu %14zu\n", n, t_mono, t_stereo, 100.0 * t_stereo / t_mono,
+			n * sizeof(float) / 1024, 2 * n * sizeof(float) / 1024);
+
+		delete[] c.samples;
+	}
+}
+
+static void bench_segment_lookup() {
+	static const size_t segment_counts[] = { 4, 16, 64, 256, 1024 };
+	const int num_evals = 1 << 20;
+
+	printf("\nSEGMENTED_BEZIER4::evaluate: segment lookup cost vs. number of segments (%d evaluations)\n", num_evals);
+	printf("%10s %12s %12s\n", "segments", "total (ms)", "ns/eval");
+
+	for (size_t n : segment_counts) {
+		SEGMENTED_BEZIER4 c = bench_segmented_curve(n);
+
+		float sink = 0;
+		double ms = bench_best_of_ms(3, [&] {
+			// scrambled rather than sequential t, so that this measures the lookup and not the branch predictor
+			for (int i = 0; i < num_evals; ++i) {
+				float t = (float)((i * 40503u) & (num_evals - 1)) / (float)num_evals;
+				sink += c.evaluate(t).y;
+			}
+		});
+
+		printf("%10zu %12.3f %12.2f%s\n", c.parts.size(), ms, 1e6 * ms / num_evals, sink == 12345.f ? " " : "");
+	}
+}
+
+static void bench_cursor() {
+	static const size_t segment_counts[] = { 4, 64, 1024 };
+	const int num_evals = 1 << 20;
+	const float dt = 1.0f / (float)num_evals;
+
+	printf("\nsequential sweep t = 0..1: evaluate(t) per sample vs. SEGMENTED_BEZIER4_cursor (%d samples)\n", num_evals);
+	printf("%10s %15s %13s %9s\n", "segments", "evaluate (ms)", "cursor (ms)", "speedup");
+
+	for (size_t n : segment_counts) {
+		SEGMENTED_BEZIER4 c = bench_segmented_curve(n);
+
+		float sink = 0;
+
+		double t_eval = bench_best_of_ms(3, [&] {
+			for (int i = 0; i < num_evals; ++i) sink += c.evaluate(i * dt).y;
+		});
+
+		double t_cursor = bench_best_of_ms(3, [&] {
+			SEGMENTED_BEZIER4_cursor cursor(c);
+			for (int i = 0; i < num_evals; ++i) sink += cursor.evaluate(i * dt).y;
+		});
+
+		printf("%10zu %15.3f %13.3f %8.1fx%s\n", c.parts.size(), t_eval, t_cursor, t_eval / t_cursor, sink == 12345.f ? " " : "");
+	}
+}
+
+static void bench_evaluate_batch() {
+	const size_t n = 1 << 20;
+	const BEZIER4 b(vec2(0.0, 0.0), vec2(0.33, -1.0), vec2(0.66, 1.0), vec2(1.0, 0.0));
+
+	std::vector<float> t(n);
+	std::vector<vec2> ref(n), out(n);
+
+	for (size_t i = 0; i < n; ++i) t[i] = (float)i / (float)n;
+
+	printf("\nBEZIER4: evaluate(t) per point vs. evaluate_batch (%zu points, dispatching to %s)\n", n, bezier_evaluate_batch_kernel_name());
+	printf("%12s %12s %9s %12s\n", "kernel", "total (ms)", "speedup", "max |err|");
+
+	double t_scalar = bench_best_of_ms(5, [&] {
+		for (size_t i = 0; i < n; ++i) ref[i] = b.evaluate(t[i]);
+	});
+	printf("%12s %12.3f %8.1fx %12s\n", "evaluate", t_scalar, 1.0, "-");
+
+	// through the dispatch, the way curve.cpp calls it
+	static const char *kernels[] = { "scalar", "sse", "avx2" };
+	for (const char *k : kernels) {
+		if (!bezier_evaluate_batch_set_kernel(k)) continue;
+
+		double ms = bench_best_of_ms(5, [&] { bezier_evaluate_batch(b.matrix_repr, &t[0], &out[0], n); });
+
+		float err = 0;
+		for (size_t i = 0; i < n; ++i) {
+			err = (std::max)(err, (std::max)(fabsf(out[i].x - ref[i].x), fabsf(out[i].y - ref[i].y)));
+		}
+		printf("%12s %12.3f %8.1fx %12.3e\n", k, ms, t_scalar / ms, err);
+	}
+	bezier_evaluate_batch_set_kernel(NULL);
+
+	const uint32_t frame_size = 4096;
+	double t_lut = bench_best_of_ms(5, [&] { delete[] b.sample_curve(frame_size); });
+	double t_nolut = bench_best_of_ms(5, [&] { delete[] b.sample_curve_noLUT(frame_size); });
+	printf("sample_curve(%u): %.3f ms, sample_curve_noLUT(%u): %.3f ms\n", frame_size, t_lut, frame_size, t_nolut);
+}
+
+static void bench_forward_difference() {
+	const size_t n = 1 << 20;
+	const float dt = 1.0f / (float)n;
+	const BEZIER4 b(vec2(0.0, 0.0), vec2(0.33, -1.0), vec2(0.66, 1.0), vec2(1.0, 0.0));
+	const BEZIER4_fragment f(b.points24, 0, 1);
+
+	static const size_t reanchor_intervals[] = { 64, 256, 1024, 4096, n };
+
+	std::vector<vec2> ref(n), out(n);
+
+	// double precision reference
+	auto coef = [&](int c, int k) { return (double)f.matrix_repr.columns[c](k); };
+	for (size_t i = 0; i < n; ++i) {
+		double t = (double)i / (double)n;
+		ref[i] = vec2(
+			(float)(((coef(0, 3)*t + coef(0, 2))*t + coef(0, 1))*t + coef(0, 0)),
+			(float)(((coef(1, 3)*t + coef(1, 2))*t + coef(1, 1))*t + coef(1, 0)));
+	}
+
+	printf("\nBEZIER4_fragment::forward_difference vs. evaluate loop (%zu uniformly spaced t)\n", n);
+	printf("%16s %12s %9s %12s\n", "reanchor every", "total (ms)", "speedup", "max |err|");
+
+	auto max_err = [&]() {
+		float err = 0;
+		for (size_t i = 0; i < n; ++i) {
+			err = (std::max)(err, (std::max)(fabsf(out[i].x - ref[i].x), fabsf(out[i].y - ref[i].y)));
+		}
+		return err;
+	};
+
+	double t_eval = bench_best_of_ms(5, [&] {
+		for (size_t i = 0; i < n; ++i) out[i] = b.evaluate(dt * (float)i);
+	});
+	printf("%16s %12.3f %8.1fx %12.3e\n", "(evaluate)", t_eval, 1.0, max_err());
+
+	for (size_t k : reanchor_intervals) {
+		double ms = bench_best_of_ms(5, [&] { f.forward_difference(0, dt, n, &out[0], k); });
+		printf("%16zu %12.3f %8.1fx %12.3e\n", k, ms, t_eval / ms, max_err());
+	}
+}
+
+// drags a control point and a knot around and checks that the incremental update_buffer agrees with a full re-render
+static void bench_incremental() {
+	const size_t frame_size = 4096;
+	const int num_edits = 256;
+
+	SEGMENTED_BEZIER4 inc = bench_segmented_curve(32);
+	SEGMENTED_BEZIER4 full = bench_segmented_curve(32);
+	inc.allocate_buffer(frame_size);
+	full.allocate_buffer(frame_size);
+	inc.update_buffer();
+
+	const int cp = 4 * 10 + 1; // first inner control point of segment 10
+	const vec2 p0 = inc.get_cp(cp);
+	const int knot = 12;
+	const vec2 k0 = inc.get_knot(knot);
+
+	size_t recomputed = 0;
+	float max_dy = 0;
+	double t_inc = 0, t_full = 0;
+
+	for (int e = 0; e < num_edits; ++e) {
+		if (e & 1) {
+			vec2 k = k0 + vec2(0.005f*sinf(0.1f*e), 0.3f*cosf(0.1f*e));
+			inc.move_knot(knot, k);
+			full.move_knot(knot, k);
+		}
+		else {
+			vec2 p = p0 + vec2(0, 0.5f*sinf(0.1f*e));
+			inc.move_cp(cp, p);
+			full.move_cp(cp, p);
+		}
+
+		perf_timer_t ti;
+		inc.update_buffer();
+		t_inc += ti.get_ms();
+		recomputed += inc.samples_recomputed;
+
+		perf_timer_t tf;
+		full.mark_all_dirty();
+		full.update_buffer();
+		t_full += tf.get_ms();
+
+		for (size_t i = 0; i < frame_size; ++i) {
+			max_dy = (std::max)(max_dy, fabsf(inc.samples[i] - full.samples[i]));
+		}
+	}
+
+	inc.update_buffer();
+
+	printf("\nincremental update_buffer: %d edits of a control point and a knot on a %zu-segment curve, %zu frames\n", num_edits, inc.parts.size(), frame_size);
+	printf("samples recomputed per edit: %.1f (of %zu)\n", (double)recomputed / num_edits, frame_size);
+	printf("time per edit: incremental %.4f ms, full %.4f ms\n", t_inc / num_edits, t_full / num_edits);
+	printf("update_buffer without edits recomputed %zu samples\n", inc.samples_recomputed);
+	printf("max |incremental - full|: %.3e\n", max_dy);
+
+	delete[] inc.samples;
+	delete[] full.samples;
+}
+
+// a random curve with monotone x, num_segments evenly spaced fragments. built directly, split() is too chatty for thousands of curves
+static SEGMENTED_BEZIER4 bench_random_curve(std::mt19937 &rng, size_t num_segments) {
+	std::uniform_real_distribution<float> y(-1.0f, 1.0f);
+	std::vector<BEZIER4_fragment> f;
+
+	vec2 knot(0, 0);
+	for (size_t i = 0; i < num_segments; ++i) {
+		const float x0 = (float)i / num_segments, x1 = (float)(i + 1) / num_segments, w = x1 - x0;
+		vec2 next(x1, i + 1 == num_segments ? 0 : y(rng));
+		f.push_back(BEZIER4_fragment(mat24(knot, vec2(x0 + w / 3, y(rng)), vec2(x0 + 2 * w / 3, y(rng)), next), x0, x1));
+		knot = next;
+	}
+
+	SEGMENTED_BEZIER4 c;
+	c.set_fragments(&f[0], f.size());
+	return c;
+}
+
+static bool same_fragments(const SEGMENTED_BEZIER4 &a, const SEGMENTED_BEZIER4 &b) {
+	if (a.parts.size() != b.parts.size()) return false;
+	for (size_t i = 0; i < a.parts.size(); ++i) {
+		const BEZIER4_fragment &p = a.parts[i], &q = b.parts[i];
+		if (p.tmin != q.tmin || p.tmax != q.tmax || p.tscale != q.tscale) return false;
+		for (int c = 0; c < 2; ++c) {
+			for (int r = 0; r < 4; ++r) {
+				if (p.points24.columns[c](r) != q.points24.columns[c](r)) return false;
+				if (p.matrix_repr.columns[c](r) != q.matrix_repr.columns[c](r)) return false;
+			}
+		}
+	}
+	return true;
+}
+
+static void bench_curve_io() {
+	const size_t num_curves = 4096;
+	const int num_text_loads = 256;
+	const char *bank_path = "wfedit_bench_bank.wfcb";
+	const char *text_path = "wfedit_bench_curve.txt";
+
+	std::mt19937 rng(1234);
+	std::vector<SEGMENTED_BEZIER4> curves;
+	size_t total_fragments = 0;
+	for (size_t i = 0; i < num_curves; ++i) {
+		curves.push_back(bench_random_curve(rng, 8 + (i % 57)));
+		total_fragments += curves.back().parts.size();
+	}
+
+	printf("\ncurve_io: bank of %zu curves, %zu fragments\n", num_curves, total_fragments);
+
+	// round trips. text floats are printed with 9 digits and both loaders rebuild the fragments from their points
+	// the way the curve was built, so both have to be bit exact
+	int text_mismatches = 0, bank_mismatches = 0;
+	for (size_t i = 0; i < num_curves; i += num_curves / 64) {
+		SEGMENTED_BEZIER4 back;
+		if (!curve_save_text(text_path, curves[i]) || !curve_load_text(text_path, &back) || !same_fragments(curves[i], back)) {
+			++text_mismatches;
+		}
+	}
+
+	double t_save = bench_best_of_ms(1, [&] { curve_bank_save(bank_path, &curves[0], num_curves); });
+
+	curve_bank_t bank;
+	double t_open = bench_best_of_ms(1, [&] { bank.open(bank_path); });
+
+	std::vector<SEGMENTED_BEZIER4> loaded(num_curves);
+	double t_load = bench_best_of_ms(3, [&] {
+		for (uint32_t i = 0; i < bank.size(); ++i) {
+			bank.load(i, &loaded[i]);
+		}
+	});
+
+	for (size_t i = 0; i < num_curves; ++i) {
+		if (i >= bank.size() || !same_fragments(curves[i], loaded[i])) ++bank_mismatches;
+	}
+
+	// the same curve sizes through the text parser, for comparison
+	curve_save_text(text_path, curves[num_curves / 2]);
+	SEGMENTED_BEZIER4 t;
+	double t_text = bench_best_of_ms(3, [&] {
+		for (int i = 0; i < num_text_loads; ++i) {
+			curve_load_text(text_path, &t);
+		}
+	});
+
+	const double bank_mb = bank.length / (1024.0 * 1024.0);
+	bank.close();
+
+	// files rasterize() can't make sense of are refused, the one-float gap split() leaves between fragments isn't
+	static const struct { const char *segments; bool valid; } text_cases[] = {
+		{ "0 0.5 0 0 0.1 1 0.2 1 0.5 0\n0.5 1 0.5 0 0.6 1 0.7 1 1 0\n", true },
+		{ "0 0.49999997 0 0 0.1 1 0.2 1 0.5 0\n0.5 1 0.5 0 0.6 1 0.7 1 1 0\n", true },
+		{ "0 0.4 0 0 0.1 1 0.2 1 0.5 0\n0.5 1 0.5 0 0.6 1 0.7 1 1 0\n", false }, // gap in t
+		{ "0 0.6 0 0 0.1 1 0.2 1 0.5 0\n0.5 1 0.5 0 0.6 1 0.7 1 1 0\n", false }, // overlap in t
+		{ "0 0.5 0 0 0.1 1 0.2 1 0.5 0\n0.5 0.9 0.5 0 0.6 1 0.7 1 1 0\n", false }, // doesn't reach t = 1
+		{ "0 0.5 0 0 0.1 1 0.2 1 0.5 0\n0.5 1 0.4 0 0.6 1 0.7 1 1 0\n", false }, // x goes backwards across the knot
+		{ "0 0.5 0 0 0.1 1 0.2 1 0.5 0\n0.5 1 0.5 0 0.6 1 0.7 1 0.4 0\n", false }, // x goes backwards within a fragment
+		{ "0 0.5 0 0 0.1 1 0.2 1 0.5 0\n0.5 1 0.5 0 0.6 1 0.7 1 1.5 0\n", false }, // x past 1
+		{ "0 0.5 0 0 0.1 nan 0.2 1 0.5 0\n0.5 1 0.5 0 0.6 1 0.7 1 1 0\n", false }, // NaN y
+		{ "0 0.5 0 0 0.1 1 0.2 1 0.5 inf\n0.5 1 0.5 inf 0.6 1 0.7 1 1 0\n", false }, // infinite y
+		{ "0 0.5 0 0 0.1 1 0.2 1 0.5 0\n0.5 1 0.5 0 nan 1 0.7 1 1 0\n", false }, // NaN control point x
+		{ "0 0.5 0 0 0.1 1 0.2 1e6 0.5 0\n0.5 1 0.5 0 0.6 1 0.7 1 1 0\n", false }, // y way out of range
+		{ "0 0.5 0 0 0.1 4 0.2 -4 0.5 0\n0.5 1 0.5 0 0.6 1 0.7 1 1 0\n", true }, // overshooting control points are fine
+	};
+	int validation_errors = 0;
+	for (const auto &c : text_cases) {
+		FILE *fp = fopen(text_path, "w");
+		fprintf(fp, "wfcurve 1\nsegments 2\n%s", c.segments);
+		fclose(fp);
+		if ((curve_load_text(text_path, &t) != 0) != c.valid) ++validation_errors;
+	}
+
+	// and a bank with a gap in t in its second curve: that one is refused by load(), the first isn't. The third
+	// has NaN coefficients and a wrong tscale stored with its points, load() has to give back the original curve
+	std::vector<BEZIER4_fragment> gapped(curves[0].parts.begin(), curves[0].parts.end());
+	gapped[1].tmin += 0.01f;
+	std::vector<BEZIER4_fragment> bad_coeffs(curves[0].parts.begin(), curves[0].parts.end());
+	for (auto &f : bad_coeffs) {
+		f.matrix_repr.columns[1] = vec4(NAN, NAN, NAN, NAN);
+		f.tscale = 1;
+	}
+	SEGMENTED_BEZIER4 bad_bank[3];
+	bad_bank[0] = curves[0];
+	bad_bank[1].set_fragments(&gapped[0], gapped.size());
+	bad_bank[2].set_fragments(&bad_coeffs[0], bad_coeffs.size());
+	if (!curve_bank_save(bank_path, bad_bank, 3) || !bank.open(bank_path) || !bank.load(0, &t) || bank.load(1, &t)) ++validation_errors;
+	if (!bank.load(2, &t) || !same_fragments(curves[0], t)) ++validation_errors;
+	bank.close();
+
+	// knots dragged past their neighbours and out of [0, 1] in the editor are clamped, so what S saves loads again
+	SEGMENTED_BEZIER4 dragged = curves[1];
+	dragged.move_knot(1, vec2(0.9f, 0.5f));
+	dragged.move_knot(3, vec2(-0.5f, 0.5f));
+	dragged.move_knot((int)dragged.parts.size() - 1, vec2(1.5f, 0.5f));
+	if (!curve_save_text(text_path, dragged) || !curve_load_text(text_path, &t)) ++validation_errors;
+
+	printf("round trip: text %s (64 curves), binary %s (%zu curves)\n",
+		text_mismatches ? "MISMATCH" : "ok", bank_mismatches ? "MISMATCH" : "ok", num_curves);
+	printf("validation: %d of %zu malformed/valid files handled wrong -> %s\n",
+		validation_errors, sizeof(text_cases) / sizeof(text_cases[0]) + 3, validation_errors ? "FAIL" : "OK");
+	printf("binary bank: %.2f MB, save %.3f ms, open (map + validate) %.3f ms, load all %.3f ms (%.2f us/curve)\n",
+		bank_mb, t_save, t_open, t_load, 1000.0 * t_load / num_curves);
+	printf("text: %.2f us/curve for a %zu-segment curve (file open included), bank load of the same curve count would take ~%.1f ms\n",
+		1000.0 * t_text / num_text_loads, curves[num_curves / 2].parts.size(), t_text / num_text_loads * num_curves);
+
+	remove(bank_path);
+	remove(text_path);
+}
+
+// fraction of the output's energy that isn't near a harmonic of freq, in dB. hann windowed, num_frames FFT
+static double bench_alias_db(const float *out, int num_frames, double freq, double sample_rate) {
+	float *in = static_cast<float*>(fftwf_malloc(num_frames * sizeof(float)));
+	fftwf_complex *spec = static_cast<fftwf_complex*>(fftwf_malloc((num_frames / 2 + 1) * sizeof(fftwf_complex)));
+	fftwf_plan plan = fft_plan_r2c(num_frames, in, spec, FFTW_ESTIMATE);
+
+	for (int i = 0; i < num_frames; ++i) {
+		in[i] = out[i] * (0.5f - 0.5f * cosf(6.2831853f * i / num_frames));
+	}
+	fftwf_execute(plan);
+
+	const double bin_hz = sample_rate / num_frames;
+	double total = 0, alias = 0;
+	for (int b = 1; b <= num_frames / 2; ++b) {
+		const double e = spec[b][0] * spec[b][0] + spec[b][1] * spec[b][1];
+		const double h = b * bin_hz / freq;
+		total += e;
+		if (fabs(h - floor(h + 0.5)) * freq > 3 * bin_hz) alias += e;
+	}
+
+	fft_destroy_plan(plan);
+	fftwf_free(in);
+	fftwf_free(spec);
+
+	return 10.0 * log10(alias / total + 1e-30);
+}
+
+static void bench_wavetable() {
+	static const uint32_t cycle_sizes[] = { 1024, 2048, 4096 };
+	const double sample_rate = 48000;
+	const int num_frames = 8192;
+
+	printf("\nwavetable_t::build: mip chain from a rasterized cycle\n");
+	printf("%8s %8s %12s\n", "size", "levels", "build (ms)");
+
+	SEGMENTED_BEZIER4 c = make_default_curve();
+	c.allocate_buffer(4096);
+	c.update_buffer();
+
+	for (uint32_t n : cycle_sizes) {
+		SEGMENTED_BEZIER4 r = make_default_curve();
+		r.allocate_buffer(n);
+		r.update_buffer();
+
+		wavetable_t wt;
+		double ms = bench_best_of_ms(5, [&] { wt.build(r.samples, n); });
+		printf("%8u %8d %12.3f\n", n, wt.num_levels, ms);
+
+		delete[] r.samples;
+	}
+
+	wavetable_t wt;
+	wt.build(c.samples, 4096);
+
+	// frequencies that land on FFT bins, so the harmonics don't smear
+	static const int fundamental_bins[] = { 19, 75, 301, 537, 1201 };
+
+	printf("energy away from the harmonics, %d frames at %.0f Hz: plain cycle (level 0) vs. mip-mapped\n", num_frames, sample_rate);
+	printf("%12s %16s %16s\n", "freq (Hz)", "level 0 (dB)", "mip-mapped (dB)");
+
+	std::vector<float> plain(num_frames), mip(num_frames);
+
+	for (int bin : fundamental_bins) {
+		const double freq = bin * sample_rate / num_frames;
+		const double inc = freq / sample_rate;
+
+		wavetable_lookup_t l0 = { wt.level(0), wt.level(0), 0 };
+		wavetable_lookup_t l = wt.select(freq, sample_rate);
+
+		double phase = 0;
+		for (int i = 0; i < num_frames; ++i) {
+			plain[i] = wavetable_read(l0, wt.size, phase);
+			mip[i] = wavetable_read(l, wt.size, phase);
+			phase += inc;
+			if (phase >= 1.0) phase -= 1.0;
+		}
+
+		printf("%12.1f %16.1f %16.1f\n", freq,
+			bench_alias_db(&plain[0], num_frames, freq, sample_rate),
+			bench_alias_db(&mip[0], num_frames, freq, sample_rate));
+	}
+
+	// the crossfade position (lo level + hi_weight) over a fine pitch sweep has to move without jumps, including
+	// across kf = 0 where level 0 hands over to level 1 (4096-sample cycle: kf = 0 at 48000/4096 Hz). The
+	// sweep steps 1/1000 octave, so the semitone fade out of level 0 moves 0.012 levels per step
+	wavetable_t wt1k;
+	wt1k.build(c.samples, 4096);
+	double prev_pos = 0, max_step = 0, worst_freq = 0;
+	for (int i = 0; i <= 8000; ++i) {
+		const double freq = 1.0 * pow(2.0, i / 1000.0); // 1 Hz to 256 Hz: kf from -3.55 to 4.45 at 4096 samples
+		const wavetable_lookup_t l = wt1k.select(freq, sample_rate);
+		const int lo = (int)((l.lo - wt1k.level(0)) / (wt1k.size + 1)), hi = (int)((l.hi - wt1k.level(0)) / (wt1k.size + 1));
+		const double pos = lo + l.hi_weight * (hi - lo);
+		if (i > 0 && fabs(pos - prev_pos) > max_step) { max_step = fabs(pos - prev_pos); worst_freq = freq; }
+		prev_pos = pos;
+	}
+	// and at exactly the native pitch the cycle plays as it is
+	const wavetable_lookup_t native = wt1k.select(sample_rate / 4096, sample_rate);
+	const bool native_ok = native.lo == wt1k.level(0) && native.hi_weight == 0;
+	printf("level crossfade over a 1-256 Hz sweep: largest step %.4f levels (at %.2f Hz), native pitch %s -> %s\n",
+		max_step, worst_freq, native_ok ? "level 0" : "NOT level 0", max_step < 0.02 && native_ok ? "OK" : "FAIL");
+
+	delete[] c.samples;
+}
+
+// voices rendered per core: one second of output at 48 kHz per run, against the one second real-time budget
+static void bench_oscillator() {
+	static const int voice_counts[] = { 8, 64, 128 };
+	static const char *kernels[] = { "scalar", "sse", "avx2" };
+	const double sample_rate = 48000;
+	const uint32_t num_frames = 48000;
+
+	SEGMENTED_BEZIER4 c = make_default_curve();
+	c.allocate_buffer(2048);
+	c.update_buffer();
+
+	wavetable_t wt;
+	wt.build(c.samples, 2048);
+
+	std::vector<float> out(num_frames * 2), ref(num_frames * 2);
+
+	printf("\noscillator_bank_t::render: %u frames at %.0f Hz (1 s of audio), stereo out, %u-sample cycle\n", num_frames, sample_rate, wt.size);
+	printf("%8s %8s %12s %10s %16s %12s\n", "kernel", "voices", "total (ms)", "cpu load", "voices per core", "max |diff|");
+
+	for (int nv : voice_counts) {
+		for (const char *k : kernels) {
+			if (!oscillator_set_kernel(k)) continue;
+
+			// every run starts from the same phases so the kernels can be compared sample for sample
+			auto run = [&](std::vector<float> &dst) {
+				oscillator_bank_t osc;
+				osc.init(sample_rate);
+				osc.set_table(&wt.tables[0], wt.size, wt.num_levels);
+				for (int v = 0; v < nv; ++v) {
+					osc.note_on(55.0f * powf(2.0f, v / 12.0f * 0.75f), 1.0f / nv); // spread over ~6 octaves so every mip level gets used
+				}
+				osc.render(&dst[0], num_frames, 2);
+			};
+
+			double ms = bench_best_of_ms(3, [&] { run(out); });
+
+			float diff = 0;
+			if (strcmp(k, "scalar") == 0) {
+				ref = out;
+			}
+			else {
+				for (size_t i = 0; i < out.size(); ++i) diff = (std::max)(diff, fabsf(out[i] - ref[i]));
+			}
+
+			printf("%8s %8d %12.3f %9.1f%% %16.0f %12.3e\n", k, nv, ms, ms / 10.0, nv * 1000.0 / ms, diff);
+		}
+	}
+
+	oscillator_set_kernel(NULL);
+	delete[] c.samples;
+}
+
+// a full re-render of every channel of a multichannel document, one thread vs. a worker per channel
+static void bench_multichannel() {
+	const size_t frame_size = 65536;
+	const int reps = 5;
+
+	std::mt19937 rng(16);
+	SEGMENTED_BEZIER4 curves[MC_MAX_CHANNELS];
+	for (auto &c : curves) c = bench_random_curve(rng, 64);
+
+	printf("\nmultichannel_curve_t::update_buffer: full re-render, %zu frames, 64 segments per channel, %u cores\n",
+		frame_size, std::thread::hardware_concurrency());
+	printf("%9s %14s %8s %14s %9s %10s %10s\n", "channels", "1 thread (ms)", "threads", "workers (ms)", "speedup", "per ch", "matches");
+
+	for (int nch = 1; nch <= MC_MAX_CHANNELS; ++nch) {
+		multichannel_curve_t serial, parallel;
+		serial.init(nch, frame_size, 0);
+		parallel.init(nch, frame_size, nch - 1); // a thread per channel even when there are fewer cores, to show the overhead too
+
+		auto run = [&](multichannel_curve_t &m) {
+			for (int c = 0; c < nch; ++c) m.set_channel(c, curves[c]);
+			m.update_buffer();
+		};
+
+		double t_serial = bench_best_of_ms(reps, [&] { run(serial); });
+		double t_parallel = bench_best_of_ms(reps, [&] { run(parallel); });
+
+		const bool same = memcmp(serial.frames, parallel.frames, frame_size * nch * sizeof(float)) == 0;
+
+		printf("%9d %14.3f %8d %14.3f %8.2fx %9.3f %10s\n", nch, t_serial, parallel.num_threads(), t_parallel,
+			t_serial / t_parallel, t_parallel / nch, same ? "OK" : "FAIL");
+	}
+
+	// init() again after update_buffer()s: the new workers have to wait for the next update_buffer instead of
+	// rasterizing right away, alongside the caller's set_channel
+	const int nch = 4;
+	multichannel_curve_t serial, reinit;
+	serial.init(nch, frame_size, 0);
+	for (int c = 0; c < nch; ++c) serial.set_channel(c, curves[c]);
+	serial.update_buffer();
+
+	bool same = true;
+	for (int pass = 0; pass < 4; ++pass) {
+		reinit.init(nch, frame_size, nch - 1);
+		for (int c = 0; c < nch; ++c) reinit.set_channel(c, curves[(c + pass) % nch]);
+		reinit.update_buffer();
+		for (int c = 0; c < nch; ++c) reinit.set_channel(c, curves[c]);
+		reinit.update_buffer();
+		same = same && memcmp(serial.frames, reinit.frames, frame_size * nch * sizeof(float)) == 0;
+	}
+	printf("init() again after update_buffer(), 4 times: %s\n", same ? "OK" : "FAIL");
+}
+
+// r2c plans at every planner level over a range of sizes: how long planning takes and what it buys per transform.
+// Wisdom is forgotten before each plan so MEASURE and PATIENT really measure. Then a wisdom round trip through
+// a file, which is what makes the second run of the editor plan instantly.
+static void bench_fft_planner() {
+	static const int sizes[] = { 256, 1024, 2048, 3072, 4096, 6144, 16384, 65536 };
+	static const unsigned levels[] = { FFTW_ESTIMATE, FFTW_MEASURE, FFTW_PATIENT };
+	const char *wisdom_path = "bench.wisdom";
+
+	printf("\nFFTW r2c planner levels: plan time and time per transform\n");
+	printf("%8s %10s %14s %16s %9s\n", "size", "planner", "plan (ms)", "transform (us)", "vs est.");
+
+	for (int n : sizes) {
+		float *in = static_cast<float*>(fftwf_malloc(n * sizeof(float)));
+		fftwf_complex *out = static_cast<fftwf_complex*>(fftwf_malloc((n / 2 + 1) * sizeof(fftwf_complex)));
+
+		double estimate_us = 0;
+		for (unsigned flags : levels) {
+			fft_forget_wisdom();
+
+			perf_timer_t pt;
+			fftwf_plan plan = fft_plan_r2c(n, in, out, flags);
+			const double plan_ms = pt.get_ms();
+
+			for (int i = 0; i < n; ++i) in[i] = sinf(0.01f * i) + 0.5f * cosf(0.37f * i);
+
+			const int reps = (std::max)(16, (int)(4194304 / n));
+			const double us = 1000.0 * bench_best_of_ms(3, [&] { for (int r = 0; r < reps; ++r) fftwf_execute(plan); }) / reps;
+			if (flags == FFTW_ESTIMATE) estimate_us = us;
+
+			printf("%8d %10s %14.2f %16.3f %8.2fx\n", n, fft_planner_name(flags), plan_ms, us, estimate_us / us);
+
+			fft_destroy_plan(plan);
+		}
+
+		fftwf_free(out);
+		fftwf_free(in);
+	}
+
+	// the editor's case: measure once, save, and plan from the file on the next run
+	const int n = 3072;
+	float *in = static_cast<float*>(fftwf_malloc(n * sizeof(float)));
+	fftwf_complex *out = static_cast<fftwf_complex*>(fftwf_malloc((n / 2 + 1) * sizeof(fftwf_complex)));
+
+	fft_forget_wisdom();
+	perf_timer_t t_cold;
+	fftwf_plan p = fft_plan_r2c(n, in, out, FFTW_MEASURE);
+	const double cold_ms = t_cold.get_ms();
+	fft_destroy_plan(p);
+	const int saved = fft_save_wisdom(wisdom_path);
+
+	fft_forget_wisdom();
+	const int loaded = fft_load_wisdom(wisdom_path);
+	perf_timer_t t_warm;
+	p = fft_plan_r2c(n, in, out, FFTW_MEASURE);
+	const double warm_ms = t_warm.get_ms();
+	fft_destroy_plan(p);
+
+	remove(wisdom_path);
+	fftwf_free(out);
+	fftwf_free(in);
+
+	printf("MEASURE plan for %d: %.2f ms without wisdom, %.2f ms with it loaded from disk (save %s, load %s)\n",
+		n, cold_ms, warm_ms, saved ? "OK" : "FAIL", loaded ? "OK" : "FAIL");
+}
+
+// spectrum_analyzer_t: the window kernels, each window's leakage on a sinusoid between two bins, and the cost
+// of analyzing several resolutions per pass
+static void bench_spectrum() {
+	static const char *kernels[] = { "scalar", "sse", "avx2" };
+	const size_t n = SPECTRUM_MAX_SIZE + 6; // the tails get used
+
+	std::vector<float> in(n), w(n), out(n), ref(n);
+	for (size_t i = 0; i < n; ++i) { in[i] = sinf(0.001f * i); w[i] = cosf(0.0003f * i); }
+
+	printf("\nspectrum_window_multiply: %zu samples\n", n);
+	printf("%8s %12s %14s %10s\n", "kernel", "total (ms)", "ns per sample", "matches");
+	for (const char *k : kernels) {
+		if (!spectrum_set_kernel(k)) continue;
+		const double ms = bench_best_of_ms(50, [&] { spectrum_window_multiply(&in[0], &w[0], &out[0], n); });
+		bool same = true;
+		if (strcmp(k, "scalar") == 0) ref = out;
+		else same = memcmp(&out[0], &ref[0], n * sizeof(float)) == 0;
+		printf("%8s %12.4f %14.3f %10s\n", k, ms, 1e6 * ms / n, same ? "OK" : "FAIL");
+	}
+	spectrum_set_kernel(NULL);
+
+	// magnitude -> dB over bins spanning 240 dB, with silent and NaN bins mixed in, against the exact value in double
+	const size_t num_bins = SPECTRUM_MAX_SIZE / 2 + 3;
+	const float scale = 1.0f / 4096, floor_dB = SPECTRUM_DEFAULT_FLOOR_DB;
+	fftwf_complex *bins = static_cast<fftwf_complex*>(fftwf_malloc(num_bins * sizeof(fftwf_complex)));
+
+	std::mt19937 rng(21);
+	std::uniform_real_distribution<float> exponent(-9, 3), angle(0, 2 * (float)M_PI);
+	for (size_t i = 0; i < num_bins; ++i) {
+		const float mag = (i % 97 == 0) ? 0.0f : powf(10.0f, exponent(rng)), phi = angle(rng);
+		bins[i][0] = mag * cosf(phi);
+		bins[i][1] = mag * sinf(phi);
+	}
+	bins[123][0] = NAN;
+
+	std::vector<double> exact(num_bins);
+	for (size_t i = 0; i < num_bins; ++i) {
+		const double p = ((double)bins[i][0] * bins[i][0] + (double)bins[i][1] * bins[i][1]) * scale;
+		exact[i] = (std::max)(10 * log10(p), (double)floor_dB);
+	}
+
+	std::vector<float> dB(num_bins), dB_ref(num_bins);
+
+	printf("\nspectrum_power_dB: %zu bins, floor %.0f dB\n", num_bins, floor_dB);
+	printf("%8s %12s %12s %12s %10s %10s\n", "kernel", "total (ms)", "ns per bin", "max |err|", "matches", "floored");
+
+	// the loop FFT_thread_proc used before: sqrt, then 20*log10f of the magnitude, -inf for silent bins
+	const float norm = sqrtf(scale);
+	const double legacy_ms = bench_best_of_ms(50, [&] {
+		for (size_t i = 0; i < num_bins; ++i) {
+			float mag = sqrt(bins[i][0] * bins[i][0] + bins[i][1] * bins[i][1]) * norm;
+			dB[i] = 20 * log10f(mag);
+		}
+	});
+	printf("%8s %12.4f %12.3f %12s %10s %10s\n", "legacy", legacy_ms, 1e6 * legacy_ms / num_bins, "-", "-", "no");
+
+	for (const char *k : kernels) {
+		if (!spectrum_set_kernel(k)) continue;
+		const double ms = bench_best_of_ms(50, [&] { spectrum_power_dB(bins, &dB[0], num_bins, scale, floor_dB); });
+
+		double max_err = 0;
+		bool floored = true;
+		for (size_t i = 0; i < num_bins; ++i) {
+			if (i == 123) { floored = floored && dB[i] == floor_dB; continue; }
+			max_err = (std::max)(max_err, fabs(dB[i] - exact[i]));
+			if (i % 97 == 0) floored = floored && dB[i] == floor_dB;
+		}
+
+		bool same = true;
+		if (strcmp(k, "scalar") == 0) dB_ref = dB;
+		else same = memcmp(&dB[0], &dB_ref[0], num_bins * sizeof(float)) == 0;
+
+		printf("%8s %12.4f %12.3f %12.2e %10s %10s\n", k, ms, 1e6 * ms / num_bins, max_err, same ? "OK" : "FAIL", floored ? "OK" : "FAIL");
+	}
+	spectrum_set_kernel(NULL);
+	fftwf_free(bins);
+
+	// a full-scale sinusoid halfway between bins 100 and 101, the worst case for every window
+	static const spectrum_window_t windows[] = { SPECTRUM_WINDOW_RECT, SPECTRUM_WINDOW_HANN, SPECTRUM_WINDOW_BLACKMAN_HARRIS, SPECTRUM_WINDOW_KAISER };
+	const uint32_t size = 4096;
+	const double bin = 100.5;
+
+	printf("\nwindows at %u, sinusoid at bin %.1f: peak level and the highest bin 10+ bins away\n", size, bin);
+	printf("%16s %12s %14s %16s\n", "window", "peak (dB)", "leakage (dB)", "analyze (us)");
+
+	spectrum_analyzer_t a;
+	for (spectrum_window_t win : windows) {
+		a.configure(size, win, SPECTRUM_DEFAULT_KAISER_BETA, FFTW_ESTIMATE);
+
+		auto fill = [&] { for (uint32_t i = 0; i < size; ++i) a.input()[i] = (float)sin(2 * M_PI * bin * i / size); };
+		fill();
+		a.analyze();
+
+		float peak = -1e30f, leak = -1e30f;
+		for (uint32_t k = 1; k <= a.num_bins(); ++k) {
+			const float v = a.dB[k - 1];
+			peak = (std::max)(peak, v);
+			if (fabs(k - bin) >= 10) leak = (std::max)(leak, v);
+		}
+
+		const double us = 1000.0 * bench_best_of_ms(20, [&] { fill(); a.analyze(); });
+		printf("%16s %12.2f %14.1f %16.2f\n", spectrum_window_name(win), peak, leak, us);
+	}
+
+	// the editor's multi-resolution case: one 2048-sample cycle resampled to and analyzed at every size
+	static const uint32_t sizes[] = { 1024, 4096, 16384, 65536 };
+	const uint32_t cycle_length = 2048;
+	std::vector<float> cycle(cycle_length);
+	for (uint32_t i = 0; i < cycle_length; ++i) cycle[i] = sinf(2 * (float)M_PI * i / cycle_length) + 0.3f * sinf(6 * (float)M_PI * i / cycle_length);
+
+	spectrum_analyzer_t levels[SPECTRUM_MAX_RESOLUTIONS];
+	cycle_resampler_t resamplers[SPECTRUM_MAX_RESOLUTIONS];
+
+	printf("\nmulti-resolution pass over a %u-sample cycle, hann window\n", cycle_length);
+	printf("%8s %16s %14s %16s\n", "size", "configure (ms)", "pass (ms)", "3rd harm. (dB)");
+
+	double total = 0;
+	for (int r = 0; r < SPECTRUM_MAX_RESOLUTIONS; ++r) {
+		perf_timer_t t;
+		levels[r].configure(sizes[r], SPECTRUM_WINDOW_HANN, SPECTRUM_DEFAULT_KAISER_BETA, FFTW_ESTIMATE);
+		const double configure_ms = t.get_ms();
+
+		const double ms = bench_best_of_ms(5, [&] {
+			resamplers[r].resample(&cycle[0], cycle_length, levels[r].input(), sizes[r]);
+			levels[r].analyze();
+		});
+		total += ms;
+
+		// the input is exactly one period, so harmonic k is bin k whatever the size
+		printf("%8u %16.3f %14.3f %16.2f\n", sizes[r], configure_ms, ms, levels[r].dB[2]);
+	}
+	printf("all %d sizes: %.3f ms per pass\n", SPECTRUM_MAX_RESOLUTIONS, total);
+
+	// a resize replans and reallocates, but the dB storage readers hold on to stays put
+	const float *held = levels[0].dB;
+	levels[0].configure(8192, SPECTRUM_WINDOW_KAISER, 5.0f, FFTW_ESTIMATE);
+	levels[0].configure(512, SPECTRUM_WINDOW_RECT, SPECTRUM_DEFAULT_KAISER_BETA, FFTW_ESTIMATE);
+	printf("dB storage across resizes: %s\n", held == levels[0].dB ? "OK" : "FAIL");
+}
+
+// the output tap and stft_t end to end: a linear sine sweep, converted to int16 with dither and pushed a period
+// at a time through an spsc_ring by a producer thread, the way pull_audio does. The consumer decodes channel 0
+// and checks each frame's peak bin against the sweep's frequency at the frame's center
+static void bench_stft() {
+	const uint32_t rate = 48000, period = 480, nch = 2;
+	const double seconds = 4, f0 = 200, f1 = 16000, amplitude = 0.5;
+	const uint32_t size = 2048, hop = 512;
+	const uint64_t total_frames = (uint64_t)(seconds * rate);
+	const size_t frame_bytes = nch * sample_format_bytes(SAMPLE_FORMAT_INT16);
+
+	spsc_ring<uint8_t> ring;
+	ring.init(8192 * frame_bytes);
+
+	std::atomic<bool> done(false);
+	std::atomic<uint64_t> retries(0);
+
+	std::thread producer([&] {
+		std::vector<float> mix(period * nch);
+		std::vector<uint8_t> out(period * frame_bytes);
+		dither_t dither;
+
+		for (uint64_t pos = 0; pos < total_frames; pos += period) {
+			const uint32_t n = (uint32_t)(std::min<uint64_t>)(period, total_frames - pos);
+			for (uint32_t i = 0; i < n; ++i) {
+				const double t = (double)(pos + i) / rate;
+				const float v = (float)(amplitude * sin(2 * M_PI * (f0 * t + 0.5 * (f1 - f0) * t * t / seconds)));
+				mix[nch * i] = mix[nch * i + 1] = v;
+			}
+			convert_samples(&mix[0], &out[0], (size_t)n * nch, SAMPLE_FORMAT_INT16, &dither);
+
+			// pull_audio drops the period instead; here every sample has to arrive for the check
+			while (!ring.push(&out[0], n * frame_bytes)) {
+				retries.fetch_add(1, std::memory_order_relaxed);
+				std::this_thread::yield();
+			}
+		}
+		done = true;
+	});
+
+	stft_t stft;
+	stft.init(size, hop, SPECTRUM_WINDOW_HANN, SPECTRUM_DEFAULT_KAISER_BETA, STFT_DEFAULT_HISTORY, FFTW_ESTIMATE);
+
+	std::vector<uint8_t> bytes(hop * frame_bytes);
+	std::vector<float> mono(hop);
+	uint64_t received = 0;
+	double max_bin_error = 0, feed_ms = 0;
+	int num_checked = 0, num_bad = 0;
+	float min_peak_dB = 1e30f;
+
+	while (!done || ring.read_available() > 0) {
+		// at most hop frames per feed, so it produces at most one frame
+		const size_t n = ring.pop(&bytes[0], bytes.size()) / frame_bytes;
+		if (n == 0) { std::this_thread::yield(); continue; }
+
+		convert_samples_to_float(&bytes[0], &mono[0], n, nch, 0, SAMPLE_FORMAT_INT16);
+		received += n;
+
+		perf_timer_t t;
+		const uint32_t produced = stft.feed(&mono[0], n);
+		feed_ms += t.get_ms();
+		if (!produced) continue;
+
+		const float *f = stft.frame(0);
+		uint32_t peak = 0;
+		for (uint32_t k = 1; k < stft.num_bins(); ++k) {
+			if (f[k] > f[peak]) peak = k;
+		}
+
+		const double center = ((stft.frames_produced - 1) * hop + size / 2.0) / rate;
+		const double expected_bin = (f0 + (f1 - f0) * center / seconds) * size / rate;
+		const double err = fabs((peak + 1) - expected_bin); // f[k] is bin k + 1
+
+		max_bin_error = (std::max)(max_bin_error, err);
+		min_peak_dB = (std::min)(min_peak_dB, f[peak]);
+		num_bad += err > 1.0;
+		++num_checked;
+	}
+	producer.join();
+
+	const uint64_t expected_frames = (received - size) / hop + 1;
+
+	printf("\nstft_t: %.0f s linear sweep %.0f -> %.0f Hz at %u Hz, int16 through the output tap, size %u, hop %u, hann\n",
+		seconds, f0, f1, rate, size, hop);
+	printf("%10s %10s %14s %16s %14s %14s\n", "received", "frames", "peak bin OK", "max |err| (bins)", "min peak (dB)", "ms per frame");
+	printf("%10llu %10llu %14s %16.2f %14.2f %14.4f\n", (unsigned long long)received, (unsigned long long)stft.frames_produced,
+		num_bad == 0 && received == total_frames && stft.frames_produced == expected_frames ? "OK" : "FAIL",
+		max_bin_error, min_peak_dB, feed_ms / (std::max)(num_checked, 1));
+	printf("ring full %llu times (the producer waited; pull_audio would have dropped a period)\n", (unsigned long long)retries.load());
+
+	const float *oldest = stft.frame(STFT_DEFAULT_HISTORY - 1);
+	printf("history: %u frames kept, oldest %s, one more %s\n", STFT_DEFAULT_HISTORY,
+		oldest ? "available" : "MISSING", stft.frame(STFT_DEFAULT_HISTORY) ? "FAIL" : "NULL as expected");
+}
+
+// cycle_resampler_t against band-limited test cycles with known values, and the spectrum analyzer's old input
+// (the curve t-marched again at FFT size) against its new one (the audio cycle, resampled)
+static void bench_resample() {
+	static const uint32_t sizes[][2] = { { 1024, 3072 }, { 1024, 4096 }, { 3072, 1024 }, { 1024, 1000 }, { 1001, 1024 } };
+	const int num_harmonics = 100;
+
+	std::mt19937 rng(18);
+	std::uniform_real_distribution<float> phase(0, 2 * (float)M_PI), amp(-1, 1);
+	float a[num_harmonics], p[num_harmonics];
+	for (int k = 0; k < num_harmonics; ++k) { a[k] = amp(rng) / (k + 1); p[k] = phase(rng); }
+
+	auto cycle_value = [&](double x) {
+		double v = 0;
+		for (int k = 0; k < num_harmonics; ++k) v += a[k] * cos(2 * M_PI * (k + 1) * x + p[k]);
+		return (float)v;
+	};
+
+	printf("\ncycle_resampler_t: %d-harmonic test cycle, max |error| against the exact values\n", num_harmonics);
+	printf("%8s %8s %12s %12s\n", "in", "out", "time (ms)", "max |err|");
+
+	cycle_resampler_t r;
+	for (const auto &s : sizes) {
+		std::vector<float> in(s[0]), out(s[1]);
+		for (uint32_t i = 0; i < s[0]; ++i) in[i] = cycle_value((double)i / s[0]);
+
+		double ms = bench_best_of_ms(3, [&] { r.resample(&in[0], s[0], &out[0], s[1]); });
+
+		float err = 0;
+		for (uint32_t i = 0; i < s[1]; ++i) err = (std::max)(err, fabsf(out[i] - cycle_value((double)i / s[1])));
+		printf("%8u %8u %12.4f %12.3e\n", s[0], s[1], ms, err);
+	}
+
+	// the spectrum input, before and after
+	const uint32_t cycle_length = 1024, fft_size = 3072;
+	SEGMENTED_BEZIER4 c = bench_segmented_curve(32);
+	c.allocate_buffer(cycle_length);
+	c.update_buffer();
+
+	SEGMENTED_BEZIER4 direct = bench_segmented_curve(32);
+	direct.allocate_buffer(fft_size);
+
+	std::vector<float> resampled(fft_size);
+	double t_march = bench_best_of_ms(5, [&] { direct.update_buffer_tmarch(8); });
+	double t_resample = bench_best_of_ms(5, [&] { r.resample(c.samples, cycle_length, &resampled[0], fft_size); });
+
+	// compare the two spectra over the bins both resolutions have
+	float *tmp = static_cast<float*>(fftwf_malloc(fft_size * sizeof(float)));
+	fftwf_complex *spec = static_cast<fftwf_complex*>(fftwf_malloc((fft_size / 2 + 1) * sizeof(fftwf_complex)));
+	fftwf_plan plan = fft_plan_r2c(fft_size, tmp, spec, FFTW_ESTIMATE);
+
+	auto magnitudes = [&](const float *x, std::vector<double> &m) {
+		memcpy(tmp, x, fft_size * sizeof(float));
+		fftwf_execute(plan);
+		m.resize(cycle_length / 2);
+		for (uint32_t k = 0; k < cycle_length / 2; ++k) m[k] = 2 * hypot(spec[k][0], spec[k][1]) / fft_size;
+	};
+
+	std::vector<double> m0, m1;
+	magnitudes(direct.samples, m0);
+	magnitudes(&resampled[0], m1);
+
+	fft_destroy_plan(plan);
+	fftwf_free(spec);
+	fftwf_free(tmp);
+
+	double max_db = 0;
+	for (uint32_t k = 1; k < cycle_length / 2; ++k) {
+		if (m0[k] < 1e-4) continue; // below -80 dB the t march's own error dominates
+		max_db = (std::max)(max_db, fabs(20 * log10(m1[k] / m0[k])));
+	}
+
+	printf("spectrum input, %u-sample cycle -> %u: t march at %u %.4f ms, resampling the audio cycle %.4f ms\n",
+		cycle_length, fft_size, fft_size, t_march, t_resample);
+	printf("max magnitude difference over harmonics 1..%u above -80 dB: %.3f dB\n", cycle_length / 2 - 1, max_db);
+
+	delete[] c.samples;
+	delete[] direct.samples;
+}
+
+// float -> device format conversion, every kernel against the scalar one. Input has out-of-range samples and
+// NaNs sprinkled in to exercise the saturation; with dither the kernels must still agree bit for bit.
+static void bench_convert() {
+	static const sample_format_t formats[] = { SAMPLE_FORMAT_INT16, SAMPLE_FORMAT_INT24, SAMPLE_FORMAT_INT32, SAMPLE_FORMAT_FLOAT32 };
+	static const char *kernels[] = { "scalar", "sse2", "avx2" };
+	const size_t n = (1 << 20) + 5; // odd length so the scalar tails get used
+
+	std::mt19937 rng(14);
+	std::uniform_real_distribution<float> dist(-1.2f, 1.2f);
+	std::vector<float> in(n);
+	for (size_t i = 0; i < n; ++i) in[i] = (i % 1021 == 0) ? NAN : dist(rng);
+
+	std::vector<uint8_t> out(4 * n), ref(4 * n);
+
+	printf("\nconvert_samples: %zu samples\n", n);
+	printf("%8s %8s %7s %12s %14s %10s\n", "format", "kernel", "dither", "total (ms)", "ns per sample", "matches");
+
+	// the clamp-and-cast loop pull_audio used before
+	std::vector<short> legacy(n);
+	double legacy_ms = bench_best_of_ms(5, [&] {
+		for (size_t i = 0; i < n; ++i) {
+			const float s = (std::min)((std::max)(in[i], -1.0f), 1.0f);
+			legacy[i] = (short)(32767.0f * s);
+		}
+	});
+	printf("%8s %8s %7s %12.3f %14.3f %10s\n", "int16", "legacy", "no", legacy_ms, 1e6 * legacy_ms / n, "-");
+
+	for (sample_format_t f : formats) {
+		for (int use_dither = 0; use_dither <= (sample_format_wants_dither(f) ? 1 : 0); ++use_dither) {
+			for (const char *k : kernels) {
+				if (!convert_samples_set_kernel(k)) continue;
+
+				dither_t d;
+				double ms = bench_best_of_ms(5, [&] {
+					d.seed(1);
+					convert_samples(&in[0], &out[0], n, f, use_dither ? &d : NULL);
+				});
+
+				const size_t bytes = n * sample_format_bytes(f);
+				bool same = true;
+				if (strcmp(k, "scalar") == 0) {
+					ref = out;
+				}
+				else {
+					same = memcmp(&out[0], &ref[0], bytes) == 0;
+				}
+
+				printf("%8s %8s %7s %12.3f %14.3f %10s\n", sample_format_name(f), k, use_dither ? "yes" : "no",
+					ms, 1e6 * ms / n, same ? "OK" : "FAIL");
+			}
+		}
+	}
+
+	convert_samples_set_kernel(NULL);
+}
+
+// The block adapter driven like a device would: every period the callback pulls period frames, which are
+// heard device_periods periods later. Note-ons arrive at random times and are applied at the next block
+// render; the latency is from arrival until the first affected frame is heard.
+struct latency_sim_t {
+	oscillator_bank_t osc;
+	uint64_t now; // device time of the current callback, in frames
+	uint64_t rendered; // frames rendered so far = stream index of the next one
+	uint32_t output_delay; // frames between a frame being pulled and heard
+
+	std::vector<uint64_t> arrivals;
+	size_t next_event;
+	double latency_sum;
+	uint64_t latency_max;
+};
+
+static void latency_sim_render(float *out, uint32_t num_frames, void *userdata) {
+	latency_sim_t &s = *static_cast<latency_sim_t*>(userdata);
+
+	while (s.next_event < s.arrivals.size() && s.arrivals[s.next_event] <= s.now) {
+		const uint64_t latency = s.rendered + s.output_delay - s.arrivals[s.next_event];
+		s.latency_sum += latency;
+		s.latency_max = (std::max)(s.latency_max, latency);
+		++s.next_event;
+	}
+
+	s.osc.render(out, num_frames, 2);
+	s.rendered += num_frames;
+}
+
+static void bench_block_size() {
+	static const uint32_t periods[] = { 128, 480 }; // 480 = 10 ms at 48 kHz, a typical shared-mode WASAPI period
+	static const uint32_t block_sizes[] = { 16, 32, 64, 128, 256, 480, 512, 1024, 2048 };
+	const int device_periods = 2;
+	const double rate = 48000;
+	const int num_voices = 64;
+	const double seconds = 10;
+	const int num_events = 2000;
+
+	// the cycle stays at 1024 frames whatever the period and block size
+	SEGMENTED_BEZIER4 c = make_default_curve();
+	c.allocate_buffer(1024);
+	c.update_buffer();
+	wavetable_t wt;
+	wt.build(c.samples, 1024);
+
+	for (uint32_t period : periods) {
+		const int num_periods = (int)(seconds * rate / period);
+
+		std::mt19937 rng(99);
+		std::uniform_int_distribution<uint64_t> when(0, (uint64_t)(num_periods - 1) * period);
+		std::vector<uint64_t> arrivals(num_events);
+		for (auto &a : arrivals) a = when(rng);
+		std::sort(arrivals.begin(), arrivals.end());
+
+		printf("\nsynthesis block size vs. device period %u frames (%.1f ms), %d periods of device buffering, %d voices\n",
+			period, 1000.0 * period / rate, device_periods, num_voices);
+		printf("%8s %16s %18s %17s %15s\n", "block", "render (ms/s)", "mean latency (ms)", "max latency (ms)", "blocks/period");
+
+		std::vector<float> out(period * 2);
+
+		for (uint32_t b : block_sizes) {
+			latency_sim_t s;
+			s.osc.init(rate);
+			s.osc.set_table(&wt.tables[0], wt.size, wt.num_levels);
+			for (int v = 0; v < num_voices; ++v) s.osc.note_on(110.0f * (1 + v * 0.05f), 1.0f / num_voices);
+			s.now = s.rendered = 0;
+			s.output_delay = device_periods * period;
+			s.arrivals = arrivals;
+			s.next_event = 0;
+			s.latency_sum = 0;
+			s.latency_max = 0;
+
+			block_adapter_t adapter;
+			adapter.init(b, 2, latency_sim_render, &s);
+
+			perf_timer_t t;
+			for (int k = 0; k < num_periods; ++k) {
+				s.now = (uint64_t)k * period;
+				adapter.pull(&out[0], period);
+			}
+			const double ms = t.get_ms();
+
+			printf("%8u %16.3f %18.2f %17.2f %15.2f\n", b, ms / seconds,
+				1000.0 * s.latency_sum / (s.next_event ? s.next_event : 1) / rate, 1000.0 * s.latency_max / rate,
+				(double)adapter.blocks_rendered / num_periods);
+		}
+	}
+
+	delete[] c.samples;
+}
+
+// stress test for the audio handoff: one thread publishes frames as fast as it can, another reads them
+// as fast as it can, and every frame read has to be complete (all samples from the same publish)
+static void bench_triple_buffer() {
+	const size_t frame_len = 2 * 1024;
+	const double duration_s = 2.0;
+
+	// the initial frame is seq 0, the reader can get to it before the first publish
+	std::vector<uint32_t> initial(frame_len);
+	for (size_t i = 0; i < frame_len; ++i) initial[i] = (uint32_t)i;
+
+	triple_buffer<std::vector<uint32_t>> tb;
+	tb.init(initial);
+
+	std::atomic<bool> done(false);
+	uint32_t published = 0;
+
+	std::thread producer([&] {
+		uint32_t seq = 0;
+		while (!done.load(std::memory_order_relaxed)) {
+			++seq;
+			std::vector<uint32_t> &w = tb.write_buffer();
+			for (size_t i = 0; i < frame_len; ++i) w[i] = seq ^ (uint32_t)i;
+			tb.publish();
+		}
+		published = seq;
+	});
+
+	size_t reads = 0, new_frames = 0, torn = 0, out_of_order = 0;
+	uint32_t last_seq = 0;
+
+	perf_timer_t t;
+	while (t.get_s() < duration_s) {
+		bool fresh = tb.has_new();
+		const std::vector<uint32_t> &r = tb.read_buffer();
+		const uint32_t seq = r[0];
+
+		for (size_t i = 1; i < frame_len; ++i) {
+			if ((r[i] ^ (uint32_t)i) != seq) { ++torn; break; }
+		}
+
+		if (seq < last_seq) ++out_of_order;
+		if (fresh) ++new_frames;
+		last_seq = seq;
+		++reads;
+	}
+
+	done = true;
+	producer.join();
+
+	printf("\ntriple_buffer: %.1f s of concurrent publish/read, %zu-sample frames\n", duration_s, frame_len);
+	printf("published %u frames, %zu reads (%zu of them picked up a new frame)\n", published, reads, new_frames);
+	printf("torn frames: %zu, out of order: %zu -> %s\n", torn, out_of_order, (torn || out_of_order) ? "FAIL" : "OK");
+}
+
+// One producer republishing a curve as fast as it can, two readers acquiring snapshots and holding them for a
+// while. Every control point of snapshot k has y = k, so a snapshot changing while held shows up as mixed values.
+// Also compares taking a snapshot with the per-iteration copy the FFT thread used to make.
+static void bench_snapshot() {
+	const size_t num_segments = 64;
+	const double duration_s = 2.0;
+
+	snapshot_pool<SEGMENTED_BEZIER4, 4> pool;
+
+	std::mt19937 rng(17);
+	const SEGMENTED_BEZIER4 base = bench_random_curve(rng, num_segments);
+
+	std::atomic<bool> done(false);
+	uint64_t published = 0, skipped = 0;
+
+	std::thread producer([&] {
+		SEGMENTED_BEZIER4 c = base;
+		while (!done.load(std::memory_order_relaxed)) {
+			SEGMENTED_BEZIER4 *s = pool.begin_write();
+			if (!s) { ++skipped; continue; }
+
+			const float k = (float)(published + 1);
+			for (auto &p : c.points) p.y = k;
+			*s = c;
+			pool.publish();
+			++published;
+		}
+	});
+
+	struct reader_stats_t { size_t acquires, inconsistent, out_of_order; };
+	reader_stats_t stats[2] = {};
+
+	auto reader = [&](reader_stats_t &st) {
+		uint64_t last = 0, last_polled = 0;
+		perf_timer_t t;
+		while (t.get_s() < duration_s) {
+			// the polling the FFT thread does through get_rasterized_cycle_version()
+			const uint64_t v = pool.version();
+			if (v < last_polled) ++st.out_of_order;
+			last_polled = v;
+
+			snapshot_pool<SEGMENTED_BEZIER4, 4>::ref r = pool.acquire();
+			if (!r) continue;
+
+			if (r.version() < last) ++st.out_of_order;
+			last = r.version();
+
+			// read it twice, some time apart, while the producer keeps publishing
+			const float k = r->points[0].y;
+			for (int pass = 0; pass < 2; ++pass) {
+				for (const vec2 &p : r->points) {
+					if (p.y != k) { ++st.inconsistent; break; }
+				}
+				std::this_thread::yield();
+			}
+			++st.acquires;
+		}
+	};
+
+	std::thread r0(reader, std::ref(stats[0]));
+	reader(stats[1]);
+	r0.join();
+	done = true;
+	producer.join();
+
+	const size_t acquires = stats[0].acquires + stats[1].acquires;
+	const size_t inconsistent = stats[0].inconsistent + stats[1].inconsistent;
+	const size_t out_of_order = stats[0].out_of_order + stats[1].out_of_order;
+
+	const int n = 100000;
+	double t_acquire = bench_best_of_ms(3, [&] { for (int i = 0; i < n; ++i) { auto r = pool.acquire(); } });
+	size_t sink = 0;
+	double t_copy = bench_best_of_ms(3, [&] { for (int i = 0; i < n / 100; ++i) { SEGMENTED_BEZIER4 c = base; sink += c.parts.size(); } });
+
+	printf("\nsnapshot_pool: %.1f s, 1 producer, 2 readers, %zu-segment curve\n", duration_s, base.parts.size());
+	printf("published %llu snapshots (%llu times all slots were held), %zu acquires\n",
+		(unsigned long long)published, (unsigned long long)skipped, acquires);
+	printf("inconsistent snapshots: %zu, out of order: %zu -> %s\n", inconsistent, out_of_order, (inconsistent || out_of_order) ? "FAIL" : "OK");
+	printf("acquire + release: %.1f ns, copying the curve: %.1f ns%s\n", 1e6 * t_acquire / n, 1e6 * t_copy / (n / 100), sink == 1 ? " " : "");
+}
+
+// runs the null backend for a while and looks at how evenly it pulls periods
+static void bench_null_backend() {
+	const uint32_t period = 256;
+	const double duration_s = 2.0;
+
+	AudioBackend *b = create_audio_backend("null", NULL);
+
+	wave_format_t fmt = {};
+	fmt.num_channels = 2;
+	fmt.sample_rate = 48000;
+	fmt.bit_depth = 16;
+	b->open(fmt, period);
+
+	struct pull_stats_t {
+		perf_timer_t clock;
+		std::vector<double> times;
+	} stats;
+	stats.times.reserve((size_t)(4 * duration_s * fmt.sample_rate / period));
+
+	b->start([](void *dst, uint32_t num_frames, void *userdata) {
+		pull_stats_t *s = static_cast<pull_stats_t*>(userdata);
+		memset(dst, 0, num_frames * 2 * sizeof(short));
+		if (s->times.size() < s->times.capacity()) s->times.push_back(s->clock.get_ms());
+	}, &stats);
+
+	std::this_thread::sleep_for(std::chrono::duration<double>(duration_s));
+	b->stop();
+	delete b;
+
+	const double expected_ms = 1000.0 * period / fmt.sample_rate;
+	double max_dev = 0;
+	for (size_t i = 1; i < stats.times.size(); ++i) {
+		max_dev = (std::max)(max_dev, fabs((stats.times[i] - stats.times[i - 1]) - expected_ms));
+	}
+
+	const size_t n = stats.times.size();
+	printf("\nnull audio backend: %u-frame periods at %d Hz for %.1f s\n", period, fmt.sample_rate, duration_s);
+	printf("%zu periods pulled, mean period %.4f ms (expected %.4f ms), max deviation %.4f ms\n",
+		n, n > 1 ? (stats.times[n - 1] - stats.times[0]) / (n - 1) : 0.0, expected_ms, max_dev);
+}
+
+#ifdef WFEDIT_EGL
+
+// A GL 4.4 core context without a window or a display server, e.g. Mesa's llvmpipe on a headless machine.
+struct bench_egl_context_t {
+	EGLDisplay display;
+	EGLContext context;
+
+	bench_egl_context_t() : display(EGL_NO_DISPLAY), context(EGL_NO_CONTEXT) {}
+	~bench_egl_context_t() {
+		if (context != EGL_NO_CONTEXT) {
+			eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+			eglDestroyContext(display, context);
+		}
+		if (display != EGL_NO_DISPLAY) eglTerminate(display);
+	}
+
+	int open() {
+		// llvmpipe rasterizes on the calling thread when it has only one to work with, and then a fence is
+		// always signaled by the time anyone looks at it. With two it runs behind, like a GPU
+		setenv("LP_NUM_THREADS", "2", 0);
+
+		PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+			(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		display = get_platform_display ? get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL)
+			: eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+		EGLint major, minor;
+		if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+			printf("bench_egl_context_t: no EGL display (0x%x).\n", eglGetError());
+			display = EGL_NO_DISPLAY;
+			return 0;
+		}
+
+		eglBindAPI(EGL_OPENGL_API);
+
+		const EGLint attribs[] = {
+			EGL_CONTEXT_MAJOR_VERSION, 4, EGL_CONTEXT_MINOR_VERSION, 4,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_NONE
+		};
+		// no config and no surface: everything is drawn into framebuffer objects
+		context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attribs);
+		if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+			printf("bench_egl_context_t: couldn't make a surfaceless GL 4.4 core context (0x%x).\n", eglGetError());
+			return 0;
+		}
+
+		if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+			printf("bench_egl_context_t: gladLoadGLLoader failed.\n");
+			return 0;
+		}
+
+		return 1;
+	}
+};
+
+static GLuint bench_compile_program(const char *vs, const char *fs) {
+	GLuint program = glCreateProgram();
+	const char *sources[2] = { vs, fs };
+	const GLenum types[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+
+	for (int i = 0; i < 2; ++i) {
+		GLuint sh = glCreateShader(types[i]);
+		glShaderSource(sh, 1, &sources[i], NULL);
+		glCompileShader(sh);
+		glAttachShader(program, sh);
+		glDeleteShader(sh);
+	}
+	glLinkProgram(program);
+
+	GLint ok = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &ok);
+	if (!ok) {
+		char log[1024] = "";
+		glGetProgramInfoLog(program, sizeof(log), NULL, log);
+		printf("bench_compile_program: %s\n", log);
+	}
+
+	return program;
+}
+
+#ifndef WFEDIT_SHADER_DIR
+#define WFEDIT_SHADER_DIR "shaders"
+#endif
+
+// shaders/spectrum/vs as the editor draws it: one point per bin from spectrum_ring's current region, so
+// gl_VertexID starts at the region's first vertex. Its output positions are captured with transform feedback
+// and bin i of every region has to land at x = i/bins, y = dB[i]. Returns the number of errors.
+static int bench_gl_spectrum_vs(bool persistent) {
+	const char *path = WFEDIT_SHADER_DIR "/spectrum/vs";
+	FILE *fp = fopen(path, "rb");
+	if (!fp) {
+		printf("bench_gl_spectrum_vs: couldn't open %s\n", path);
+		return 1;
+	}
+	std::string source;
+	char chunk[512];
+	size_t n;
+	while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0) source.append(chunk, n);
+	fclose(fp);
+
+	const char *src = source.c_str();
+	GLuint sh = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(sh, 1, &src, NULL);
+	glCompileShader(sh);
+	GLuint program = glCreateProgram();
+	glAttachShader(program, sh);
+	glDeleteShader(sh);
+	const char *varyings[] = { "gl_Position" };
+	glTransformFeedbackVaryings(program, 1, varyings, GL_INTERLEAVED_ATTRIBS);
+	glLinkProgram(program);
+
+	GLint ok = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &ok);
+	if (!ok) {
+		char log[1024] = "";
+		glGetProgramInfoLog(program, sizeof(log), NULL, log);
+		printf("bench_gl_spectrum_vs: %s\n", log);
+		glDeleteProgram(program);
+		return 1;
+	}
+
+	const int bins = 512;
+	gl_buffer_ring_t ring;
+	ring.init(bins * sizeof(float), persistent);
+
+	GLuint vao, captured;
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, ring.buffer);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 1, GL_FLOAT, GL_FALSE, 0, 0);
+	glGenBuffers(1, &captured);
+	glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, captured);
+	glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, bins * 4 * sizeof(float), NULL, GL_STREAM_READ);
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, captured);
+
+	glUseProgram(program);
+	glUniform1f(glGetUniformLocation(program, "uNumBins"), (float)bins);
+	const GLint first_location = glGetUniformLocation(program, "uFirstBin");
+	glEnable(GL_RASTERIZER_DISCARD);
+
+	int errors = 0;
+	std::vector<float> positions(bins * 4);
+	for (int f = 0; f < 2 * GL_RING_REGIONS; ++f) {
+		float *p = static_cast<float*>(ring.begin_write());
+		for (int i = 0; i < bins; ++i) p[i] = -(float)(f * 7 + i % 100);
+		ring.end_write(bins * sizeof(float));
+
+		// the same calls as draw() in glwindow.cpp
+		const GLint first_bin = ring.first_vertex(sizeof(float));
+		glUniform1i(first_location, first_bin);
+		glBeginTransformFeedback(GL_POINTS);
+		glDrawArrays(GL_POINTS, first_bin, bins);
+		glEndTransformFeedback();
+		ring.fence();
+
+		glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, 0, bins * 4 * sizeof(float), &positions[0]);
+		for (int i = 0; i < bins; ++i) {
+			if (fabsf(positions[i * 4] - (float)i / bins) > 1e-6f || positions[i * 4 + 1] != -(float)(f * 7 + i % 100)) {
+				printf("bench_gl_spectrum_vs: region %d, bin %d drawn at (%g, %g)\n", ring.region, i, positions[i * 4], positions[i * 4 + 1]);
+				++errors;
+				break;
+			}
+		}
+	}
+
+	glDisable(GL_RASTERIZER_DISCARD);
+	glBindVertexArray(0);
+	glDeleteVertexArrays(1, &vao);
+	glDeleteBuffers(1, &captured);
+	glDeleteProgram(program);
+	ring.destroy();
+
+	return errors;
+}
+
+#endif
+
+// gl_buffer_ring_t through a few dozen frames, mapped persistently and with the glBufferSubData fallback. Every
+// frame writes a pattern into its region, draws from it (a fullscreen triangle with enough fragment work to
+// keep the GPU behind) and copies the region to a log buffer on the GPU. The log then has to hold every
+// frame's pattern, i.e. no region was overwritten while the GPU still needed it, and each region what was
+// last written to it. begin_write must never return a region whose fence hasn't signaled.
+// The editor's spectrum vertex shader is drawn through the ring too, see bench_gl_spectrum_vs.
+static void bench_gl_ring() {
+#ifndef WFEDIT_EGL
+	printf("\ngl_ring: needs a build with WFEDIT_EGL (a surfaceless EGL context), skipped\n");
+#else
+	const uint32_t count = 1024; // floats per region
+	const size_t bytes = count * sizeof(float);
+	const int num_frames = 36;
+	const int fb_size = 256;
+
+	bench_egl_context_t egl;
+	if (!egl.open()) {
+		printf("\ngl_ring: no GL context, skipped\n");
+		return;
+	}
+
+	printf("\ngl_ring: %s | %s\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+	printf("%d frames of %zu bytes, %dx%d fullscreen draw per frame\n", num_frames, bytes, fb_size, fb_size);
+	printf("%18s %10s %10s %10s %10s %10s %10s\n", "mode", "ms/frame", "busy", "waits", "wait (ms)", "errors", "");
+
+	GLuint fbo, rb;
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glGenRenderbuffers(1, &rb);
+	glBindRenderbuffer(GL_RENDERBUFFER, rb);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, fb_size, fb_size);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rb);
+	glViewport(0, 0, fb_size, fb_size);
+
+	// the triangle's corners come from the vertex ID, the attribute only feeds the fragment loop
+	const GLuint program = bench_compile_program(
+		"#version 440 core\n"
+		"layout(location = 0) in float v;\n"
+		"uniform int uFirst;\n"
+		"out float fv;\n"
+		"void main() {\n"
+		"	int i = gl_VertexID - uFirst;\n"
+		"	fv = v;\n"
+		"	gl_Position = vec4(float((i & 1) * 4 - 1), float((i >> 1) * 4 - 1), 0.0, 1.0);\n"
+		"}\n",
+		"#version 440 core\n"
+		"in float fv;\n"
+		"out vec4 color;\n"
+		"void main() {\n"
+		"	float a = fv;\n"
+		"	for (int i = 0; i < 128; ++i) a = sin(a) * 1.0001 + 0.1;\n"
+		"	color = vec4(a);\n"
+		"}\n");
+	glUseProgram(program);
+	const GLint first_location = glGetUniformLocation(program, "uFirst");
+
+	GLuint vao, log_buffer;
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(1, &log_buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, log_buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, num_frames * bytes, NULL, GL_DYNAMIC_COPY);
+
+	std::vector<float> readback(num_frames * count);
+
+	for (int mode = 0; mode < 2; ++mode) {
+		const bool persistent = mode == 0;
+
+		gl_buffer_ring_t ring;
+		ring.init(bytes, persistent);
+
+		int errors = 0, busy = 0;
+		if (ring.persistent != (persistent && GLAD_GL_VERSION_4_4)) ++errors;
+
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, ring.buffer);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 1, GL_FLOAT, GL_FALSE, 0, 0);
+
+		perf_timer_t t;
+		for (int f = 0; f < num_frames; ++f) {
+			busy += ring.next_region_busy();
+
+			float *p = static_cast<float*>(ring.begin_write());
+			if (!ring.current_region_free()) ++errors;
+			if (ring.region != f % GL_RING_REGIONS || ring.first_vertex(sizeof(float)) != (GLint)(ring.region * count)) ++errors;
+
+			for (uint32_t i = 0; i < count; ++i) p[i] = (float)(f * 10000 + i);
+			ring.end_write(bytes);
+
+			glUniform1i(first_location, ring.first_vertex(sizeof(float)));
+			glDrawArrays(GL_TRIANGLES, ring.first_vertex(sizeof(float)), 3);
+
+			glBindBuffer(GL_COPY_READ_BUFFER, ring.buffer);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, log_buffer);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, ring.region * ring.region_size, f * bytes, bytes);
+
+			ring.fence();
+		}
+		glFinish();
+		const double ms = t.get_ms();
+
+		// what the GPU saw, frame by frame
+		glBindBuffer(GL_COPY_READ_BUFFER, log_buffer);
+		glGetBufferSubData(GL_COPY_READ_BUFFER, 0, num_frames * bytes, &readback[0]);
+		for (int f = 0; f < num_frames; ++f) {
+			for (uint32_t i = 0; i < count; ++i) {
+				if (readback[f * count + i] != (float)(f * 10000 + i)) { ++errors; break; }
+			}
+		}
+
+		// and what the regions hold: the last frame written into each
+		glBindBuffer(GL_COPY_READ_BUFFER, ring.buffer);
+		for (int r = 0; r < GL_RING_REGIONS; ++r) {
+			const int f = r + (num_frames - 1 - r) / GL_RING_REGIONS * GL_RING_REGIONS;
+			glGetBufferSubData(GL_COPY_READ_BUFFER, r * ring.region_size, bytes, &readback[0]);
+			for (uint32_t i = 0; i < count; ++i) {
+				if (readback[i] != (float)(f * 10000 + i)) { ++errors; break; }
+			}
+		}
+
+		// growing gives a new, larger buffer that starts over at region 0
+		const GLuint old_buffer = ring.buffer;
+		if (ring.grow(bytes) || !ring.grow(2 * bytes + 1) || ring.region_size != 4 * bytes || ring.buffer == old_buffer) ++errors;
+		float *p = static_cast<float*>(ring.begin_write());
+		for (uint32_t i = 0; i < 4 * count; ++i) p[i] = (float)i;
+		ring.end_write(4 * bytes);
+		if (ring.region != 0 || ring.first_vertex(sizeof(float)) != 0) ++errors;
+		glBindBuffer(GL_COPY_READ_BUFFER, ring.buffer);
+		glGetBufferSubData(GL_COPY_READ_BUFFER, 0, bytes, &readback[0]);
+		for (uint32_t i = 0; i < count; ++i) {
+			if (readback[i] != (float)i) { ++errors; break; }
+		}
+
+		glBindVertexArray(0);
+		errors += bench_gl_spectrum_vs(persistent);
+		glUseProgram(program);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+		printf("%18s %10.2f %10d %10llu %10.2f %10d %10s\n", ring.persistent ? "persistent-mapped" : "glBufferSubData",
+			ms / num_frames, busy, (unsigned long long)ring.num_waits, ring.wait_ms, errors, errors ? "FAIL" : "OK");
+
+		glBindVertexArray(0);
+		ring.destroy();
+	}
+
+	glDeleteVertexArrays(1, &vao);
+	glDeleteBuffers(1, &log_buffer);
+	glDeleteProgram(program);
+	glDeleteRenderbuffers(1, &rb);
+	glDeleteFramebuffers(1, &fbo);
+#endif
+}
+
+struct bench_entry_t {
+	const char *name;
+	void(*run)();
+};
+
+static const bench_entry_t benchmarks[] = {
+	{ "update_buffer", bench_update_buffer },
+	{ "segment_lookup", bench_segment_lookup },
+	{ "cursor", bench_cursor },
+	{ "evaluate_batch", bench_evaluate_batch },
+	{ "forward_difference", bench_forward_difference },
+	{ "incremental", bench_incremental },
+	{ "triple_buffer", bench_triple_buffer },
+	{ "snapshot", bench_snapshot },
+	{ "null_backend", bench_null_backend },
+	{ "curve_io", bench_curve_io },
+	{ "wavetable", bench_wavetable },
+	{ "oscillator", bench_oscillator },
+	{ "block_size", bench_block_size },
+	{ "convert", bench_convert },
+	{ "layout", bench_layout },
+	{ "multichannel", bench_multichannel },
+	{ "resample", bench_resample },
+	{ "fft_planner", bench_fft_planner },
+	{ "spectrum", bench_spectrum },
+	{ "stft", bench_stft },
+	{ "gl_ring", bench_gl_ring },
+};
+
+int wfedit_run_benchmarks(const char *which) {
+
+	int num_run = 0;
+
+	for (const auto &b : benchmarks) {
+		if (which && which[0] && strcmp(which, b.name) != 0) continue;
+		b.run();
+		++num_run;
+	}
+
+	if (num_run == 0) {
+		printf("wfedit_run_benchmarks: no benchmark named \"%s\". Available:\n", which);
+		for (const auto &b : benchmarks) printf("  %s\n", b.name);
+		return 0;
+	}
+
+	return 1;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+// Offline micro-benchmarks, run with "waveformedit.exe --bench [name]".
+// Without a name every benchmark is run.
+
+int wfedit_run_benchmarks(const char *which);
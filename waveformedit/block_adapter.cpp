@@ -0,0 +1,42 @@
+#include "block_adapter.h"
+
+#include <cstring>
+#include <algorithm>
+
+void block_adapter_t::init(uint32_t a_block_frames, int a_num_channels, block_render_callback_t a_render, void *a_userdata) {
+	block_frames = a_block_frames;
+	num_channels = a_num_channels;
+	block.assign(block_frames * num_channels, 0);
+	block_pos = block_frames;
+	render = a_render;
+	userdata = a_userdata;
+	blocks_rendered = 0;
+}
+
+void block_adapter_t::pull(float *out, uint32_t num_frames) {
+	while (num_frames > 0) {
+
+		if (block_pos == block_frames) {
+			// whole blocks go straight to the output, only a trailing partial block is rendered into the buffer
+			while (num_frames >= block_frames) {
+				render(out, block_frames, userdata);
+				++blocks_rendered;
+				out += block_frames * num_channels;
+				num_frames -= block_frames;
+			}
+
+			if (num_frames == 0) break;
+
+			render(&block[0], block_frames, userdata);
+			++blocks_rendered;
+			block_pos = 0;
+		}
+
+		const uint32_t n = (std::min)(num_frames, block_frames - block_pos);
+		memcpy(out, &block[block_pos * num_channels], n * num_channels * sizeof(float));
+
+		block_pos += n;
+		out += n * num_channels;
+		num_frames -= n;
+	}
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Lets the synthesis side work in its own block size while the device asks for whatever period it negotiated.
+// pull() hands out frames from the current block and renders a new one through the callback whenever it
+// runs dry, so at most block_frames - 1 rendered frames are ever held back. Everything happens on the
+// caller's (the audio) thread.
+
+typedef void(*block_render_callback_t)(float *out, uint32_t num_frames, void *userdata);
+
+struct block_adapter_t {
+	uint32_t block_frames;
+	int num_channels;
+	std::vector<float> block; // interleaved, one block
+	uint32_t block_pos; // frames of block already handed out, block_frames when it's used up
+
+	block_render_callback_t render;
+	void *userdata;
+
+	uint64_t blocks_rendered;
+
+	block_adapter_t() : block_frames(0), num_channels(0), block_pos(0), render(NULL), userdata(NULL), blocks_rendered(0) {}
+
+	void init(uint32_t block_frames, int num_channels, block_render_callback_t render, void *userdata);
+
+	void pull(float *out, uint32_t num_frames);
+
+	uint32_t buffered() const { return block_frames - block_pos; } // rendered but not yet pulled
+};
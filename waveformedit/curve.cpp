@@ -1,8 +1,10 @@
 #include "curve.h"
+#include "curve_simd.h"
 
 #include <xmmintrin.h>
 #include <smmintrin.h>
 #include <fstream>
+#include <algorithm>
 
 inline void print_mat4(const mat4 &M) {
 	for (int i = 0; i < 4; ++i) {
@@ -13,6 +15,9 @@ inline void print_mat4(const mat4 &M) {
 }
 
 static int split_bezier(float t, const mat24& points24, BEZIER4_fragment *out);
+static void forward_difference_cubic(const mat24 &M, float t0, float dt, size_t n, vec2 *out, size_t reanchor_interval);
+
+#define EVALUATE_BATCH_SIZE 64 // t values handed to evaluate_batch at a time by the samplers
 
 const mat4 BEZIER4::weights = mat4(
 	vec4(1, -3, 3, -1), 
@@ -109,6 +114,10 @@ vec2 BEZIER4::evaluate_derivative(float t) const {
 }
 
 
+void BEZIER4::evaluate_batch(const float *t, vec2 *out, size_t n) const {
+	bezier_evaluate_batch(matrix_repr, t, out, n);
+}
+
 BEZIER4::BEZIER4(const vec2 &aP0, const vec2 &aP1, const vec2 &aP2, const vec2 &aP3) 
 	: P0(aP0), P1(aP1), P2(aP2), P3(aP3) {
 
@@ -186,18 +195,15 @@ static inline float LUT_find_y_for_x(float x, const vec2 *LUT, int buf_size, int
 	return LUT[i].y;
 }
 
-float *BEZIER4::sample_curve(UINT32 frame_size, int precision) const {
-	float *samples = new float[frame_size * 2];
+float *BEZIER4::sample_curve(uint32_t frame_size, int precision) const {
+	float *samples = new float[frame_size];
 
 	size_t LUT_size = precision*frame_size;
 	vec2 *LUT = new vec2[LUT_size];
 
 	const float dt = 1.0 / (float)LUT_size;
-	
-	for (int i = 0; i < LUT_size; ++i) {
-		float t = dt * (float)i;
-		LUT[i] = evaluate(t);
-	}
+
+	forward_difference_cubic(matrix_repr, 0, dt, LUT_size, LUT, FORWARD_DIFFERENCE_REANCHOR);
 
 	const float dx = 1.0 / (float)frame_size;
 	int buff_offset = 0;
@@ -207,8 +213,7 @@ float *BEZIER4::sample_curve(UINT32 frame_size, int precision) const {
 
 		float y = LUT_find_y_for_x(target_x, LUT, LUT_size, &buff_offset);
 
-		samples[2 * i] = y;
-		samples[2 * i + 1] = y;
+		samples[i] = y;
 
 	}
 	
@@ -219,26 +224,37 @@ float *BEZIER4::sample_curve(UINT32 frame_size, int precision) const {
 	return samples;
 }
 
-float *BEZIER4::sample_curve_noLUT(UINT32 frame_size, int precision) const {
+float *BEZIER4::sample_curve_noLUT(uint32_t frame_size, int precision) const {
 
-	float *samples = new float[frame_size * 2];
+	float *samples = new float[frame_size];
 
 	const float dx = 1.0 / (float)frame_size;
 	const float dt = 1.0 / ((float)frame_size * precision);
 	float t = 0;
+	vec2 p = evaluate(t);
+
+	// the march evaluates the next EVALUATE_BATCH_SIZE steps at once and then consumes them one by one
+	float tb[EVALUATE_BATCH_SIZE];
+	vec2 pb[EVALUATE_BATCH_SIZE];
+	int k = EVALUATE_BATCH_SIZE;
 
-	int buff_offset = 0;
 	for (int i = 0; i < frame_size; ++i) {
 		float target_x = i * dx;
-		vec2 p = evaluate(t);
 
-		while (p.x < target_x) {
-			t += dt;
-			p = evaluate(t);
+		while (p.x < target_x && t <= 1) {
+			if (k == EVALUATE_BATCH_SIZE) {
+				for (int j = 0; j < EVALUATE_BATCH_SIZE; ++j) {
+					tb[j] = t + (j + 1)*dt;
+				}
+				evaluate_batch(tb, pb, EVALUATE_BATCH_SIZE);
+				k = 0;
+			}
+			t = tb[k];
+			p = pb[k];
+			++k;
 		}
 
-		samples[2 * i] = p.y;
-		samples[2 * i + 1] = p.y;
+		samples[i] = p.y;
 
 	}
 
@@ -331,6 +347,87 @@ void BEZIER4_fragment::update() {
 	matrix_repr = multiply44_24(BEZIER4::weights, points24);
 }
 
+void BEZIER4_fragment::evaluate_batch(const float *local_t, vec2 *out, size_t n) const {
+	bezier_evaluate_batch(matrix_repr, local_t, out, n);
+}
+
+static void forward_difference_cubic(const mat24 &M, float t0, float dt, size_t n, vec2 *out, size_t reanchor_interval) {
+
+	if (reanchor_interval == 0) reanchor_interval = n;
+
+	const float h = dt, h2 = dt*dt, h3 = h2*dt;
+
+	// one set of differences per coordinate: [0] = x, [1] = y
+	float f[2], d1[2], d2[2], d3[2];
+
+	for (size_t base = 0; base < n; base += reanchor_interval) {
+
+		// p(t) = a + bt + ct^2 + dt^3, the differences at t follow from expanding p(t + h) - p(t) etc.
+		const float t = t0 + (float)base * dt;
+		const float t2 = t*t;
+
+		for (int c = 0; c < 2; ++c) {
+			const vec4 &k = M.columns[c];
+			f[c] = ((k(3)*t + k(2))*t + k(1))*t + k(0);
+			d1[c] = k(1)*h + k(2)*(2 * t*h + h2) + k(3)*(3 * t2*h + 3 * t*h2 + h3);
+			d2[c] = 2 * k(2)*h2 + k(3)*(6 * t*h2 + 6 * h3);
+			d3[c] = 6 * k(3)*h3;
+		}
+
+		const size_t end = (std::min)(n, base + reanchor_interval);
+
+		for (size_t i = base; i < end; ++i) {
+			out[i] = vec2(f[0], f[1]);
+
+			f[0] += d1[0]; d1[0] += d2[0]; d2[0] += d3[0];
+			f[1] += d1[1]; d1[1] += d2[1]; d2[1] += d3[1];
+		}
+	}
+}
+
+void BEZIER4_fragment::forward_difference(float t0, float dt, size_t n, vec2 *out, size_t reanchor_interval) const {
+	forward_difference_cubic(matrix_repr, t0, dt, n, out, reanchor_interval);
+}
+
+// |x(t) - x| at which solve_t_for_x stops iterating. With 65536 frames one sample is ~1.5e-5 wide in x,
+// so this keeps the solution well inside a sample. The old t march (update_buffer_tmarch) overshoots x by
+// up to x'(t)/(frame_size*precision), so the two samplers agree to within |dy/dx| / (frame_size*precision).
+#define BEZIER4_X_TOLERANCE 1e-6f
+#define BEZIER4_SOLVE_MAX_ITER 16
+
+float BEZIER4_fragment::solve_t_for_x(float x, float t_guess) const {
+	// x(t) = c0 + c1*t + c2*t^2 + c3*t^3, the coefficients being the x column of matrix_repr
+	const float c0 = matrix_repr.columns[0](0) - x;
+	const float c1 = matrix_repr.columns[0](1);
+	const float c2 = matrix_repr.columns[0](2);
+	const float c3 = matrix_repr.columns[0](3);
+
+	if (c0 >= 0) return 0; // x(0) already past the target
+	if (c0 + c1 + c2 + c3 <= 0) return 1; // never reaches the target within this fragment
+
+	// Newton's method, safeguarded by bisection: [lo, hi] always brackets the root,
+	// so a bad step (x'(t) ~ 0 near a cusp) just falls back to halving the bracket.
+
+	float lo = 0, hi = 1;
+	float t = t_guess > lo && t_guess < hi ? t_guess : 0.5f;
+
+	for (int n = 0; n < BEZIER4_SOLVE_MAX_ITER; ++n) {
+		float fx = ((c3*t + c2)*t + c1)*t + c0;
+
+		if (fabs(fx) <= BEZIER4_X_TOLERANCE) break;
+
+		if (fx < 0) lo = t;
+		else hi = t;
+
+		float dfx = (3 * c3*t + 2 * c2)*t + c1;
+		float tn = t - fx / dfx;
+
+		t = (tn > lo && tn < hi) ? tn : 0.5f*(lo + hi); // this also catches dfx == 0 (inf/nan)
+	}
+
+	return t;
+}
+
 
 static int split_bezier(float t, const mat24 &points24, BEZIER4_fragment *out) {
 	if (t < 0.0 || t > 1.0) {
@@ -379,22 +476,27 @@ static int split_bezier(float t, const mat24 &points24, BEZIER4_fragment *out) {
 }
 
 
+int SEGMENTED_BEZIER4::find_segment(float t) const {
+	// the last tmin <= t
+	auto it = std::upper_bound(tmins.begin(), tmins.end(), t);
+	if (it == tmins.begin()) return -1;
+
+	int index = (int)(it - tmins.begin()) - 1;
+
+	return parts[index].tmax > t ? index : -1;
+}
+
 int SEGMENTED_BEZIER4::split(float at_t) {
 	// first we need to look up which one of the curves has this t.
-	BEZIER4_fragment *frag = NULL;
-
-	for (auto &c : parts) {
-		if (c.tmin <= at_t && c.tmax > at_t) {
-			frag = &c;
-			break;
-		}
-	}
+	int index = find_segment(at_t);
 
-	if (!frag) {
+	if (index < 0) {
 		printf("SEGMENTED_BEZIER4::split: error: didn't find valid segment for t = %f\n", at_t);
 		return 0;
 	}
 
+	BEZIER4_fragment *frag = &parts[index];
+
 	BEZIER4_fragment split[2];
 
 	// the t's will need to be scaled with tscale
@@ -417,6 +519,9 @@ int SEGMENTED_BEZIER4::split(float at_t) {
 
 	size_t offset = frag - &(*parts.begin());
 
+	// the halves trace the same curve, but they get rasterized with their own (slightly different) coefficients
+	mark_segment_dirty(offset);
+
 	// then insert into curve
 
 	// replace the previous fragment
@@ -425,6 +530,7 @@ int SEGMENTED_BEZIER4::split(float at_t) {
 	points_replace4(offset, split[0].points24);
 
 	parts.insert(parts.begin() + (offset + 1), split[1]);
+	tmins.insert(tmins.begin() + (offset + 1), split[1].tmin);
 	matrix_reprs.insert(matrix_reprs.begin() + (offset + 1), split[1].matrix_repr);
 	points_insert4(offset + 1, split[1].points24);
 
@@ -438,16 +544,83 @@ void SEGMENTED_BEZIER4::update_segment_index(int index) {
 	auto &s = parts[index];
 	matrix_reprs[index] = s.matrix_repr;
 	points_replace4(index, s.points24); // this has the disadvantage of copying the 3 unchanged vec2s, but it looks neat
+	mark_segment_dirty(index);
+}
+
+void SEGMENTED_BEZIER4::set_fragments(const BEZIER4_fragment *fragments, size_t num_fragments) {
+	parts.clear();
+	tmins.clear();
+	matrix_reprs.clear();
+	points.clear();
+
+	// the fragments are taken as-is, matrix_repr and tscale included
+	parts.assign(fragments, fragments + num_fragments);
+	tmins.reserve(num_fragments);
+	matrix_reprs.reserve(num_fragments);
+	points.reserve(4 * num_fragments);
+
+	for (size_t i = 0; i < num_fragments; ++i) {
+		const BEZIER4_fragment &f = parts[i];
+		tmins.push_back(f.tmin);
+		matrix_reprs.push_back(f.matrix_repr);
+		points_insert4((int)i, f.points24);
+	}
+
+	mark_all_dirty();
+}
+
+SEGMENTED_BEZIER4 make_default_curve() {
+	SEGMENTED_BEZIER4 c(BEZIER4(vec2(0.0, 0.0), vec2(0.33, -1.0), vec2(0.66, 1.0), vec2(1.0, 0.0)));
+
+	c.split(0.15);
+	//c.split(0.30);
+	c.split(0.45);
+	//c.split(0.60);
+	c.split(0.75);
+	//c.split(0.90);
+
+	return c;
+}
+
+void SEGMENTED_BEZIER4::mark_dirty(float xmin, float xmax) {
+	if (!is_dirty()) {
+		dirty_xmin = xmin;
+		dirty_xmax = xmax;
+	}
+	else {
+		dirty_xmin = (std::min)(dirty_xmin, xmin);
+		dirty_xmax = (std::max)(dirty_xmax, xmax);
+	}
+}
+
+void SEGMENTED_BEZIER4::mark_segment_dirty(size_t index) {
+	const vec4 &x = parts[index].points24.columns[0];
+	mark_dirty(
+		(std::min)((std::min)(x(0), x(1)), (std::min)(x(2), x(3))),
+		(std::max)((std::max)(x(0), x(1)), (std::max)(x(2), x(3))));
 }
 
-int SEGMENTED_BEZIER4::move_knot(int index, const vec2 &p) {
+int SEGMENTED_BEZIER4::move_knot(int index, const vec2 &new_position) {
 	if (index > parts.size()) {
 		printf("SEGMENTED_BEZIER4::move_knot: error: requested index > num knots (%d > %d).\n", index, parts.size());
 		return 0;
 	}
+
+	// rasterize needs the knots in order within x = [0, 1], so a knot can't be dragged past its neighbours
+	const float xmin = index > 0 ? parts[index - 1].points24.columns[0](0) : 0.0f;
+	const float xmax = (size_t)index < parts.size() ? parts[index].points24.columns[0](3) : 1.0f;
+	vec2 p = new_position;
+	p.x = (std::min)((std::max)(p.x, (std::max)(xmin, 0.0f)), (std::min)(xmax, 1.0f));
 	
 	auto &s = parts[index >= parts.size() ? parts.size()-1 : index];
 
+	// the span the segments covered before the move needs re-rendering too.
+	// update_segment_index takes care of the span they cover afterwards.
+	mark_segment_dirty(index >= parts.size() ? parts.size() - 1 : index);
+	if (index > 0 && index < parts.size()) {
+		mark_segment_dirty(index - 1);
+	}
+
 	if (index == parts.size()) {
 		// this means very last control point value :P
 		s.points24.assign_row(3, p);
@@ -511,6 +684,9 @@ int SEGMENTED_BEZIER4::move_cp(int index, const vec2 &newp) {
 	}
 
 	BEZIER4_fragment &p = parts[seg];
+
+	mark_segment_dirty(seg);
+
 	p.points24.columns[0].assign(mod, newp.x);
 	p.points24.columns[1].assign(mod, newp.y);
 
@@ -519,25 +695,22 @@ int SEGMENTED_BEZIER4::move_cp(int index, const vec2 &newp) {
 	matrix_reprs[seg] = p.matrix_repr;
 	points_replace4(seg, p.points24);
 
+	mark_segment_dirty(seg);
+
 	return 1;
 }
 
 vec2 SEGMENTED_BEZIER4::evaluate(float t) const {
 
-	const BEZIER4_fragment *frag = NULL;
+	int index = find_segment(t);
 
-	for (const auto &c : parts) {
-		if (c.tmin <= t && c.tmax > t) {
-			frag = &c;
-			break;
-		}
-	}
-
-	if (!frag) {
+	if (index < 0) {
 		printf("SEGMENTED_BEZIER4::evaluate: error: didn't find valid segment for t = %f\n", t);
 		return vec2(0, 0);
 	}
 
+	const BEZIER4_fragment *frag = &parts[index];
+
 	float lt = 1 - (frag->tmax - t)*frag->tscale;
 
 	float lt2 = lt*lt;
@@ -550,26 +723,90 @@ vec2 SEGMENTED_BEZIER4::evaluate(float t) const {
 
 
 
-int SEGMENTED_BEZIER4::allocate_buffer(int num_channels, size_t framesize) {
+int SEGMENTED_BEZIER4::allocate_buffer(size_t framesize) {
 	if (framesize != this->frame_size && this->samples == NULL) {
 		this->frame_size = framesize;
-		samples = new float[num_channels * framesize];
+		samples = new float[framesize];
+		mark_all_dirty();
 	}
 
 	return 1;
 }
 
 
-int SEGMENTED_BEZIER4::update_buffer(int precision) {
+void SEGMENTED_BEZIER4::rasterize(int i_begin, int i_end) {
+
+	const float dx = 1.0 / (float)frame_size;
+	const size_t last = parts.size() - 1;
+
+	size_t seg = 0;
+	float lt = 0; // local t of the previous sample, used as the initial guess for the next one
+
+	float tb[EVALUATE_BATCH_SIZE];
+	vec2 pb[EVALUATE_BATCH_SIZE];
+
+	int i = i_begin;
+	while (i < i_end) {
+
+		// the knots are ordered in x, so the fragment containing target_x is found by walking forward
+		while (seg < last && parts[seg].points24.columns[0](3) < i * dx) {
+			++seg;
+			lt = 0;
+		}
+
+		const BEZIER4_fragment &f = parts[seg];
+		const float end_x = f.points24.columns[0](3);
+
+		// solve t for the run of samples that fall within this fragment, then evaluate them all at once
+		int n = 0;
+		while (n < EVALUATE_BATCH_SIZE && i + n < i_end && (seg == last || (i + n) * dx <= end_x)) {
+			lt = f.solve_t_for_x((i + n) * dx, lt);
+			tb[n++] = lt;
+		}
+
+		f.evaluate_batch(tb, pb, n);
+
+		for (int j = 0; j < n; ++j) {
+			samples[i + j] = pb[j].y;
+		}
+
+		i += n;
+	}
+}
+
+int SEGMENTED_BEZIER4::update_buffer() {
+
+	samples_recomputed = 0;
+
+	if (is_dirty()) {
+		// the samples whose x falls in [dirty_xmin, dirty_xmax], with one sample of slack on both sides for rounding
+		const int i_begin = (std::max)(0, (int)ceilf(dirty_xmin * frame_size) - 1);
+		const int i_end = (int)(std::min)((float)frame_size, floorf(dirty_xmax * frame_size) + 2);
+
+		if (i_begin < i_end) {
+			rasterize(i_begin, i_end);
+			samples_recomputed = i_end - i_begin;
+		}
+
+		dirty_xmin = 1;
+		dirty_xmax = 0;
+	}
+
+	return 1;
+
+}
+
+int SEGMENTED_BEZIER4::update_buffer_tmarch(int precision) {
 
 	const float dx = 1.0 / (float)frame_size;
 	const float dt = 1.0 / ((float)frame_size * precision);
 	float t = 0;
 
-	int buff_offset = 0;
+	SEGMENTED_BEZIER4_cursor cursor(*this);
+
 	for (int i = 0; i < frame_size; ++i) {
 		float target_x = i * dx;
-		vec2 p = evaluate(t);
+		vec2 p = cursor.evaluate(t);
 
 		while (p.x < target_x) {
 			if (t > 1) { 
@@ -577,18 +814,27 @@ int SEGMENTED_BEZIER4::update_buffer(int precision) {
 				return 0; 
 			}
 			t += dt;
-			p = evaluate(t);
+			p = cursor.evaluate(t);
 		}
 
-		samples[2 * i] = p.y;
-		samples[2 * i + 1] = p.y;
-
-	}
+		samples[i] = p.y;
 
-	if (record.is_open()) {
-		record.write(reinterpret_cast<const char*>(samples), 2*frame_size*sizeof(float));
 	}
 
 	return 1;
 
-}
\ No newline at end of file
+}
+SEGMENTED_BEZIER4_cursor::SEGMENTED_BEZIER4_cursor(const SEGMENTED_BEZIER4 &c, float t0)
+	: curve(&c), frag(&c.parts[0]), index(0) {
+	seek(t0);
+}
+
+void SEGMENTED_BEZIER4_cursor::seek(float t) {
+	const size_t last = curve->parts.size() - 1;
+
+	while (index < last && t >= curve->parts[index].tmax) {
+		++index;
+	}
+
+	frag = &curve->parts[index];
+}
@@ -1,11 +1,10 @@
 #pragma once
 
-#include <Windows.h>
 #include <cmath>
+#include <cstdio>
+#include <cstdint>
 #include <vector>
 
-#include "glwindow.h"
-
 #include "lin_alg.h"
 #include "alignment_allocator.h"
 
@@ -73,6 +72,8 @@ struct BEZIER4 {
 
 	vec2 evaluate_derivative(float t) const;
 
+	void evaluate_batch(const float *t, vec2 *out, size_t n) const; // see curve_simd.h
+
 	BEZIER4(const vec2 &aP0, const vec2 &aP1, const vec2 &aP2, const vec2 &aP3);
 	BEZIER4(const mat24 &PV);
 
@@ -80,8 +81,9 @@ struct BEZIER4 {
 
 	BEZIER4() {}
 	
-	float *sample_curve(UINT32 frame_size, int precision = 8) const;
-	float *sample_curve_noLUT(UINT32 frame_size, int precision = 32) const;
+	// both return frame_size mono samples, new[]'d
+	float *sample_curve(uint32_t frame_size, int precision = 8) const;
+	float *sample_curve_noLUT(uint32_t frame_size, int precision = 32) const;
 
 	CATMULLROM4 convert_to_CATMULLROM4() const;
 
@@ -106,6 +108,8 @@ struct CATMULLROM4 {
 
 };
 
+#define FORWARD_DIFFERENCE_REANCHOR 256
+
 struct BEZIER4_fragment {
 	mat24 points24;
 	mat24 matrix_repr;
@@ -115,6 +119,14 @@ struct BEZIER4_fragment {
 
 	void update(); // update matrix_repr based on points24
 
+	float solve_t_for_x(float x, float t_guess) const; // local t (in [0, 1]) for which the fragment's x(t) == x
+
+	void evaluate_batch(const float *local_t, vec2 *out, size_t n) const; // t local to the fragment, i.e. in [0, 1]
+
+	// out[i] = p(t0 + i*dt) for i < n, in local t, stepped with forward differences (three adds per coordinate).
+	// The differences are recomputed from scratch every reanchor_interval samples to keep the float drift bounded.
+	void forward_difference(float t0, float dt, size_t n, vec2 *out, size_t reanchor_interval = FORWARD_DIFFERENCE_REANCHOR) const;
+
 	BEZIER4_fragment() {}
 
 };
@@ -123,15 +135,29 @@ struct SEGMENTED_BEZIER4 {
 	std::vector < BEZIER4_fragment, AlignmentAllocator<BEZIER4_fragment, 16>> parts;
 	std::vector < mat24, AlignmentAllocator<mat24, 16>> matrix_reprs; // this is needed for shaders/bezier
 	std::vector<vec2> points; // this is needed for shaders/pointplot
+	std::vector<float> tmins; // parts[i].tmin, kept sorted so segment lookups can binary search
 
+	// one cycle, frame_size mono samples. Channels are never written here: the output stage expands the cycle
+	// to however many the device has (oscillator_bank_t::render, expand_channels).
 	float *samples;
 	size_t frame_size;
 
+	// The x span edited since the last update_buffer call; update_buffer only re-renders the samples
+	// falling inside it. Empty (clean) when dirty_xmin > dirty_xmax.
+	float dirty_xmin, dirty_xmax;
+	size_t samples_recomputed; // by the last update_buffer call
+
+	void mark_dirty(float xmin, float xmax);
+	void mark_segment_dirty(size_t index); // the x extent of the segment's control polygon, which contains the segment
+	void mark_all_dirty() { mark_dirty(-1, 2); }
+	bool is_dirty() const { return dirty_xmin <= dirty_xmax; }
+
 	int split(float at_t); // this is the primary method for using this thing
 
 	int move_knot(int index, const vec2 &new_position); 
 	// knot = the first and last CP of every segment. Whether they need to be congruent will depend on how this is implemented.
 	// "knot at index n" will refer to the first CP of the n-th segment, and 4th CP of the n-1:th segment (if it exists).
+	// The knot's x is clamped between its neighbouring knots' and to [0, 1].
 
 	int move_cp(int index, const vec2 &new_position);
 
@@ -160,6 +186,8 @@ struct SEGMENTED_BEZIER4 {
 	
 	}
 
+	int find_segment(float t) const; // index of the fragment whose [tmin, tmax[ contains t, -1 if none. O(log n)
+
 	vec2 evaluate(float t) const; // evaluate the segmented curve at t = t (will need to look up which curve has that t value within its range)
 
 	vec2 get_knot(int index) const; 
@@ -173,17 +201,52 @@ struct SEGMENTED_BEZIER4 {
 		f.tmax = 1;
 		f.tscale = 1;
 		parts.push_back(f);
+		tmins.push_back(f.tmin);
 		matrix_reprs.push_back(f.matrix_repr);
 		points_push4(f.points24);
 		samples = NULL;
 		frame_size = 0;
+		samples_recomputed = 0;
+		mark_all_dirty();
 	}
 
-	SEGMENTED_BEZIER4() {}
+	SEGMENTED_BEZIER4() : samples(NULL), frame_size(0), dirty_xmin(1), dirty_xmax(0), samples_recomputed(0) {}
+
+	// replaces the whole curve. the fragments must be sorted by t and cover [0, 1].
+	void set_fragments(const BEZIER4_fragment *fragments, size_t num_fragments);
 
 	void update_segment_index(int index);
 
-	int allocate_buffer(int num_channels, size_t framesize);
-	int update_buffer(int precision = 32);
+	int allocate_buffer(size_t framesize);
+	int update_buffer(); // O(1) per sample, solves x(t) = target_x for each output sample. Only touches the dirty span.
+	int update_buffer_tmarch(int precision = 32); // the old fixed-step t march, kept around as a reference for bench.cpp
 
+	void rasterize(int i_begin, int i_end); // the sample range [i_begin, i_end[ of update_buffer
+
+};
+
+SEGMENTED_BEZIER4 make_default_curve(); // the curve the editor starts out with
+
+// Forward-only evaluation over a SEGMENTED_BEZIER4, for sweeps where t never decreases.
+// Remembers the current fragment and only moves on to the next one once t crosses its tmax,
+// so a sweep costs O(samples + segments) instead of a segment lookup per sample.
+// The curve must not be split while a cursor is pointing at it.
+
+struct SEGMENTED_BEZIER4_cursor {
+	const SEGMENTED_BEZIER4 *curve;
+	const BEZIER4_fragment *frag;
+	size_t index;
+
+	SEGMENTED_BEZIER4_cursor(const SEGMENTED_BEZIER4 &c, float t0 = 0);
+
+	void seek(float t); // advance to the fragment containing t (or the last one, if t >= 1)
+
+	vec2 evaluate(float t) {
+		if (t >= frag->tmax) seek(t);
+		float lt = 1 - (frag->tmax - t)*frag->tscale;
+
+		const vec4 &cx = frag->matrix_repr.columns[0];
+		const vec4 &cy = frag->matrix_repr.columns[1];
+		return vec2(((cx(3)*lt + cx(2))*lt + cx(1))*lt + cx(0), ((cy(3)*lt + cy(2))*lt + cy(1))*lt + cy(0));
+	}
 };
@@ -0,0 +1,399 @@
+#define _CRT_SECURE_NO_WARNINGS // fopen, fscanf
+
+#include "curve_io.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define CURVE_TEXT_MAGIC "wfcurve"
+#define CURVE_TEXT_VERSION 1
+
+// how far apart the end of a fragment and the start of the next may be in t. SEGMENTED_BEZIER4::split leaves
+// one float's worth of gap, a few more are allowed for files written by hand or by other tools
+#define CURVE_T_TOLERANCE 1e-6f
+
+// how far from 0 a control point's y may be. The editor's view spans y = [-1, 1] and samples are full scale
+// there; this leaves room for control points dragged well past it while refusing garbage
+#define CURVE_Y_LIMIT 16.0f
+
+// What SEGMENTED_BEZIER4::rasterize assumes of a curve: the fragments cover t = [0, 1] back to back, and their
+// knots stay within x = [0, 1] without going backwards. Every coordinate has to be finite and every y within
+// CURVE_Y_LIMIT, or NaNs and infinities end up in the wavetables and the rendered audio. Returns NULL if that
+// holds, otherwise why not, with the offending fragment in *bad_index.
+static const char *check_fragments(const BEZIER4_fragment *f, size_t n, size_t *bad_index) {
+	for (size_t i = 0; i < n; ++i) {
+		*bad_index = i;
+
+		for (int r = 0; r < 4; ++r) {
+			const float x = f[i].points24.columns[0](r), y = f[i].points24.columns[1](r);
+			if (!std::isfinite(x) || !std::isfinite(y)) return "non-finite control point";
+			if (!(fabsf(y) <= CURVE_Y_LIMIT)) return "control point y out of range";
+		}
+
+		const float x0 = f[i].points24.columns[0](0), x3 = f[i].points24.columns[0](3);
+
+		if (!(f[i].tmax > f[i].tmin)) return "empty or reversed t range";
+		if (i == 0 && f[i].tmin != 0) return "the first fragment doesn't start at t = 0";
+		if (i > 0 && !(fabsf(f[i].tmin - f[i - 1].tmax) <= CURVE_T_TOLERANCE)) return "gap or overlap in t with the previous fragment";
+		if (i == n - 1 && !(fabsf(f[i].tmax - 1.0f) <= CURVE_T_TOLERANCE)) return "the last fragment doesn't end at t = 1";
+
+		if (!(x0 >= 0 && x3 <= 1)) return "knot x outside [0, 1]";
+		if (!(x3 >= x0)) return "knot x goes backwards within the fragment";
+		if (i > 0 && !(x0 >= f[i - 1].points24.columns[0](3))) return "knot x goes backwards from the previous fragment";
+	}
+
+	return NULL;
+}
+
+// skips whitespace and '#' comment lines
+static void skip_comments(FILE *fp) {
+	int c;
+	while ((c = fgetc(fp)) != EOF) {
+		if (c == '#') {
+			while ((c = fgetc(fp)) != EOF && c != '\n');
+		}
+		else if (c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+			ungetc(c, fp);
+			return;
+		}
+	}
+}
+
+int curve_load_text(const char *path, SEGMENTED_BEZIER4 *out) {
+	FILE *fp = fopen(path, "r");
+	if (!fp) {
+		printf("curve_load_text: couldn't open %s.\n", path);
+		return 0;
+	}
+
+	char magic[16] = "";
+	int version = 0, num_segments = 0;
+	std::vector<BEZIER4_fragment> fragments;
+	const char *bad_reason;
+	size_t bad_index;
+
+	skip_comments(fp);
+	if (fscanf(fp, "%15s %d", magic, &version) != 2 || strcmp(magic, CURVE_TEXT_MAGIC) != 0) {
+		printf("curve_load_text: %s: not a curve file.\n", path);
+		goto exit_err;
+	}
+
+	if (version != CURVE_TEXT_VERSION) {
+		printf("curve_load_text: %s: unsupported version %d.\n", path, version);
+		goto exit_err;
+	}
+
+	skip_comments(fp);
+	if (fscanf(fp, " segments %d", &num_segments) != 1 || num_segments <= 0) {
+		printf("curve_load_text: %s: bad segment count.\n", path);
+		goto exit_err;
+	}
+
+	for (int i = 0; i < num_segments; ++i) {
+		float tmin, tmax;
+		vec2 p[4];
+
+		skip_comments(fp);
+		int n = fscanf(fp, "%f %f %f %f %f %f %f %f %f %f", &tmin, &tmax,
+			&p[0].x, &p[0].y, &p[1].x, &p[1].y, &p[2].x, &p[2].y, &p[3].x, &p[3].y);
+
+		if (n != 10) {
+			printf("curve_load_text: %s: segment %d: expected 10 numbers, got %d.\n", path, i, n);
+			goto exit_err;
+		}
+
+		fragments.push_back(BEZIER4_fragment(mat24(p[0], p[1], p[2], p[3]), tmin, tmax));
+	}
+
+	fclose(fp);
+
+	if ((bad_reason = check_fragments(&fragments[0], fragments.size(), &bad_index))) {
+		const BEZIER4_fragment &f = fragments[bad_index];
+		printf("curve_load_text: %s: segment %zu (t [%g, %g], x [%g, %g]): %s.\n", path, bad_index,
+			f.tmin, f.tmax, f.points24.columns[0](0), f.points24.columns[0](3), bad_reason);
+		return 0;
+	}
+
+	out->set_fragments(&fragments[0], fragments.size());
+
+	return 1;
+
+exit_err:
+	fclose(fp);
+	return 0;
+}
+
+int curve_save_text(const char *path, const SEGMENTED_BEZIER4 &curve) {
+	FILE *fp = fopen(path, "w");
+	if (!fp) {
+		printf("curve_save_text: couldn't open %s for writing.\n", path);
+		return 0;
+	}
+
+	fprintf(fp, "%s %d\n", CURVE_TEXT_MAGIC, CURVE_TEXT_VERSION);
+	fprintf(fp, "segments %d\n", (int)curve.parts.size());
+	fprintf(fp, "# tmin tmax x0 y0 x1 y1 x2 y2 x3 y3\n");
+
+	for (const auto &f : curve.parts) {
+		fprintf(fp, "%.9g %.9g", f.tmin, f.tmax);
+		for (int r = 0; r < 4; ++r) {
+			vec2 p = f.points24.row(r);
+			fprintf(fp, " %.9g %.9g", p.x, p.y);
+		}
+		fprintf(fp, "\n");
+	}
+
+	int ok = !ferror(fp);
+	fclose(fp);
+
+	return ok;
+}
+
+static_assert(sizeof(curve_bank_header_t) == 48, "curve_bank_header_t layout");
+static_assert(sizeof(curve_bank_fragment_t) == 80, "curve_bank_fragment_t layout");
+
+#define CURVE_BANK_ALIGN 16
+
+static size_t align_up(size_t v, size_t a) { return (v + a - 1) & ~(a - 1); }
+
+static void fragment_to_record(const BEZIER4_fragment &f, curve_bank_fragment_t *r) {
+	for (int c = 0; c < 2; ++c) {
+		for (int i = 0; i < 4; ++i) {
+			r->points[c][i] = f.points24.columns[c](i);
+			r->coeffs[c][i] = f.matrix_repr.columns[c](i);
+		}
+	}
+	r->tmin = f.tmin;
+	r->tmax = f.tmax;
+	r->tscale = f.tscale;
+	r->padding0 = 0;
+}
+
+// only the points and the t range are taken from the record: matrix_repr and tscale are recomputed from them,
+// so a curve plays exactly what the editor draws of it whatever the file's coeffs and tscale say
+static void record_to_fragment(const curve_bank_fragment_t &r, BEZIER4_fragment *f) {
+	mat24 points;
+	for (int c = 0; c < 2; ++c) {
+		points.columns[c] = vec4(r.points[c][0], r.points[c][1], r.points[c][2], r.points[c][3]);
+	}
+	*f = BEZIER4_fragment(points, r.tmin, r.tmax);
+	f->padding0 = 0;
+}
+
+int curve_bank_save(const char *path, const SEGMENTED_BEZIER4 *curves, size_t num_curves) {
+	std::vector<curve_bank_entry_t> entries(num_curves);
+	std::vector<curve_bank_fragment_t> records;
+
+	for (size_t i = 0; i < num_curves; ++i) {
+		entries[i].first_fragment = (uint32_t)records.size();
+		entries[i].num_fragments = (uint32_t)curves[i].parts.size();
+		for (const auto &f : curves[i].parts) {
+			curve_bank_fragment_t r;
+			fragment_to_record(f, &r);
+			records.push_back(r);
+		}
+	}
+
+	curve_bank_header_t h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, CURVE_BANK_MAGIC, 4);
+	h.version = CURVE_BANK_VERSION;
+	h.endian_tag = CURVE_BANK_ENDIAN_TAG;
+	h.num_curves = (uint32_t)num_curves;
+	h.num_fragments = (uint32_t)records.size();
+	h.fragment_size = sizeof(curve_bank_fragment_t);
+	h.entries_offset = sizeof(h);
+	h.fragments_offset = align_up(h.entries_offset + num_curves * sizeof(curve_bank_entry_t), CURVE_BANK_ALIGN);
+
+	FILE *fp = fopen(path, "wb");
+	if (!fp) {
+		printf("curve_bank_save: couldn't open %s for writing.\n", path);
+		return 0;
+	}
+
+	static const uint8_t zeros[CURVE_BANK_ALIGN] = { 0 };
+	const size_t pad = h.fragments_offset - (h.entries_offset + num_curves * sizeof(curve_bank_entry_t));
+
+	fwrite(&h, sizeof(h), 1, fp);
+	if (num_curves) { fwrite(&entries[0], sizeof(curve_bank_entry_t), num_curves, fp); }
+	fwrite(zeros, 1, pad, fp);
+	if (!records.empty()) { fwrite(&records[0], sizeof(curve_bank_fragment_t), records.size(), fp); }
+
+	int ok = !ferror(fp);
+	fclose(fp);
+
+	return ok;
+}
+
+curve_bank_t::curve_bank_t()
+	: base(NULL), length(0), header(NULL), entries(NULL), fragments(NULL)
+#ifdef _WIN32
+	, file_handle(INVALID_HANDLE_VALUE), mapping_handle(NULL)
+#endif
+{}
+
+int curve_bank_t::open(const char *path) {
+	close();
+
+#ifdef _WIN32
+	file_handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file_handle == INVALID_HANDLE_VALUE) {
+		printf("curve_bank_t::open: couldn't open %s.\n", path);
+		return 0;
+	}
+
+	LARGE_INTEGER size;
+	GetFileSizeEx(file_handle, &size);
+	length = (size_t)size.QuadPart;
+
+	if (length >= sizeof(curve_bank_header_t)) {
+		mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping_handle) {
+			base = static_cast<const uint8_t*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+		}
+	}
+#else
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0) {
+		printf("curve_bank_t::open: couldn't open %s.\n", path);
+		return 0;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == 0) {
+		length = (size_t)st.st_size;
+		if (length >= sizeof(curve_bank_header_t)) {
+			void *p = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+			base = (p == MAP_FAILED) ? NULL : static_cast<const uint8_t*>(p);
+		}
+	}
+	::close(fd); // the mapping keeps its own reference
+#endif
+
+	if (!base) {
+		printf("curve_bank_t::open: couldn't map %s (%zu bytes).\n", path, length);
+		close();
+		return 0;
+	}
+
+	const curve_bank_header_t *h = reinterpret_cast<const curve_bank_header_t*>(base);
+
+	if (memcmp(h->magic, CURVE_BANK_MAGIC, 4) != 0 || h->version != CURVE_BANK_VERSION
+		|| h->endian_tag != CURVE_BANK_ENDIAN_TAG || h->fragment_size != sizeof(curve_bank_fragment_t)) {
+		printf("curve_bank_t::open: %s: not a version %d curve bank.\n", path, CURVE_BANK_VERSION);
+		close();
+		return 0;
+	}
+
+	const uint64_t entries_end = h->entries_offset + (uint64_t)h->num_curves * sizeof(curve_bank_entry_t);
+	const uint64_t fragments_end = h->fragments_offset + (uint64_t)h->num_fragments * sizeof(curve_bank_fragment_t);
+
+	if (h->entries_offset < sizeof(*h) || entries_end > length || fragments_end > length
+		|| h->fragments_offset % CURVE_BANK_ALIGN != 0 || h->fragments_offset < entries_end) {
+		printf("curve_bank_t::open: %s: truncated or corrupt.\n", path);
+		close();
+		return 0;
+	}
+
+	header = h;
+	entries = reinterpret_cast<const curve_bank_entry_t*>(base + h->entries_offset);
+	fragments = reinterpret_cast<const curve_bank_fragment_t*>(base + h->fragments_offset);
+
+	for (uint32_t i = 0; i < h->num_curves; ++i) {
+		const curve_bank_entry_t &e = entries[i];
+		if (e.num_fragments == 0 || (uint64_t)e.first_fragment + e.num_fragments > h->num_fragments) {
+			printf("curve_bank_t::open: %s: curve %u has a bad fragment range.\n", path, i);
+			close();
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+void curve_bank_t::close() {
+#ifdef _WIN32
+	if (base) { UnmapViewOfFile(base); }
+	if (mapping_handle) { CloseHandle(mapping_handle); }
+	if (file_handle != INVALID_HANDLE_VALUE) { CloseHandle(file_handle); }
+	mapping_handle = NULL;
+	file_handle = INVALID_HANDLE_VALUE;
+#else
+	if (base) { munmap(const_cast<uint8_t*>(base), length); }
+#endif
+	base = NULL;
+	length = 0;
+	header = NULL;
+	entries = NULL;
+	fragments = NULL;
+}
+
+const curve_bank_fragment_t *curve_bank_t::get_fragments(uint32_t index, uint32_t *num_fragments) const {
+	if (index >= size()) {
+		*num_fragments = 0;
+		return NULL;
+	}
+	*num_fragments = entries[index].num_fragments;
+	return fragments + entries[index].first_fragment;
+}
+
+int curve_bank_t::load(uint32_t index, SEGMENTED_BEZIER4 *out) const {
+	uint32_t n;
+	const curve_bank_fragment_t *r = get_fragments(index, &n);
+	if (!r) {
+		printf("curve_bank_t::load: index %u out of range (%u curves).\n", index, size());
+		return 0;
+	}
+
+	std::vector<BEZIER4_fragment> f(n);
+	for (uint32_t i = 0; i < n; ++i) {
+		record_to_fragment(r[i], &f[i]);
+	}
+
+	// the same checks as for a text curve: a bank can come from anywhere too
+	size_t bad_index;
+	if (const char *bad_reason = check_fragments(&f[0], n, &bad_index)) {
+		printf("curve_bank_t::load: curve %u, fragment %zu (t [%g, %g], x [%g, %g]): %s.\n", index, bad_index,
+			f[bad_index].tmin, f[bad_index].tmax, f[bad_index].points24.columns[0](0), f[bad_index].points24.columns[0](3), bad_reason);
+		return 0;
+	}
+
+	out->set_fragments(&f[0], n);
+
+	return 1;
+}
+
+int curve_load(const char *path, SEGMENTED_BEZIER4 *out, uint32_t bank_index) {
+	char magic[4] = { 0 };
+
+	FILE *fp = fopen(path, "rb");
+	if (!fp) {
+		printf("curve_load: couldn't open %s.\n", path);
+		return 0;
+	}
+	size_t n = fread(magic, 1, 4, fp);
+	fclose(fp);
+
+	if (n == 4 && memcmp(magic, CURVE_BANK_MAGIC, 4) == 0) {
+		curve_bank_t bank;
+		return bank.open(path) && bank.load(bank_index, out);
+	}
+
+	if (bank_index != 0) {
+		printf("curve_load: %s is a single text curve, there's no curve %u.\n", path, bank_index);
+		return 0;
+	}
+
+	return curve_load_text(path, out);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "curve.h"
+
+// Text curve description:
+//
+//   wfcurve 1
+//   segments <N>
+//   <tmin> <tmax> <x0> <y0> <x1> <y1> <x2> <y2> <x3> <y3>    (N lines, one per fragment, sorted by t)
+//
+// '#' starts a comment line. Floats are written with 9 significant digits, so save/load round-trips exactly.
+// The fragments must cover t = [0, 1] back to back, with knots (x0 and x3) non-decreasing in x within [0, 1],
+// and every coordinate finite with |y| <= 16; curves that don't are rejected with a message. The same goes for the curves of a bank, on load().
+
+int curve_load_text(const char *path, SEGMENTED_BEZIER4 *out);
+int curve_save_text(const char *path, const SEGMENTED_BEZIER4 &curve);
+
+// Binary curve bank: any number of curves in one file, laid out so the file can be mapped and used in place.
+//
+//   curve_bank_header_t
+//   curve_bank_entry_t[num_curves]          (at entries_offset)
+//   curve_bank_fragment_t[num_fragments]    (at fragments_offset, 16-byte aligned, curves stored back to back)
+//
+// All fields are little-endian. The fragment records carry the precomputed coefficient matrix for readers of
+// the mapped records (get_fragments). load() doesn't trust it: it recomputes the coefficients and tscale from
+// the points, so a curve loaded from a bank is the one its points describe, like a text curve.
+
+#define CURVE_BANK_MAGIC "WFCB"
+#define CURVE_BANK_VERSION 1
+#define CURVE_BANK_ENDIAN_TAG 0x01020304u
+
+struct curve_bank_header_t {
+	char magic[4];
+	uint32_t version;
+	uint32_t endian_tag;
+	uint32_t num_curves;
+	uint32_t num_fragments;
+	uint32_t fragment_size; // sizeof(curve_bank_fragment_t), checked on open
+	uint64_t entries_offset;
+	uint64_t fragments_offset;
+	uint32_t reserved[2];
+};
+
+struct curve_bank_entry_t {
+	uint32_t first_fragment;
+	uint32_t num_fragments;
+};
+
+struct curve_bank_fragment_t {
+	float points[2][4]; // x0..x3, y0..y3, i.e. the columns of BEZIER4_fragment::points24
+	float coeffs[2][4]; // BEZIER4_fragment::matrix_repr, ignored by load()
+	float tmin, tmax, tscale, padding0;
+};
+
+int curve_bank_save(const char *path, const SEGMENTED_BEZIER4 *curves, size_t num_curves);
+
+// Read-only view of a mapped bank file. open() validates the header and the entry table once;
+// after that load() is bounds-checked, builds the curve from its fragment records' points and checks it as above.
+struct curve_bank_t {
+	const uint8_t *base;
+	size_t length;
+	const curve_bank_header_t *header;
+	const curve_bank_entry_t *entries;
+	const curve_bank_fragment_t *fragments;
+
+#ifdef _WIN32
+	void *file_handle, *mapping_handle;
+#endif
+
+	curve_bank_t();
+	~curve_bank_t() { close(); }
+
+	int open(const char *path);
+	void close();
+
+	bool is_open() const { return base != NULL; }
+	uint32_t size() const { return header ? header->num_curves : 0; }
+
+	const curve_bank_fragment_t *get_fragments(uint32_t index, uint32_t *num_fragments) const;
+	int load(uint32_t index, SEGMENTED_BEZIER4 *out) const;
+
+private:
+	curve_bank_t(const curve_bank_t&);
+	curve_bank_t &operator=(const curve_bank_t&);
+};
+
+// Loads a text curve or curve bank_index of a binary bank, whichever the file turns out to be.
+int curve_load(const char *path, SEGMENTED_BEZIER4 *out, uint32_t bank_index = 0);
@@ -0,0 +1,150 @@
+#include "curve_simd.h"
+#include "curve.h"
+
+#include <xmmintrin.h>
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+int cpu_has_avx2() {
+#ifdef _MSC_VER
+	int r[4];
+
+	__cpuid(r, 0);
+	if (r[0] < 7) return 0;
+
+	__cpuid(r, 1);
+	const int osxsave = r[2] & (1 << 27);
+	const int avx = r[2] & (1 << 28);
+	const int fma = r[2] & (1 << 12);
+	if (!osxsave || !avx || !fma) return 0;
+
+	// the OS has to save the ymm registers on context switches, too
+	if ((_xgetbv(0) & 6) != 6) return 0;
+
+	__cpuidex(r, 7, 0);
+	return (r[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+static inline vec2 evaluate_scalar(const mat24 &M, float t) {
+	const vec4 &cx = M.columns[0];
+	const vec4 &cy = M.columns[1];
+	return vec2(((cx(3)*t + cx(2))*t + cx(1))*t + cx(0), ((cy(3)*t + cy(2))*t + cy(1))*t + cy(0));
+}
+
+void bezier_evaluate_batch_sse(const mat24 &M, const float *t, vec2 *out, size_t n) {
+
+	const __m128 cx = M.columns[0].getData();
+	const __m128 cy = M.columns[1].getData();
+
+	const __m128 x0 = _mm_shuffle_ps(cx, cx, _MM_SHUFFLE(0, 0, 0, 0));
+	const __m128 x1 = _mm_shuffle_ps(cx, cx, _MM_SHUFFLE(1, 1, 1, 1));
+	const __m128 x2 = _mm_shuffle_ps(cx, cx, _MM_SHUFFLE(2, 2, 2, 2));
+	const __m128 x3 = _mm_shuffle_ps(cx, cx, _MM_SHUFFLE(3, 3, 3, 3));
+
+	const __m128 y0 = _mm_shuffle_ps(cy, cy, _MM_SHUFFLE(0, 0, 0, 0));
+	const __m128 y1 = _mm_shuffle_ps(cy, cy, _MM_SHUFFLE(1, 1, 1, 1));
+	const __m128 y2 = _mm_shuffle_ps(cy, cy, _MM_SHUFFLE(2, 2, 2, 2));
+	const __m128 y3 = _mm_shuffle_ps(cy, cy, _MM_SHUFFLE(3, 3, 3, 3));
+
+	float *o = reinterpret_cast<float*>(out);
+	size_t i = 0;
+
+	for (; i + 4 <= n; i += 4) {
+		__m128 T = _mm_loadu_ps(t + i);
+
+		__m128 X = _mm_add_ps(_mm_mul_ps(x3, T), x2);
+		X = _mm_add_ps(_mm_mul_ps(X, T), x1);
+		X = _mm_add_ps(_mm_mul_ps(X, T), x0);
+
+		__m128 Y = _mm_add_ps(_mm_mul_ps(y3, T), y2);
+		Y = _mm_add_ps(_mm_mul_ps(Y, T), y1);
+		Y = _mm_add_ps(_mm_mul_ps(Y, T), y0);
+
+		// back to (x, y) pairs
+		_mm_storeu_ps(o + 2 * i, _mm_unpacklo_ps(X, Y));
+		_mm_storeu_ps(o + 2 * i + 4, _mm_unpackhi_ps(X, Y));
+	}
+
+	for (; i < n; ++i) {
+		out[i] = evaluate_scalar(M, t[i]);
+	}
+}
+
+TARGET_AVX2
+void bezier_evaluate_batch_avx2(const mat24 &M, const float *t, vec2 *out, size_t n) {
+
+	const __m256 x0 = _mm256_set1_ps(M.columns[0](0));
+	const __m256 x1 = _mm256_set1_ps(M.columns[0](1));
+	const __m256 x2 = _mm256_set1_ps(M.columns[0](2));
+	const __m256 x3 = _mm256_set1_ps(M.columns[0](3));
+
+	const __m256 y0 = _mm256_set1_ps(M.columns[1](0));
+	const __m256 y1 = _mm256_set1_ps(M.columns[1](1));
+	const __m256 y2 = _mm256_set1_ps(M.columns[1](2));
+	const __m256 y3 = _mm256_set1_ps(M.columns[1](3));
+
+	float *o = reinterpret_cast<float*>(out);
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8) {
+		__m256 T = _mm256_loadu_ps(t + i);
+
+		__m256 X = _mm256_fmadd_ps(x3, T, x2);
+		X = _mm256_fmadd_ps(X, T, x1);
+		X = _mm256_fmadd_ps(X, T, x0);
+
+		__m256 Y = _mm256_fmadd_ps(y3, T, y2);
+		Y = _mm256_fmadd_ps(Y, T, y1);
+		Y = _mm256_fmadd_ps(Y, T, y0);
+
+		// the unpacks work within 128-bit lanes: lo = (p0 p1 | p4 p5), hi = (p2 p3 | p6 p7)
+		__m256 lo = _mm256_unpacklo_ps(X, Y);
+		__m256 hi = _mm256_unpackhi_ps(X, Y);
+
+		_mm256_storeu_ps(o + 2 * i, _mm256_permute2f128_ps(lo, hi, 0x20));
+		_mm256_storeu_ps(o + 2 * i + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+	}
+
+	if (i < n) {
+		bezier_evaluate_batch_sse(M, t + i, out + i, n - i);
+	}
+}
+
+void bezier_evaluate_batch_scalar(const mat24 &M, const float *t, vec2 *out, size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		out[i] = evaluate_scalar(M, t[i]);
+	}
+}
+
+typedef void(*bezier_batch_kernel_t)(const mat24 &, const float *, vec2 *, size_t);
+
+struct bezier_batch_kernel_entry_t {
+	const char *name;
+	bezier_batch_kernel_t kernel;
+};
+
+static const bezier_batch_kernel_entry_t bezier_batch_kernels[] = {
+	{ "scalar", bezier_evaluate_batch_scalar },
+	{ "sse", bezier_evaluate_batch_sse },
+	{ "avx2", bezier_evaluate_batch_avx2 },
+};
+
+static simd_kernel_dispatch<bezier_batch_kernel_entry_t> bezier_batch_dispatch(bezier_batch_kernels, "bezier_evaluate_batch_set_kernel");
+
+void bezier_evaluate_batch(const mat24 &M, const float *t, vec2 *out, size_t n) {
+	bezier_batch_dispatch.get().kernel(M, t, out, n);
+}
+
+int bezier_evaluate_batch_set_kernel(const char *name) {
+	return bezier_batch_dispatch.set(name);
+}
+
+const char *bezier_evaluate_batch_kernel_name() {
+	return bezier_batch_dispatch.get().name;
+}
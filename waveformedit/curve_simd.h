@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <atomic>
+
+// Marks a kernel compiled for AVX2 (and FMA) in a translation unit built for the SSE2 baseline, so it can be
+// picked at runtime. MSVC emits any intrinsic without being asked.
+#ifdef _MSC_VER
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+
+struct vec2;
+struct mat24;
+
+// Evaluates the cubic described by matrix_repr (x and y polynomial coefficients, as in BEZIER4::matrix_repr)
+// at t[0..n-1]. The coefficients are broadcast and 4 (SSE) or 8 (AVX2) t values are evaluated at once
+// with Horner's rule. bezier_evaluate_batch goes through a simd_kernel_dispatch (below), i.e. the widest
+// kernel the CPU supports unless bezier_evaluate_batch_set_kernel forced one.
+
+void bezier_evaluate_batch(const mat24 &matrix_repr, const float *t, vec2 *out, size_t n);
+
+void bezier_evaluate_batch_scalar(const mat24 &matrix_repr, const float *t, vec2 *out, size_t n);
+void bezier_evaluate_batch_sse(const mat24 &matrix_repr, const float *t, vec2 *out, size_t n);
+void bezier_evaluate_batch_avx2(const mat24 &matrix_repr, const float *t, vec2 *out, size_t n);
+
+int cpu_has_avx2();
+
+// forces a kernel ("scalar", "sse" or "avx2"), NULL or "" goes back to the widest one the CPU supports
+int bezier_evaluate_batch_set_kernel(const char *name);
+const char *bezier_evaluate_batch_kernel_name();
+
+// Runtime choice between the scalar, SSE and AVX2 versions of a set of kernels. entry_t is a struct of a
+// const char *name followed by the kernel function pointer(s); the table lists the three in that order.
+// get() is the AVX2 entry where the CPU has it and SSE otherwise, unless set() forced one by name (for the
+// benchmarks). Lock-free, so the audio thread can call get() every block.
+template <typename entry_t>
+class simd_kernel_dispatch {
+	const entry_t *table; // scalar, sse, avx2
+	const char *owner; // prefix for messages, e.g. "oscillator_set_kernel"
+	std::atomic<const entry_t*> current;
+
+	const entry_t *widest() const { return cpu_has_avx2() ? &table[2] : &table[1]; }
+
+public:
+	constexpr simd_kernel_dispatch(const entry_t (&kernels)[3], const char *a_owner) : table(kernels), owner(a_owner), current(nullptr) {}
+
+	const entry_t &get() {
+		const entry_t *k = current.load(std::memory_order_relaxed);
+		if (!k) {
+			k = widest();
+			current.store(k, std::memory_order_relaxed);
+		}
+		return *k;
+	}
+
+	// NULL or "" goes back to the widest one the CPU supports
+	int set(const char *name) {
+		if (!name || !name[0]) {
+			current = widest();
+			return 1;
+		}
+
+		for (int i = 0; i < 3; ++i) {
+			if (strcmp(table[i].name, name) == 0) {
+				if (i == 2 && !cpu_has_avx2()) {
+					printf("%s: this CPU doesn't do AVX2.\n", owner);
+					return 0;
+				}
+				current = &table[i];
+				return 1;
+			}
+		}
+
+		printf("%s: no kernel named \"%s\".\n", owner, name);
+		return 0;
+	}
+};
@@ -0,0 +1,84 @@
+#include "fft_util.h"
+
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+static std::mutex planner_mutex;
+static bool wisdom_changed = false; // guarded by planner_mutex
+
+static void note_new_wisdom(unsigned flags) {
+	if (!(flags & FFTW_ESTIMATE)) wisdom_changed = true;
+}
+
+fftwf_plan fft_plan_r2c(int n, float *in, fftwf_complex *out, unsigned flags) {
+	std::lock_guard<std::mutex> lock(planner_mutex);
+	note_new_wisdom(flags);
+	return fftwf_plan_dft_r2c_1d(n, in, out, flags);
+}
+
+fftwf_plan fft_plan_c2r(int n, fftwf_complex *in, float *out, unsigned flags) {
+	std::lock_guard<std::mutex> lock(planner_mutex);
+	note_new_wisdom(flags);
+	return fftwf_plan_dft_c2r_1d(n, in, out, flags);
+}
+
+void fft_destroy_plan(fftwf_plan plan) {
+	std::lock_guard<std::mutex> lock(planner_mutex);
+	fftwf_destroy_plan(plan);
+}
+
+static const struct { const char *name; unsigned flags; } planners[] = {
+	{ "estimate", FFTW_ESTIMATE },
+	{ "measure", FFTW_MEASURE },
+	{ "patient", FFTW_PATIENT },
+};
+
+int fft_planner_from_name(const char *name, unsigned *flags) {
+	for (const auto &p : planners) {
+		if (strcmp(p.name, name) == 0) {
+			*flags = p.flags;
+			return 1;
+		}
+	}
+
+	printf("fft_planner_from_name: unknown planner \"%s\" (estimate, measure or patient).\n", name);
+	return 0;
+}
+
+const char *fft_planner_name(unsigned flags) {
+	for (const auto &p : planners) {
+		if (p.flags == flags) return p.name;
+	}
+	return "custom";
+}
+
+int fft_load_wisdom(const char *path) {
+	std::lock_guard<std::mutex> lock(planner_mutex);
+	if (!fftwf_import_wisdom_from_filename(path)) {
+		return 0;
+	}
+	wisdom_changed = false;
+	return 1;
+}
+
+int fft_save_wisdom(const char *path) {
+	std::lock_guard<std::mutex> lock(planner_mutex);
+	if (!wisdom_changed) {
+		return 1;
+	}
+
+	if (!fftwf_export_wisdom_to_filename(path)) {
+		printf("fft_save_wisdom: couldn't write %s.\n", path);
+		return 0;
+	}
+
+	wisdom_changed = false;
+	return 1;
+}
+
+void fft_forget_wisdom() {
+	std::lock_guard<std::mutex> lock(planner_mutex);
+	fftwf_forget_wisdom();
+	wisdom_changed = false;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "fftw3.h"
+
+// FFTW's planner isn't thread-safe (fftwf_execute is), and plans get made from the FFT thread as well as
+// wherever wavetables are built. Every plan should go through these.
+
+fftwf_plan fft_plan_r2c(int n, float *in, fftwf_complex *out, unsigned flags);
+fftwf_plan fft_plan_c2r(int n, fftwf_complex *in, float *out, unsigned flags);
+void fft_destroy_plan(fftwf_plan plan);
+
+// Planner effort: FFTW_ESTIMATE picks an algorithm from heuristics, instantly. FFTW_MEASURE and FFTW_PATIENT
+// time candidates on the actual arrays (overwriting them, so plan before filling them), which takes from
+// milliseconds to seconds but can be much faster for sizes like 3072 that aren't a power of two.
+// What they learn ("wisdom") stays in the process, and can be saved so the next run plans at ESTIMATE speed.
+int fft_planner_from_name(const char *name, unsigned *flags); // "estimate", "measure" or "patient"
+const char *fft_planner_name(unsigned flags);
+
+#define FFT_WISDOM_FILE "wfedit.wisdom"
+
+int fft_load_wisdom(const char *path); // 0 if there's no (readable) file, which is normal on a first run
+int fft_save_wisdom(const char *path); // only writes if plans were measured since the last load/save
+void fft_forget_wisdom();
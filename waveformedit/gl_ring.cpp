@@ -0,0 +1,125 @@
+#include "gl_ring.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "timer.h"
+
+#define GL_RING_WAIT_TIMEOUT_NS 100000000 // per glClientWaitSync call, re-issued until the fence signals
+
+gl_buffer_ring_t::gl_buffer_ring_t()
+	: buffer(0), region_size(0), region(0), persistent(false), num_waits(0), wait_ms(0), mapped(NULL), allow_persistent(true) {
+	for (int i = 0; i < GL_RING_REGIONS; ++i) fences[i] = NULL;
+}
+
+int gl_buffer_ring_t::init(size_t a_region_size, bool a_allow_persistent) {
+	region_size = a_region_size;
+	region = GL_RING_REGIONS - 1; // the first begin_write moves to region 0
+	allow_persistent = a_allow_persistent;
+	persistent = allow_persistent && GLAD_GL_VERSION_4_4;
+
+	const size_t total = GL_RING_REGIONS * region_size;
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+	if (persistent) {
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER, total, NULL, flags);
+		mapped = static_cast<uint8_t*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, total, flags));
+		if (!mapped) {
+			printf("gl_buffer_ring_t::init: couldn't map %zu bytes persistently, falling back to glBufferSubData.\n", total);
+			// storage made with glBufferStorage is immutable, start over with a plain buffer
+			glDeleteBuffers(1, &buffer);
+			glGenBuffers(1, &buffer);
+			glBindBuffer(GL_ARRAY_BUFFER, buffer);
+			persistent = false;
+		}
+	}
+
+	if (!persistent) {
+		glBufferData(GL_ARRAY_BUFFER, total, NULL, GL_DYNAMIC_DRAW);
+		staging.resize(region_size);
+	}
+
+	return 1;
+}
+
+void gl_buffer_ring_t::destroy() {
+	for (int i = 0; i < GL_RING_REGIONS; ++i) {
+		if (fences[i]) { glDeleteSync(fences[i]); fences[i] = NULL; }
+	}
+	if (mapped) {
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		mapped = NULL;
+	}
+	if (buffer) { glDeleteBuffers(1, &buffer); buffer = 0; }
+}
+
+bool gl_buffer_ring_t::grow(size_t min_region_size) {
+	if (min_region_size <= region_size) return false;
+
+	size_t s = region_size > 0 ? region_size : 1;
+	while (s < min_region_size) s *= 2;
+
+	// the GPU may still be drawing from the old buffer, GL keeps it alive until it's done
+	destroy();
+	init(s, allow_persistent);
+
+	return true;
+}
+
+void *gl_buffer_ring_t::begin_write() {
+	region = (region + 1) % GL_RING_REGIONS;
+
+	const GLsync f = fences[region];
+	if (f) {
+		GLenum status = glClientWaitSync(f, 0, 0);
+		if (status == GL_TIMEOUT_EXPIRED) {
+			// the GPU is still reading this region from GL_RING_REGIONS frames ago
+			perf_timer_t t;
+			do {
+				status = glClientWaitSync(f, GL_SYNC_FLUSH_COMMANDS_BIT, GL_RING_WAIT_TIMEOUT_NS);
+			} while (status == GL_TIMEOUT_EXPIRED);
+			++num_waits;
+			wait_ms += t.get_ms();
+		}
+		if (status == GL_WAIT_FAILED) {
+			printf("gl_buffer_ring_t::begin_write: glClientWaitSync failed.\n");
+		}
+		// kept until fence() replaces it, so current_region_free() can tell
+	}
+
+	return persistent ? mapped + region * region_size : &staging[0];
+}
+
+void gl_buffer_ring_t::end_write(size_t bytes) {
+	// coherent mapping: the writes are visible to commands issued from here on, nothing to flush
+	if (persistent || bytes == 0) return;
+
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferSubData(GL_ARRAY_BUFFER, region * region_size, bytes, &staging[0]);
+}
+
+void gl_buffer_ring_t::fence() {
+	if (fences[region]) {
+		glDeleteSync(fences[region]);
+	}
+	fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+static bool fence_pending(GLsync f) {
+	if (!f) return false;
+	GLint status = GL_SIGNALED;
+	glGetSynciv(f, GL_SYNC_STATUS, 1, NULL, &status);
+	return status != GL_SIGNALED;
+}
+
+bool gl_buffer_ring_t::next_region_busy() const {
+	return fence_pending(fences[(region + 1) % GL_RING_REGIONS]);
+}
+
+bool gl_buffer_ring_t::current_region_free() const {
+	return !fence_pending(fences[region]);
+}
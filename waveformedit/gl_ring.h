@@ -0,0 +1,69 @@
+#pragma once
+
+#include "glad/glad.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A vertex buffer written by the CPU every frame without stalling on the GPU.
+//
+// The buffer object holds GL_RING_REGIONS regions of region_size bytes, allocated with glBufferStorage and
+// mapped once, persistently and coherently: the CPU writes straight into the mapping, with no glBufferSubData
+// copy and no implicit sync. Each frame goes to the next region while the GPU may still be reading the
+// others, and a fence placed after the frame's draws tells when a region is free to be written again.
+// With three regions the CPU only waits if it gets two whole frames ahead of the GPU.
+//
+// The regions are consecutive in one buffer, so a VAO set up once at offset 0 draws region r by starting at
+// vertex first_vertex(stride). Without GL 4.4 (or if forced off), the same interface falls back to
+// glBufferSubData from a staging copy. "wfedit --bench gl_ring" runs both against a surfaceless EGL context.
+
+#define GL_RING_REGIONS 3
+
+struct gl_buffer_ring_t {
+	GLuint buffer;
+	size_t region_size; // bytes
+	int region; // the one being written / drawn this frame
+	bool persistent;
+
+	// time spent in glClientWaitSync, i.e. waiting for the GPU to let go of a region
+	uint64_t num_waits;
+	double wait_ms;
+
+	gl_buffer_ring_t();
+
+	// leaves buffer bound to GL_ARRAY_BUFFER, for the VAO setup that follows
+	int init(size_t region_size, bool allow_persistent = true);
+	void destroy();
+
+	// makes regions at least min_region_size bytes, doubling region_size until they are. Returns true if it had
+	// to: buffer is then a new object (bound to GL_ARRAY_BUFFER), and VAOs pointing at the old one need setting
+	// up again. Call before begin_write
+	bool grow(size_t min_region_size);
+
+	// moves on to the next region (waiting for its fence if the GPU isn't done with it) and returns where to
+	// write up to region_size bytes
+	void *begin_write();
+	// the fallback uploads here. bytes as written since begin_write
+	void end_write(size_t bytes);
+
+	// the first vertex of the current region, for vertices stride bytes apart
+	GLint first_vertex(size_t stride) const { return (GLint)(region * region_size / stride); }
+
+	// after the last draw reading the current region
+	void fence();
+
+	// for the bench: whether begin_write would have to wait for the GPU right now, and whether everything
+	// fenced on the current region has completed (which begin_write guarantees)
+	bool next_region_busy() const;
+	bool current_region_free() const;
+
+private:
+	uint8_t *mapped;
+	bool allow_persistent;
+	GLsync fences[GL_RING_REGIONS];
+	std::vector<uint8_t> staging;
+
+	gl_buffer_ring_t(const gl_buffer_ring_t&);
+	gl_buffer_ring_t &operator=(const gl_buffer_ring_t&);
+};
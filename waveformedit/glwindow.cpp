@@ -7,8 +7,10 @@
 #include <iostream>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <cmath>
 #include <vector>
+#include <algorithm>
 #include <string>
 #include <random>
 #include <stdarg.h>
@@ -24,7 +26,10 @@
 #include "lin_alg.h"
 #include "sound.h"
 #include "curve.h"
+#include "curve_io.h"
+#include "sample_convert.h"
 #include "timer.h"
+#include "gl_ring.h"
 
 bool mouse_locked = false;
 
@@ -41,9 +46,16 @@ unsigned WINDOW_WIDTH = WIN_W;
 unsigned WINDOW_HEIGHT = WIN_H;
 
 static GLuint wave_VBOid, wave_VAOid;
-static GLuint bezier_VBOid, bezier_VAOid;
-static GLuint point_VBOid, point_VAOid;
-static GLuint spectrum_VBOid, spectrum_VAOid;
+static GLuint bezier_VAOid, point_VAOid, spectrum_VAOid;
+
+// the per-frame vertex data, see gl_ring.h. sized per region, for curves of up to this many parts to begin with;
+// update_data grows them for longer ones
+#define BEZIER_INITIAL_PARTS 64
+static gl_buffer_ring_t bezier_ring, point_ring, spectrum_ring;
+static size_t bezier_parts = 0, point_count = 0; // in the current regions
+static int spectrum_bins = 0; // in spectrum_ring's current region
+static uint64_t spectrum_serial = 0; // of the spectrum_frame_t uploaded
+static double upload_ms = 0; // the last update_data, for report_frame_stats
 
 static int recording = 0;
 
@@ -67,7 +79,28 @@ void stop_main_loop() { _main_loop_running = false; }
 
 static SEGMENTED_BEZIER4 main_bezier;
 
-SEGMENTED_BEZIER4 get_main_bezier_copy() { return main_bezier;  }
+// main_bezier is only ever touched by this (the GL) thread, everyone else reads the rasterized cycle snapshots
+static cycle_snapshot_pool cycle_snapshots;
+static bool cycle_pending = true;
+
+cycle_snapshot_ref get_rasterized_cycle() { return cycle_snapshots.acquire(); }
+uint64_t get_rasterized_cycle_version() { return cycle_snapshots.version(); }
+
+// when the oldest edit not yet in a published cycle was seen, for the edit->spectrum latency
+static double edit_time_ms = 0;
+static bool edit_pending = false;
+
+static void publish_rasterized_cycle() {
+	rasterized_cycle_t *c = cycle_snapshots.begin_write();
+	if (!c) return;
+
+	c->samples.assign(main_bezier.samples, main_bezier.samples + main_bezier.frame_size);
+	c->edit_time_ms = edit_pending ? edit_time_ms : wfedit_clock_ms();
+	edit_pending = false;
+
+	cycle_snapshots.publish();
+	cycle_pending = false;
+}
 
 static mat4 projection, projection_inv;
 
@@ -86,19 +119,24 @@ vec4 solve_equation_coefs(const float *points) {
 	return correct;
 }
 
-void start_recording() {
-
-	static const std::string default_base = "recording";
-
+// base0.ext, base1.ext, ... whichever doesn't exist yet
+static std::string next_free_filename(const std::string &base, const std::string &ext) {
 	std::string tn;
 	struct stat fo;
 	
 	int r, s = 0;
 	do {
-		tn = default_base + std::to_string(s) + ".raw";
+		tn = base + std::to_string(s) + ext;
 		r = stat(tn.c_str(), &fo);
 		++s;
 	} while (r == 0);
+
+	return tn;
+}
+
+void start_recording() {
+
+	std::string tn = next_free_filename("recording", ".raw");
 		
 	printf("Recording raw data to file %s.\n", tn.c_str());
 	record.open(tn, std::ios::binary);
@@ -110,6 +148,14 @@ void stop_recording() {
 	record.close();
 }
 
+static void save_main_curve() {
+	std::string tn = next_free_filename("curve", ".txt");
+
+	if (curve_save_text(tn.c_str(), main_bezier)) {
+		printf("Saved curve to %s.\n", tn.c_str());
+	}
+}
+
 static float *sample_buffer = NULL;
 
 static float GT = 0;
@@ -152,33 +198,122 @@ static int get_samples(const vec4 &coefs, wave_format_t *fmt) {
 
 }
 
+static void report_rasterizer_stats(size_t samples_recomputed) {
+	static const int report_interval = 120; // frames
+	static int frames = 0;
+	static size_t recomputed = 0, max_recomputed = 0;
+
+	recomputed += samples_recomputed;
+	max_recomputed = (std::max)(max_recomputed, samples_recomputed);
+
+	if (++frames < report_interval) return;
+
+	if (recomputed > 0) {
+		printf("update_buffer: %zu samples recomputed over the last %d frames (avg %.1f/frame, max %zu/frame, frame size %zu)\n",
+			recomputed, frames, (double)recomputed / frames, max_recomputed, main_bezier.frame_size);
+	}
+
+	frames = 0;
+	recomputed = 0;
+	max_recomputed = 0;
+}
+
+// the attribute pointers refer to the ring's buffer object, which changes when the ring grows
+static void setup_bezier_VAO() {
+	glBindVertexArray(bezier_VAOid);
+	glBindBuffer(GL_ARRAY_BUFFER, bezier_ring.buffer);
+
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(mat24), 0);
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(mat24), (LPVOID)(sizeof(mat24::columns[0])));
+
+	glBindVertexArray(0);
+}
+
+static void setup_point_VAO() {
+	glBindVertexArray(point_VAOid);
+	glBindBuffer(GL_ARRAY_BUFFER, point_ring.buffer);
+
+	glEnableVertexAttribArray(0);
+
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
+
+	glBindVertexArray(0);
+}
+
 void update_data() {
 
 	GT += 0.005;
 
 	while (!SND_initialized()) { Sleep(250); }
 
-	wave_format_t fmt = SND_get_format_info();
-	//allocate_static_buf(fmt.num_channels * SND_get_frame_size());
-
-	main_bezier.allocate_buffer(fmt.num_channels, SND_get_frame_size());
+	main_bezier.allocate_buffer(SND_get_cycle_length());
 	// this won't do anything if it's already allocated
+
+	if (main_bezier.is_dirty()) {
+		// the callbacks that edit the curve ran just before this frame, so this is when the edit happened
+		if (!edit_pending) {
+			edit_time_ms = wfedit_clock_ms();
+			edit_pending = true;
+		}
+	}
 	
-	main_bezier.update_buffer(32);
-	SND_write_to_buffer(main_bezier.samples);
+	main_bezier.update_buffer();
 
-	glBindBuffer(GL_ARRAY_BUFFER, bezier_VBOid);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, main_bezier.matrix_reprs.size() * sizeof(mat24), &main_bezier.matrix_reprs[0]);
+	// update_buffer only re-renders what was edited since the last frame, and nothing at all if the curve is untouched
+	if (main_bezier.samples_recomputed > 0) {
+		SND_write_to_buffer(main_bezier.samples);
+		cycle_pending = true;
+	}
+
+	if (cycle_pending) publish_rasterized_cycle();
 
-	glBindBuffer(GL_ARRAY_BUFFER, point_VBOid);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, main_bezier.points.size() * sizeof(vec2), &main_bezier.points[0]);
+	report_rasterizer_stats(main_bezier.samples_recomputed);
+
+	if (record.is_open()) {
+		// recordings stay interleaved stereo
+		static std::vector<float> record_frames;
+		record_frames.resize(2 * main_bezier.frame_size);
+		expand_channels(main_bezier.samples, &record_frames[0], main_bezier.frame_size, 2);
+		record.write(reinterpret_cast<const char*>(&record_frames[0]), record_frames.size()*sizeof(float));
+	}
+
+	perf_timer_t upload_timer;
+
+	// straight into the mapped regions, see gl_ring.h. a loaded or edited curve can outgrow them
+	bezier_parts = main_bezier.matrix_reprs.size();
+	point_count = main_bezier.points.size();
+
+	if (bezier_ring.grow(bezier_parts * sizeof(mat24))) {
+		printf("bezier vertex ring grown to %zu parts.\n", bezier_ring.region_size / sizeof(mat24));
+		setup_bezier_VAO();
+	}
+	if (point_ring.grow(point_count * sizeof(vec2))) {
+		setup_point_VAO();
+	}
+
+	memcpy(bezier_ring.begin_write(), &main_bezier.matrix_reprs[0], bezier_parts * sizeof(mat24));
+	bezier_ring.end_write(bezier_parts * sizeof(mat24));
+
+	memcpy(point_ring.begin_write(), &main_bezier.points[0], point_count * sizeof(vec2));
+	point_ring.end_write(point_count * sizeof(vec2));
 
 	if (FFT_initialized()) {
-		float *spectrum = get_FFT_result();
-		glBindBuffer(GL_ARRAY_BUFFER, spectrum_VBOid);
-		glBufferSubData(GL_ARRAY_BUFFER, 0, get_FFT_size() * sizeof(float), spectrum);
+		// only when there's a new frame, and only its bins: the size may have changed since the last one.
+		// otherwise the ring stays on the region it drew from last time
+		const spectrum_frame_t &f = get_FFT_frame();
+		if (f.serial != spectrum_serial && f.num_resolutions > 0) {
+			spectrum_bins = (int)f.dB[0].size();
+			memcpy(spectrum_ring.begin_write(), &f.dB[0][0], spectrum_bins * sizeof(float));
+			spectrum_ring.end_write(spectrum_bins * sizeof(float));
+			spectrum_serial = f.serial;
+		}
 	}
 
+	upload_ms = upload_timer.get_ms();
+
 	//glUseProgram(wave_shader->getProgramHandle());
 	//wave_shader->update_uniform_mat4("coefs_inv", m);
 	//wave_shader->update_uniform_vec4("y_coords", vec4(y0, y1, y2, y3));
@@ -189,34 +324,80 @@ void update_data() {
 }
 
 
+// frame pacing and what the frame cost on the CPU, reported every couple of seconds
+static void report_frame_stats(double cpu_ms) {
+	static const int report_interval = 120; // frames
+	static perf_timer_t frame_timer;
+	static int frames = -1; // the first call only starts the clock
+	static double interval_sum = 0, interval_max = 0, cpu_sum = 0, upload_sum = 0;
+	static uint64_t waits_seen = 0;
+	static double wait_ms_seen = 0;
+
+	const double interval = frame_timer.get_ms();
+	frame_timer.begin();
+	if (++frames == 0) return;
+
+	interval_sum += interval;
+	interval_max = (std::max)(interval_max, interval);
+	cpu_sum += cpu_ms;
+	upload_sum += upload_ms;
+
+	if (frames < report_interval) return;
+
+	const uint64_t waits = bezier_ring.num_waits + point_ring.num_waits + spectrum_ring.num_waits;
+	const double wait_ms = bezier_ring.wait_ms + point_ring.wait_ms + spectrum_ring.wait_ms;
+
+	printf("frames: avg %.2f ms, max %.2f ms; draw() avg %.3f ms, uploads avg %.1f us (%s); %llu fence waits, %.2f ms\n",
+		interval_sum / frames, interval_max, cpu_sum / frames, 1000.0 * upload_sum / frames,
+		bezier_ring.persistent ? "persistent-mapped" : "glBufferSubData", (unsigned long long)(waits - waits_seen), wait_ms - wait_ms_seen);
+
+	frames = 0;
+	interval_sum = interval_max = cpu_sum = upload_sum = 0;
+	waits_seen = waits;
+	wait_ms_seen = wait_ms;
+}
+
 void draw() {
 
+	perf_timer_t cpu_timer;
+
 	update_data();
 	
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+	// every draw starts at its ring's current region
 	glUseProgram(bezier_shader->getProgramHandle());
 	glBindVertexArray(bezier_VAOid);
 	bezier_shader->update_uniform_mat4("uMVP", projection);
-	glDrawArrays(GL_PATCHES, 0, main_bezier.parts.size());
+	glDrawArrays(GL_PATCHES, bezier_ring.first_vertex(sizeof(mat24)), (GLsizei)bezier_parts);
 
 	glUseProgram(grid_shader->getProgramHandle());
 	grid_shader->update_uniform_1f("tess_level", 5);
 	grid_shader->update_uniform_mat4("uMVP", projection);
-	glDrawArrays(GL_PATCHES, 0, 1);
+	glDrawArrays(GL_PATCHES, bezier_ring.first_vertex(sizeof(mat24)), 1); // still the bezier VAO
 
 	glUseProgram(point_shader->getProgramHandle());
 	glBindVertexArray(point_VAOid);
 	point_shader->update_uniform_mat4("uMVP", projection);
-	glDrawArrays(GL_POINTS, 0, main_bezier.points.size());
+	glDrawArrays(GL_POINTS, point_ring.first_vertex(sizeof(vec2)), (GLsizei)point_count);
 
 	glUseProgram(spectrum_shader->getProgramHandle());
 	glBindVertexArray(spectrum_VAOid);
 	spectrum_shader->update_uniform_mat4("uMVP", projection);
-	glDrawArrays(GL_POINTS, 0, get_FFT_size()/2);
+	const GLint first_bin = spectrum_ring.first_vertex(sizeof(float));
+	spectrum_shader->update_uniform_1f("uNumBins", (float)spectrum_bins);
+	spectrum_shader->update_uniform_1i("uFirstBin", first_bin); // gl_VertexID starts at first_bin, not 0
+	glDrawArrays(GL_POINTS, first_bin, spectrum_bins);
 	
 	glBindVertexArray(0);
 
+	// the regions drawn from can be written again once these have passed
+	bezier_ring.fence();
+	point_ring.fence();
+	spectrum_ring.fence();
+
+	report_frame_stats(cpu_timer.get_ms());
+
 	/*grid_shader->update_uniform_1f("tess_level", 22);
 	mvp = mvp * mat4::scale(0.50, 2.0, 0) * mat4::rotate(3.1415926536 / 2.0, 0, 0, 1) * mat4::translate(-0.5, 1.0, 0.0);
 	grid_shader->update_uniform_mat4("uMVP", mvp);
@@ -224,7 +405,7 @@ void draw() {
 
 }
 
-int init_GL() {
+int init_GL(const char *curve_path, bool persistent_buffers) {
 
 	glClearColor(0.0, 0.0, 0.0, 1.0);
 	//glEnable(GL_DEPTH_TEST);
@@ -282,59 +463,26 @@ int init_GL() {
 	//glBindVertexArray(0);
 
 	glGenVertexArrays(1, &bezier_VAOid);
-	glBindVertexArray(bezier_VAOid);
-
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
-
-	glGenBuffers(1, &bezier_VBOid);
-	glBindBuffer(GL_ARRAY_BUFFER, bezier_VBOid);
-	glBufferData(GL_ARRAY_BUFFER, 64 * sizeof(mat24), NULL, GL_DYNAMIC_DRAW);
-
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(mat24), 0);
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(mat24), (LPVOID)(sizeof(mat24::columns[0])));
-
-	glBindVertexArray(0);
-
-	glDisableVertexAttribArray(0);
-	glDisableVertexAttribArray(1);
+	bezier_ring.init(BEZIER_INITIAL_PARTS * sizeof(mat24), persistent_buffers);
+	setup_bezier_VAO();
 
 	glGenVertexArrays(1, &point_VAOid);
-	glBindVertexArray(point_VAOid);
-
-	glEnableVertexAttribArray(0);
-
-	glGenBuffers(1, &point_VBOid);
-	glBindBuffer(GL_ARRAY_BUFFER, point_VBOid);
-	glBufferData(GL_ARRAY_BUFFER, 4*64 * sizeof(vec2), NULL, GL_DYNAMIC_DRAW);
-
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
-
-	glBindVertexArray(0);
-
-	glDisableVertexAttribArray(0);
-	glDisableVertexAttribArray(1);
+	point_ring.init(4 * BEZIER_INITIAL_PARTS * sizeof(vec2), persistent_buffers);
+	setup_point_VAO();
 
 	glGenVertexArrays(1, &spectrum_VAOid);
 	glBindVertexArray(spectrum_VAOid);
 	
 	glEnableVertexAttribArray(0);
-	glGenBuffers(1, &spectrum_VBOid);
-	glBindBuffer(GL_ARRAY_BUFFER, spectrum_VBOid);
-	glBufferData(GL_ARRAY_BUFFER, get_FFT_size()*sizeof(float), NULL, GL_DYNAMIC_DRAW);
+	spectrum_ring.init(SPECTRUM_MAX_SIZE/2 * sizeof(float), persistent_buffers); // room for any FFT size
 
 	glVertexAttribPointer(0, 1, GL_FLOAT, GL_FALSE, 0, 0);
 
 	glBindVertexArray(0);
 
-	main_bezier = SEGMENTED_BEZIER4(BEZIER4(vec2(0.0, 0.0), vec2(0.33, -1.0), vec2(0.66, 1.0), vec2(1.0, 0.0)));
-
-	main_bezier.split(0.15);
-	//main_bezier.split(0.30);
-	main_bezier.split(0.45);
-	//main_bezier.split(0.60);
-	main_bezier.split(0.75);
-	//main_bezier.split(0.90);
+	if (!curve_path || !curve_load(curve_path, &main_bezier)) {
+		main_bezier = make_default_curve();
+	}
 
 	projection = mat4::proj_ortho(-0.1, 1.1, -1.5, 1.5, -1.0, 1.0);
 	projection_inv = projection.inverted();
@@ -363,6 +511,24 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
 			recording = 1;
 		}
 	}
+	else if (key == GLFW_KEY_S && action == GLFW_PRESS) {
+		save_main_curve();
+	}
+	else if ((key == GLFW_KEY_EQUAL || key == GLFW_KEY_MINUS || key == GLFW_KEY_KP_ADD || key == GLFW_KEY_KP_SUBTRACT) && action == GLFW_PRESS) {
+		// double/halve the size of the spectrum on screen
+		spectrum_config_t c = get_FFT_config();
+		const uint32_t n = (key == GLFW_KEY_EQUAL || key == GLFW_KEY_KP_ADD) ? 2 * c.sizes[0] : c.sizes[0] / 2;
+		if (n >= SPECTRUM_MIN_SIZE && n <= SPECTRUM_MAX_SIZE && n % 2 == 0) {
+			c.sizes[0] = n;
+			set_FFT_config(c);
+		}
+	}
+	else if (key == GLFW_KEY_W && action == GLFW_PRESS) {
+		// cycle through the windows
+		spectrum_config_t c = get_FFT_config();
+		c.window = (spectrum_window_t)((c.window + 1) % (SPECTRUM_WINDOW_KAISER + 1));
+		set_FFT_config(c);
+	}
 }
 
 static int mouse_button_state[2] = { 0, 0 };
@@ -4,21 +4,36 @@
 #include <GLFW/glfw3.h>
 #include <Windows.h>
 #include <fstream>
+#include <vector>
 
 #include "curve.h"
+#include "snapshot_pool.h"
 
 #define WIN_W 1600
 #define WIN_H 900
 
 GLFWwindow *create_GL_window(const char* title, int width, int height);
-int init_GL();
+int init_GL(const char *curve_path = NULL, bool persistent_buffers = true); // curve_path: a text curve or bank to start with, see curve_io.h.
+// persistent_buffers = false uploads with glBufferSubData even where GL 4.4 persistent mapping is available, see gl_ring.h
 
 void draw();
 
 struct SEGMENTED_BEZIER4;
 
 float *get_main_samples();
-SEGMENTED_BEZIER4 get_main_bezier_copy();
+
+// The cycle as the audio path rasterized it, republished whenever the rasterizer recomputed anything. Lets
+// other consumers (the spectrum) use the samples the curve was already evaluated into instead of evaluating it again.
+struct rasterized_cycle_t {
+	std::vector<float> samples; // one cycle, mono
+	double edit_time_ms; // wfedit_clock_ms() when the first edit that went into it was seen
+};
+
+typedef snapshot_pool<rasterized_cycle_t, 4> cycle_snapshot_pool;
+typedef cycle_snapshot_pool::ref cycle_snapshot_ref;
+
+cycle_snapshot_ref get_rasterized_cycle(); // the snapshot's version() is the cycle's, bumped per publish
+uint64_t get_rasterized_cycle_version(); // without acquiring it, for "has anything changed" polling
 
 int FFT_initialized();
 
@@ -0,0 +1,167 @@
+#include "multichannel.h"
+
+#include <cstdio>
+#include <algorithm>
+
+#include "curve_io.h"
+
+multichannel_curve_t::multichannel_curve_t()
+	: num_channels(0), frame_size(0), frames(NULL), samples_recomputed(0), generation(0), busy(0), quit(false) {}
+
+multichannel_curve_t::~multichannel_curve_t() {
+	stop_workers();
+	for (auto &c : channels) {
+		delete[] c.samples;
+		c.samples = NULL;
+	}
+	delete[] frames;
+}
+
+int multichannel_curve_t::init(int nch, size_t framesize, int num_workers) {
+	if (nch < 1 || nch > MC_MAX_CHANNELS || framesize == 0) {
+		printf("multichannel_curve_t::init: bad channel count (%d, max %d) or frame size (%zu).\n", nch, MC_MAX_CHANNELS, framesize);
+		return 0;
+	}
+
+	stop_workers();
+
+	for (auto &c : channels) {
+		delete[] c.samples;
+		c.samples = NULL;
+		c.frame_size = 0;
+	}
+	delete[] frames;
+
+	num_channels = nch;
+	frame_size = framesize;
+	frames = new float[frame_size * num_channels];
+
+	const SEGMENTED_BEZIER4 default_curve = make_default_curve();
+	for (int c = 0; c < num_channels; ++c) {
+		set_channel(c, default_curve);
+		channels[c].allocate_buffer(frame_size);
+	}
+
+	if (num_workers < 0) {
+		const int cores = (std::max)(1, (int)std::thread::hardware_concurrency());
+		num_workers = (std::min)(num_channels, cores) - 1;
+	}
+	num_workers = (std::min)(num_workers, num_channels - 1);
+
+	quit = false;
+	busy = 0;
+	// generation keeps counting across init()s: new workers must wait for the next bump, not run on the current one
+	for (int i = 0; i < num_workers; ++i) {
+		workers.push_back(std::thread(&multichannel_curve_t::worker_proc, this, i + 1, generation));
+	}
+
+	return 1;
+}
+
+int multichannel_curve_t::load(const char *bank_path, uint32_t first_index) {
+	curve_bank_t bank;
+	if (!bank.open(bank_path)) {
+		return 0;
+	}
+
+	if (first_index + num_channels > bank.size()) {
+		printf("multichannel_curve_t::load: %s has %u curves, %d channels from index %u need %u.\n",
+			bank_path, bank.size(), num_channels, first_index, first_index + num_channels);
+		return 0;
+	}
+
+	for (int c = 0; c < num_channels; ++c) {
+		SEGMENTED_BEZIER4 curve;
+		if (!bank.load(first_index + c, &curve)) {
+			return 0;
+		}
+		set_channel(c, curve);
+	}
+
+	return 1;
+}
+
+void multichannel_curve_t::set_channel(int channel, const SEGMENTED_BEZIER4 &curve) {
+	// set_fragments keeps the channel's sample buffer, which a plain copy would overwrite
+	channels[channel].set_fragments(&curve.parts[0], curve.parts.size());
+}
+
+void multichannel_curve_t::rasterize_share(int thread_index) {
+	for (int c = thread_index; c < num_channels; c += num_threads()) {
+		channels[c].update_buffer();
+	}
+}
+
+void multichannel_curve_t::worker_proc(int thread_index, uint64_t seen) {
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			work_ready.wait(lock, [&] { return quit || generation != seen; });
+			if (quit) return;
+			seen = generation;
+		}
+
+		rasterize_share(thread_index);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--busy == 0) {
+			work_done.notify_one();
+		}
+	}
+}
+
+void multichannel_curve_t::stop_workers() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	work_ready.notify_all();
+
+	for (auto &w : workers) w.join();
+	workers.clear();
+}
+
+int multichannel_curve_t::update_buffer() {
+	samples_recomputed = 0;
+
+	int num_dirty = 0;
+	for (int c = 0; c < num_channels; ++c) num_dirty += channels[c].is_dirty();
+	if (num_dirty == 0) return 1;
+
+	// waking the workers costs more than a single dirty channel takes to rasterize
+
+	if (workers.empty() || num_dirty < 2) {
+		for (int c = 0; c < num_channels; ++c) channels[c].update_buffer();
+	}
+	else {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			busy = (int)workers.size();
+			++generation;
+		}
+		work_ready.notify_all();
+
+		rasterize_share(0);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		work_done.wait(lock, [this] { return busy == 0; });
+	}
+
+	for (int c = 0; c < num_channels; ++c) samples_recomputed += channels[c].samples_recomputed;
+
+	// the one interleaving pass. a frame's channels are adjacent in the output, so this writes frames sequentially
+	// and reads num_channels streams
+	const int nch = num_channels;
+	const float *src[MC_MAX_CHANNELS];
+	for (int c = 0; c < nch; ++c) src[c] = channels[c].samples;
+
+	float *out = frames;
+	for (size_t i = 0; i < frame_size; ++i) {
+		for (int c = 0; c < nch; ++c) {
+			*out++ = src[c][i];
+		}
+	}
+
+	return 1;
+}
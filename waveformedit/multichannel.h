@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "curve.h"
+
+// A multichannel document: one independent SEGMENTED_BEZIER4 per channel (true stereo, surround...).
+//
+// update_buffer() rasterizes the dirty channels in parallel, one channel per worker (the calling thread
+// being one of them), each into its own mono buffer so the workers never share a cache line. A single
+// pass then interleaves all channels into frames, which is what the output stage wants.
+
+#define MC_MAX_CHANNELS 8
+
+struct multichannel_curve_t {
+	SEGMENTED_BEZIER4 channels[MC_MAX_CHANNELS];
+	int num_channels;
+	size_t frame_size;
+
+	float *frames; // frame_size interleaved frames of num_channels samples
+	size_t samples_recomputed; // by the last update_buffer call, summed over the channels
+
+	multichannel_curve_t();
+	~multichannel_curve_t();
+
+	// every channel starts out as the editor's default curve. num_workers < 0 picks one thread per channel,
+	// capped by the core count; 0 rasterizes everything on the calling thread.
+	int init(int num_channels, size_t frame_size, int num_workers = -1);
+
+	// channels 0..num_channels-1 from curves first_index.. of a binary curve bank (see curve_io.h)
+	int load(const char *bank_path, uint32_t first_index);
+
+	void set_channel(int channel, const SEGMENTED_BEZIER4 &curve); // copies the fragments, marks the channel dirty
+
+	int update_buffer();
+
+	int num_threads() const { return (int)workers.size() + 1; }
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable work_ready, work_done;
+	uint64_t generation; // bumped per update_buffer, the workers run once per value
+	int busy; // workers still rasterizing the current generation
+	bool quit;
+
+	void rasterize_share(int thread_index); // channels thread_index, thread_index + num_threads(), ...
+	void worker_proc(int thread_index, uint64_t seen); // seen: the generation it starts out having done
+	void stop_workers();
+
+	multichannel_curve_t(const multichannel_curve_t&);
+	multichannel_curve_t &operator=(const multichannel_curve_t&);
+};
@@ -0,0 +1,319 @@
+#define _CRT_SECURE_NO_WARNINGS // fopen, sscanf
+
+#include "offline.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "curve.h"
+#include "curve_io.h"
+#include "wav.h"
+#include "timer.h"
+#include "wavetable.h"
+#include "oscillator.h"
+#include "multichannel.h"
+
+#define OFFLINE_CHUNK_FRAMES 65536 // frames converted and written per fwrite
+#define OFFLINE_PHASE_TABLE_SIZE 4096 // cycle resolution of the wavetable used when --freq asks for a non-integer cycle length
+
+static std::string curve_path_storage, output_path_storage;
+
+// the whitespace-separated token following "name" in cmdline, or NULL
+static const char *find_option(const char *cmdline, const char *name, char *value, size_t value_size) {
+	const char *p = cmdline;
+	const size_t len = strlen(name);
+
+	while ((p = strstr(p, name)) != NULL) {
+		const bool starts = (p == cmdline || p[-1] == ' ');
+		const bool ends = (p[len] == ' ' || p[len] == '\0');
+		if (starts && ends) {
+			p += len;
+			while (*p == ' ') ++p;
+			size_t n = 0;
+			while (p[n] && p[n] != ' ' && n + 1 < value_size) { value[n] = p[n]; ++n; }
+			value[n] = '\0';
+			return value;
+		}
+		p += len;
+	}
+	return NULL;
+}
+
+int parse_offline_render_options(const char *cmdline, offline_render_options_t *opts) {
+	char v[512];
+
+	*opts = offline_render_options_t();
+
+	// the curve file is the token after --render, unless it's another option
+	if (find_option(cmdline, "--render", v, sizeof(v)) && v[0] && v[0] != '-') {
+		curve_path_storage = v;
+		opts->curve_path = curve_path_storage.c_str();
+	}
+
+	if (!find_option(cmdline, "-o", v, sizeof(v)) || !v[0]) {
+		printf("--render: no output file given (-o out.wav).\n");
+		return 0;
+	}
+	output_path_storage = v;
+	opts->output_path = output_path_storage.c_str();
+
+	if (find_option(cmdline, "--index", v, sizeof(v))) { opts->curve_index = strtoul(v, NULL, 10); }
+	if (find_option(cmdline, "--rate", v, sizeof(v))) { opts->sample_rate = strtoul(v, NULL, 10); }
+	if (find_option(cmdline, "--channels", v, sizeof(v))) { opts->num_channels = atoi(v); }
+	opts->multichannel = find_option(cmdline, "--multichannel", v, sizeof(v)) != NULL;
+	if (find_option(cmdline, "--format", v, sizeof(v)) && !sample_format_from_name(v, &opts->format)) { return 0; }
+	if (find_option(cmdline, "--cycle", v, sizeof(v))) { opts->cycle_length = strtoul(v, NULL, 10); }
+	if (find_option(cmdline, "--freq", v, sizeof(v))) { opts->freq = atof(v); }
+	if (find_option(cmdline, "--notes", v, sizeof(v))) {
+		// comma separated, e.g. --notes 220,277.2,329.6
+		for (char *tok = strtok(v, ","); tok && opts->num_notes < OFFLINE_MAX_NOTES; tok = strtok(NULL, ",")) {
+			opts->notes[opts->num_notes++] = (float)atof(tok);
+		}
+	}
+	if (find_option(cmdline, "--cycles", v, sizeof(v))) { opts->num_cycles = strtoul(v, NULL, 10); }
+	if (find_option(cmdline, "--seconds", v, sizeof(v))) { opts->seconds = atof(v); }
+
+	if (opts->sample_rate == 0 || opts->cycle_length < 2 || opts->freq < 0 || opts->seconds < 0) {
+		printf("--render: bad rate/cycle/freq/seconds.\n");
+		return 0;
+	}
+
+	if (opts->num_channels < 1 || opts->num_channels > MC_MAX_CHANNELS) {
+		printf("--render: 1 to %d channels are supported (got %d).\n", MC_MAX_CHANNELS, opts->num_channels);
+		return 0;
+	}
+
+	if (opts->multichannel && (!opts->curve_path || opts->freq > 0 || opts->num_notes > 0)) {
+		printf("--render: --multichannel needs a curve bank, and plays in --cycle mode only.\n");
+		return 0;
+	}
+
+	if (opts->freq > 0.5 * opts->sample_rate) {
+		printf("--render: freq %.2f is above Nyquist for rate %u.\n", opts->freq, opts->sample_rate);
+		return 0;
+	}
+
+	for (int i = 0; i < opts->num_notes; ++i) {
+		if (!(opts->notes[i] > 0) || opts->notes[i] > 0.5 * opts->sample_rate) {
+			printf("--render: note %d (%.2f Hz) is out of range for rate %u.\n", i, opts->notes[i], opts->sample_rate);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static bool ends_with(const char *s, const char *suffix) {
+	size_t n = strlen(s), m = strlen(suffix);
+	return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+// Output stage: interleaved float frames in, WAV in fmt's sample format or raw float32 out.
+struct offline_sink_t {
+	wav_writer_t wav;
+	FILE *raw;
+	int num_channels;
+	sample_format_t format;
+	dither_t dither;
+	std::vector<uint8_t> pcm;
+
+	offline_sink_t() : raw(NULL), num_channels(2), format(SAMPLE_FORMAT_INT16) {}
+	~offline_sink_t() { close(); }
+
+	int open(const char *path, const wave_format_t &fmt) {
+		num_channels = fmt.num_channels;
+		if (ends_with(path, ".raw")) {
+			raw = fopen(path, "wb");
+			if (!raw) { printf("offline: couldn't open %s for writing.\n", path); }
+			return raw != NULL;
+		}
+		if (!sample_format_from_wave_format(fmt, &format)) {
+			printf("offline: unsupported WAV format (%d-bit).\n", fmt.bit_depth);
+			return 0;
+		}
+		return wav.open(path, fmt);
+	}
+
+	int write(const float *frames, uint32_t num_frames) {
+		const size_t n = (size_t)num_frames * num_channels;
+		if (raw) {
+			return fwrite(frames, sizeof(float), n, raw) == n;
+		}
+
+		pcm.resize(n * sample_format_bytes(format));
+		convert_samples(frames, &pcm[0], n, format, sample_format_wants_dither(format) ? &dither : NULL);
+		return wav.write(&pcm[0], num_frames);
+	}
+
+	void close() {
+		if (raw) { fclose(raw); raw = NULL; }
+		wav.close();
+	}
+};
+
+int wfedit_render_offline(const offline_render_options_t &opts) {
+
+	SEGMENTED_BEZIER4 curve;
+	if (opts.multichannel) {
+		// loaded into the document below
+	}
+	else if (opts.curve_path) {
+		if (!curve_load(opts.curve_path, &curve, opts.curve_index)) {
+			return 0;
+		}
+	}
+	else {
+		curve = make_default_curve();
+	}
+
+	const uint32_t rate = opts.sample_rate;
+	const int nch = opts.num_channels;
+
+	// with --freq/--notes the cycle is rendered once at a fixed resolution, mip-mapped into a band-limited wavetable
+	// and played by oscillator voices, otherwise it's rendered at exactly cycle_length frames and repeated verbatim
+	const bool phase_mode = opts.freq > 0 || opts.num_notes > 0;
+	const double freq = opts.num_notes > 0 ? opts.notes[0] : phase_mode ? opts.freq : (double)rate / opts.cycle_length;
+	const uint32_t table_size = phase_mode ? OFFLINE_PHASE_TABLE_SIZE : opts.cycle_length;
+
+	uint64_t total_frames = opts.seconds > 0
+		? (uint64_t)llround(opts.seconds * rate)
+		: (uint64_t)llround((double)opts.num_cycles * rate / freq);
+
+	if (total_frames > UINT32_MAX) {
+		printf("offline: %llu frames doesn't fit in a WAV file.\n", (unsigned long long)total_frames);
+		return 0;
+	}
+
+	perf_timer_t timer;
+	timer.begin();
+
+	multichannel_curve_t document;
+	if (opts.multichannel) {
+		if (!document.init(nch, table_size) || !document.load(opts.curve_path, opts.curve_index)) {
+			return 0;
+		}
+		document.update_buffer();
+	}
+	else {
+		curve.allocate_buffer(table_size);
+		curve.update_buffer();
+	}
+
+	wavetable_t wavetable;
+	oscillator_bank_t oscillator;
+	if (phase_mode) {
+		if (!wavetable.build(curve.samples, table_size)) {
+			return 0;
+		}
+		oscillator.init(rate);
+		oscillator.set_table(&wavetable.tables[0], wavetable.size, wavetable.num_levels);
+
+		if (opts.num_notes > 0) {
+			for (int i = 0; i < opts.num_notes; ++i) {
+				oscillator.note_on(opts.notes[i], 1.0f / opts.num_notes);
+			}
+		}
+		else {
+			oscillator.note_on((float)freq, 1.0f);
+		}
+	}
+
+	const double rasterize_ms = timer.get_ms();
+
+	wave_format_t fmt = {};
+	fmt.num_channels = nch;
+	fmt.sample_rate = rate;
+	sample_format_to_wave_format(opts.format, &fmt);
+	fmt.wave_freq = (float)freq;
+	fmt.cycle_duration_ms = (float)(1000.0 / freq);
+
+	offline_sink_t sink;
+	if (!sink.open(opts.output_path, fmt)) {
+		return 0;
+	}
+
+	std::vector<float> chunk((size_t)OFFLINE_CHUNK_FRAMES * nch);
+
+	const float *cycle = curve.samples; // mono, expanded to nch channels per chunk
+	uint32_t pos = 0;
+
+	uint64_t written = 0;
+	while (written < total_frames) {
+		const uint32_t n = (uint32_t)(std::min<uint64_t>)(OFFLINE_CHUNK_FRAMES, total_frames - written);
+		float *out = &chunk[0];
+
+		if (phase_mode) {
+			oscillator.render(out, n, nch);
+		}
+		else {
+			for (uint32_t i = 0; i < n; ) {
+				const uint32_t run = (std::min)(n - i, table_size - pos);
+				if (opts.multichannel) {
+					memcpy(out, document.frames + (size_t)pos * nch, (size_t)run * nch * sizeof(float));
+				}
+				else {
+					expand_channels(cycle + pos, out, run, nch);
+				}
+				out += run * nch;
+				i += run;
+				pos += run;
+				if (pos == table_size) { pos = 0; }
+			}
+		}
+
+		if (!sink.write(&chunk[0], n)) {
+			printf("offline: write to %s failed.\n", opts.output_path);
+			return 0;
+		}
+
+		written += n;
+	}
+
+	sink.close();
+
+	const double total_ms = timer.get_ms();
+	const double audio_ms = 1000.0 * total_frames / rate;
+
+	printf("rendered %llu frames (%.3f s, %u Hz, %d ch, %.3f Hz) to %s\n",
+		(unsigned long long)total_frames, audio_ms / 1000.0, rate, nch, freq, opts.output_path);
+	printf("rasterize%s %.3f ms, total %.3f ms, %.1fx realtime\n",
+		phase_mode ? " + wavetable" : "", rasterize_ms, total_ms, total_ms > 0 ? audio_ms / total_ms : 0.0);
+
+	return 1;
+}
+
+#ifdef WFEDIT_HEADLESS
+
+// Command-line build without the editor: "wfedit --render ..." or "wfedit --bench [name]".
+
+#include "bench.h"
+
+int main(int argc, char **argv) {
+	std::string cmdline;
+	for (int i = 1; i < argc; ++i) {
+		if (i > 1) cmdline += ' ';
+		cmdline += argv[i];
+	}
+
+	if (strstr(cmdline.c_str(), "--bench")) {
+		char which[64] = "";
+		sscanf(strstr(cmdline.c_str(), "--bench") + strlen("--bench"), "%63s", which);
+		return wfedit_run_benchmarks(which) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	offline_render_options_t opts;
+	if (!strstr(cmdline.c_str(), "--render") || !parse_offline_render_options(cmdline.c_str(), &opts)) {
+		printf("usage: %s --render [curve file] [--index N] -o out.wav [--rate N] [--channels N] [--multichannel] [--format s16|s24|s32|f32] [--cycle N | --freq F | --notes F,F,...] [--cycles N | --seconds S]\n", argv[0]);
+		printf("       %s --bench [name]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	return wfedit_render_offline(opts) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#endif
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+
+#include "sample_convert.h"
+
+// Headless rendering, "waveformedit.exe --render [curve file] -o out.wav [options]". No window, no GL context,
+// no audio device; the curve is rasterized and written as fast as the CPU goes.
+//
+//   curve file      a text curve or a binary curve bank (see curve_io.h). without one the editor's default curve is used
+//   --index N       which curve of a bank to render, default 0
+//   -o path         output file. *.raw writes interleaved 32-bit floats (like the old R-key recording), anything else WAV
+//   --format F      WAV sample format: s16 (default, dithered), s24 (dithered), s32 or f32
+//   --rate N        sample rate, default 48000
+//   --channels N    1 to MC_MAX_CHANNELS, default 2. the one curve plays on every channel, unless...
+//   --multichannel  the curve file is a bank and curves --index .. --index + N-1 are channels 0 .. N-1 (--cycle mode only)
+//   --cycle N       cycle length in frames, default 1024 (pitch = rate/N)
+//   --freq F        pitch in Hz instead of --cycle, any value. the cycle is played from a band-limited wavetable then
+//   --notes F,F,... a chord instead of a single pitch, up to OFFLINE_MAX_NOTES oscillator voices (cycles count the first note)
+//   --cycles N      number of cycles to render, default 1
+//   --seconds S     length in seconds instead of --cycles
+
+#define OFFLINE_MAX_NOTES 64
+
+struct offline_render_options_t {
+	const char *curve_path; // NULL renders the editor's default curve
+	uint32_t curve_index;
+	const char *output_path;
+	uint32_t sample_rate;
+	int num_channels;
+	bool multichannel; // a curve per channel
+	sample_format_t format; // of the WAV output
+	uint32_t cycle_length;
+	double freq;
+	float notes[OFFLINE_MAX_NOTES];
+	int num_notes;
+	uint32_t num_cycles;
+	double seconds;
+
+	offline_render_options_t()
+		: curve_path(NULL), curve_index(0), output_path(NULL), sample_rate(48000), num_channels(2),
+		multichannel(false), format(SAMPLE_FORMAT_INT16), cycle_length(1024), freq(0), num_notes(0), num_cycles(1), seconds(0) {}
+};
+
+// Fills opts from a command line. The returned strings point into storage owned by the parser, valid until the next call.
+int parse_offline_render_options(const char *cmdline, offline_render_options_t *opts);
+
+int wfedit_render_offline(const offline_render_options_t &opts);
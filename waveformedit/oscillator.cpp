@@ -0,0 +1,271 @@
+#include "oscillator.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include <xmmintrin.h>
+#include <immintrin.h>
+
+#include "wavetable.h"
+#include "curve_simd.h" // TARGET_AVX2, simd_kernel_dispatch
+
+oscillator_bank_t::oscillator_bank_t() {
+	init(48000);
+}
+
+void oscillator_bank_t::init(double a_sample_rate) {
+	sample_rate = a_sample_rate;
+	tables = NULL;
+	size = 0;
+	num_levels = 0;
+	num_slots = 0;
+
+	for (int i = 0; i < OSC_MAX_VOICES; ++i) {
+		phase[i] = inc[i] = gain[i] = hi_weight[i] = freq[i] = 0;
+		lo_offset[i] = hi_offset[i] = 0;
+	}
+}
+
+void oscillator_bank_t::set_table(const float *a_tables, uint32_t a_size, int a_num_levels) {
+	if (size != 0 && a_size != size) {
+		const float scale = (float)a_size / (float)size;
+		for (int i = 0; i < num_slots; ++i) {
+			phase[i] = fmodf(phase[i] * scale, (float)a_size);
+		}
+	}
+
+	tables = a_tables;
+	size = a_size;
+	num_levels = a_num_levels;
+
+	for (int i = 0; i < num_slots; ++i) {
+		set_voice(i, freq[i], gain[i]);
+	}
+}
+
+void oscillator_bank_t::set_voice(int slot, float f, float g) {
+	if (slot < 0 || slot >= OSC_MAX_VOICES) {
+		return;
+	}
+
+	// above Nyquist there's nothing left to play, and it keeps inc below size so one wrap per frame is enough
+	f = (std::min)(fabsf(f), (float)(0.5 * sample_rate));
+
+	freq[slot] = f;
+	gain[slot] = g;
+
+	if (tables && size) {
+		wavetable_lookup_t l = wavetable_select(tables, size, num_levels, f, sample_rate);
+		lo_offset[slot] = (int32_t)(l.lo - tables);
+		hi_offset[slot] = (int32_t)(l.hi - tables);
+		hi_weight[slot] = l.hi_weight;
+		inc[slot] = (float)(f / sample_rate * size);
+	}
+	else {
+		lo_offset[slot] = hi_offset[slot] = 0;
+		hi_weight[slot] = 0;
+		inc[slot] = 0;
+	}
+
+	if (g == 0) {
+		inc[slot] = 0;
+		phase[slot] = 0;
+	}
+
+	update_slot_count();
+}
+
+void oscillator_bank_t::update_slot_count() {
+	int last = -1;
+	for (int i = 0; i < OSC_MAX_VOICES; ++i) {
+		if (gain[i] != 0) last = i;
+	}
+	num_slots = (last + OSC_GROUP_SIZE) / OSC_GROUP_SIZE * OSC_GROUP_SIZE;
+}
+
+int oscillator_bank_t::note_on(float f, float g) {
+	for (int i = 0; i < OSC_MAX_VOICES; ++i) {
+		if (gain[i] == 0) {
+			phase[i] = 0;
+			set_voice(i, f, g);
+			return i;
+		}
+	}
+	return -1;
+}
+
+void oscillator_bank_t::note_off(int slot) {
+	set_voice(slot, 0, 0);
+}
+
+int oscillator_bank_t::num_active() const {
+	int n = 0;
+	for (int i = 0; i < num_slots; ++i) {
+		if (gain[i] != 0) ++n;
+	}
+	return n;
+}
+
+void oscillator_render_group_scalar(oscillator_bank_t &b, int first_voice, uint32_t n, float *acc) {
+	const float *T = b.tables;
+	const float size = (float)b.size;
+
+	for (int v = 0; v < OSC_GROUP_SIZE; ++v) {
+		const int k = first_voice + v;
+		const float *lo = T + b.lo_offset[k];
+		const float *hi = T + b.hi_offset[k];
+		const float w = b.hi_weight[k], g = b.gain[k], dp = b.inc[k];
+		float p = b.phase[k];
+
+		for (uint32_t f = 0; f < n; ++f) {
+			const int i = (int)p;
+			const float fr = p - (float)i;
+			const float yl = lo[i] + fr * (lo[i + 1] - lo[i]);
+			const float yh = hi[i] + fr * (hi[i + 1] - hi[i]);
+
+			acc[f * OSC_GROUP_SIZE + v] += g * (yl + w * (yh - yl));
+
+			p += dp;
+			if (p >= size) p -= size;
+		}
+
+		b.phase[k] = p;
+	}
+}
+
+// four voices starting at k, accumulating into lanes [lane, lane + 4[
+static inline void render_quad_sse(oscillator_bank_t &b, int k, int lane, uint32_t n, float *acc) {
+	const float *T = b.tables;
+
+	const __m128i lo_off = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&b.lo_offset[k]));
+	const __m128i hi_off = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&b.hi_offset[k]));
+	const __m128 w = _mm_loadu_ps(&b.hi_weight[k]);
+	const __m128 g = _mm_loadu_ps(&b.gain[k]);
+	const __m128 dp = _mm_loadu_ps(&b.inc[k]);
+	const __m128 size = _mm_set1_ps((float)b.size);
+	__m128 p = _mm_loadu_ps(&b.phase[k]);
+
+	// SSE has no gather, the four table reads per voice go through memory
+	int32_t il[4], ih[4];
+
+	for (uint32_t f = 0; f < n; ++f) {
+		const __m128i i = _mm_cvttps_epi32(p);
+		const __m128 fr = _mm_sub_ps(p, _mm_cvtepi32_ps(i));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(il), _mm_add_epi32(i, lo_off));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(ih), _mm_add_epi32(i, hi_off));
+
+		const __m128 l0 = _mm_setr_ps(T[il[0]], T[il[1]], T[il[2]], T[il[3]]);
+		const __m128 l1 = _mm_setr_ps(T[il[0] + 1], T[il[1] + 1], T[il[2] + 1], T[il[3] + 1]);
+		const __m128 h0 = _mm_setr_ps(T[ih[0]], T[ih[1]], T[ih[2]], T[ih[3]]);
+		const __m128 h1 = _mm_setr_ps(T[ih[0] + 1], T[ih[1] + 1], T[ih[2] + 1], T[ih[3] + 1]);
+
+		const __m128 yl = _mm_add_ps(l0, _mm_mul_ps(fr, _mm_sub_ps(l1, l0)));
+		const __m128 yh = _mm_add_ps(h0, _mm_mul_ps(fr, _mm_sub_ps(h1, h0)));
+		const __m128 y = _mm_add_ps(yl, _mm_mul_ps(w, _mm_sub_ps(yh, yl)));
+
+		float *a = acc + f * OSC_GROUP_SIZE + lane;
+		_mm_storeu_ps(a, _mm_add_ps(_mm_loadu_ps(a), _mm_mul_ps(g, y)));
+
+		p = _mm_add_ps(p, dp);
+		p = _mm_sub_ps(p, _mm_and_ps(_mm_cmpge_ps(p, size), size));
+	}
+
+	_mm_storeu_ps(&b.phase[k], p);
+}
+
+void oscillator_render_group_sse(oscillator_bank_t &b, int first_voice, uint32_t n, float *acc) {
+	render_quad_sse(b, first_voice, 0, n, acc);
+	render_quad_sse(b, first_voice + 4, 4, n, acc);
+}
+
+TARGET_AVX2
+void oscillator_render_group_avx2(oscillator_bank_t &b, int first_voice, uint32_t n, float *acc) {
+	const float *T = b.tables;
+	const int k = first_voice;
+
+	const __m256i lo_off = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&b.lo_offset[k]));
+	const __m256i hi_off = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&b.hi_offset[k]));
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256 w = _mm256_loadu_ps(&b.hi_weight[k]);
+	const __m256 g = _mm256_loadu_ps(&b.gain[k]);
+	const __m256 dp = _mm256_loadu_ps(&b.inc[k]);
+	const __m256 size = _mm256_set1_ps((float)b.size);
+	__m256 p = _mm256_loadu_ps(&b.phase[k]);
+
+	for (uint32_t f = 0; f < n; ++f) {
+		const __m256i i = _mm256_cvttps_epi32(p);
+		const __m256 fr = _mm256_sub_ps(p, _mm256_cvtepi32_ps(i));
+
+		const __m256i il = _mm256_add_epi32(i, lo_off);
+		const __m256i ih = _mm256_add_epi32(i, hi_off);
+
+		const __m256 l0 = _mm256_i32gather_ps(T, il, 4);
+		const __m256 l1 = _mm256_i32gather_ps(T, _mm256_add_epi32(il, one), 4);
+		const __m256 h0 = _mm256_i32gather_ps(T, ih, 4);
+		const __m256 h1 = _mm256_i32gather_ps(T, _mm256_add_epi32(ih, one), 4);
+
+		const __m256 yl = _mm256_fmadd_ps(fr, _mm256_sub_ps(l1, l0), l0);
+		const __m256 yh = _mm256_fmadd_ps(fr, _mm256_sub_ps(h1, h0), h0);
+		const __m256 y = _mm256_fmadd_ps(w, _mm256_sub_ps(yh, yl), yl);
+
+		float *a = acc + f * OSC_GROUP_SIZE;
+		_mm256_storeu_ps(a, _mm256_fmadd_ps(g, y, _mm256_loadu_ps(a)));
+
+		p = _mm256_add_ps(p, dp);
+		p = _mm256_sub_ps(p, _mm256_and_ps(_mm256_cmp_ps(p, size, _CMP_GE_OQ), size));
+	}
+
+	_mm256_storeu_ps(&b.phase[k], p);
+}
+
+typedef void(*osc_kernel_t)(oscillator_bank_t&, int, uint32_t, float*);
+
+struct osc_kernel_entry_t {
+	const char *name;
+	osc_kernel_t kernel;
+};
+
+static const osc_kernel_entry_t osc_kernels[] = {
+	{ "scalar", oscillator_render_group_scalar },
+	{ "sse", oscillator_render_group_sse },
+	{ "avx2", oscillator_render_group_avx2 },
+};
+
+static simd_kernel_dispatch<osc_kernel_entry_t> osc_dispatch(osc_kernels, "oscillator_set_kernel");
+
+int oscillator_set_kernel(const char *name) {
+	return osc_dispatch.set(name);
+}
+
+const char *oscillator_kernel_name() {
+	return osc_dispatch.get().name;
+}
+
+void oscillator_bank_t::render(float *out, uint32_t num_frames, int num_channels) {
+	const osc_kernel_t kernel = osc_dispatch.get().kernel;
+
+	while (num_frames > 0) {
+		const uint32_t n = (std::min)(num_frames, (uint32_t)OSC_BLOCK_SIZE);
+
+		memset(acc, 0, n * OSC_GROUP_SIZE * sizeof(float));
+
+		if (tables) {
+			for (int v = 0; v < num_slots; v += OSC_GROUP_SIZE) {
+				kernel(*this, v, n, acc);
+			}
+		}
+
+		for (uint32_t f = 0; f < n; ++f) {
+			const float *a = acc + f * OSC_GROUP_SIZE;
+			const float s = ((a[0] + a[1]) + (a[2] + a[3])) + ((a[4] + a[5]) + (a[6] + a[7]));
+			for (int c = 0; c < num_channels; ++c) {
+				*out++ = s;
+			}
+		}
+
+		num_frames -= n;
+	}
+}
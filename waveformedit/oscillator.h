@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+
+// A pool of phase-accumulator voices playing the edited cycle out of a wavetable mip chain (see wavetable.h).
+// Each voice reads the two levels wavetable_select picks for its pitch with linear interpolation and
+// crossfades between them, so any pitch plays alias-free.
+//
+// The voice state is kept as structure-of-arrays and render() processes 4 (SSE) or 8 (AVX2) voices per
+// instruction: the phases of a whole group advance together and their samples are accumulated lane-wise,
+// with one horizontal sum per output frame at the end of the block.
+
+#define OSC_MAX_VOICES 128 // a multiple of the widest kernel
+#define OSC_BLOCK_SIZE 256 // frames rendered per pass over the voices
+#define OSC_GROUP_SIZE 8 // voices per kernel call. SSE does a group as two halves
+
+struct oscillator_bank_t {
+	// per voice; slots >= num_slots are silent and never touched by render()
+	float phase[OSC_MAX_VOICES]; // in table samples, [0, size[
+	float inc[OSC_MAX_VOICES]; // table samples per output frame
+	float gain[OSC_MAX_VOICES]; // 0 = free
+	float hi_weight[OSC_MAX_VOICES];
+	int32_t lo_offset[OSC_MAX_VOICES], hi_offset[OSC_MAX_VOICES]; // the voice's two levels, as offsets into tables
+	float freq[OSC_MAX_VOICES];
+
+	int num_slots; // one past the highest slot in use, rounded up to OSC_GROUP_SIZE
+
+	const float *tables;
+	uint32_t size;
+	int num_levels;
+	double sample_rate;
+
+	oscillator_bank_t();
+
+	void init(double sample_rate);
+
+	// levels laid out like wavetable_t::tables. Called again when the cycle is edited; the voices keep
+	// their phase (rescaled if the size changed) and re-pick their levels.
+	void set_table(const float *tables, uint32_t size, int num_levels);
+
+	int note_on(float freq, float gain); // returns the voice's slot, or -1 if they're all taken
+	void note_off(int slot);
+	void set_voice(int slot, float freq, float gain); // gain 0 frees the slot
+	int num_active() const;
+
+	// overwrites out[0 .. num_frames*num_channels[ with the interleaved mix, every channel gets the same signal
+	void render(float *out, uint32_t num_frames, int num_channels);
+
+private:
+	float acc[OSC_BLOCK_SIZE * OSC_GROUP_SIZE]; // lane-wise partial sums, one lane per voice of a group
+	void update_slot_count();
+};
+
+// the kernels, exposed for bench.cpp. They add voices [first_voice, first_voice + OSC_GROUP_SIZE[ into acc.
+void oscillator_render_group_scalar(oscillator_bank_t &b, int first_voice, uint32_t n, float *acc);
+void oscillator_render_group_sse(oscillator_bank_t &b, int first_voice, uint32_t n, float *acc);
+void oscillator_render_group_avx2(oscillator_bank_t &b, int first_voice, uint32_t n, float *acc);
+
+// forces a kernel ("scalar", "sse" or "avx2"), NULL or "" goes back to the widest one the CPU supports
+int oscillator_set_kernel(const char *name);
+const char *oscillator_kernel_name();
@@ -0,0 +1,93 @@
+#include "resample.h"
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#include "fft_util.h"
+
+cycle_resampler_t::cycle_resampler_t()
+	: in_size(0), out_size(0), plan_r2c(NULL), plan_c2r(NULL), in_buf(NULL), out_buf(NULL), in_spectrum(NULL), out_spectrum(NULL) {}
+
+cycle_resampler_t::~cycle_resampler_t() {
+	release_fft();
+}
+
+void cycle_resampler_t::release_fft() {
+	if (plan_r2c) { fft_destroy_plan(plan_r2c); }
+	if (plan_c2r) { fft_destroy_plan(plan_c2r); }
+	if (in_buf) { fftwf_free(in_buf); }
+	if (out_buf) { fftwf_free(out_buf); }
+	if (in_spectrum) { fftwf_free(in_spectrum); }
+	if (out_spectrum) { fftwf_free(out_spectrum); }
+
+	plan_r2c = plan_c2r = NULL;
+	in_buf = out_buf = NULL;
+	in_spectrum = out_spectrum = NULL;
+}
+
+int cycle_resampler_t::resample(const float *in, uint32_t n_in, float *out, uint32_t n_out) {
+
+	if (n_in < 2 || n_out < 2) {
+		printf("cycle_resampler_t::resample: bad sizes %u -> %u.\n", n_in, n_out);
+		return 0;
+	}
+
+	if (n_in == n_out) {
+		memcpy(out, in, n_in * sizeof(float));
+		return 1;
+	}
+
+	if (n_in != in_size || n_out != out_size || !plan_r2c) {
+		release_fft();
+
+		in_size = n_in;
+		out_size = n_out;
+
+		in_buf = static_cast<float*>(fftwf_malloc(in_size * sizeof(float)));
+		out_buf = static_cast<float*>(fftwf_malloc(out_size * sizeof(float)));
+		in_spectrum = static_cast<fftwf_complex*>(fftwf_malloc((in_size / 2 + 1) * sizeof(fftwf_complex)));
+		out_spectrum = static_cast<fftwf_complex*>(fftwf_malloc((out_size / 2 + 1) * sizeof(fftwf_complex)));
+
+		plan_r2c = fft_plan_r2c(in_size, in_buf, in_spectrum, FFTW_ESTIMATE);
+		plan_c2r = fft_plan_c2r(out_size, out_spectrum, out_buf, FFTW_ESTIMATE);
+
+		if (!plan_r2c || !plan_c2r) {
+			printf("cycle_resampler_t::resample: couldn't create FFT plans for %u -> %u.\n", in_size, out_size);
+			release_fft();
+			in_size = out_size = 0;
+			return 0;
+		}
+	}
+
+	memcpy(in_buf, in, in_size * sizeof(float));
+	fftwf_execute(plan_r2c);
+
+	// bins 0 .. h are shared by both sizes, everything above is zero (upsampling) or dropped (downsampling)
+	const uint32_t in_bins = in_size / 2 + 1, out_bins = out_size / 2 + 1;
+	const uint32_t h = (std::min)(in_bins, out_bins) - 1;
+
+	memcpy(out_spectrum, in_spectrum, (h + 1) * sizeof(fftwf_complex));
+	memset(out_spectrum + h + 1, 0, (out_bins - h - 1) * sizeof(fftwf_complex));
+
+	// an even size's Nyquist bin is counted once, every other bin twice (itself and its conjugate). Going up, the
+	// input's Nyquist bin becomes an ordinary one and is split in half; going down, the output's Nyquist bin takes
+	// what a cosine at that frequency samples to, which is twice the real part
+	if (out_size > in_size && in_size % 2 == 0) {
+		out_spectrum[h][0] *= 0.5f;
+		out_spectrum[h][1] *= 0.5f;
+	}
+	else if (out_size < in_size && out_size % 2 == 0) {
+		out_spectrum[h][0] *= 2.0f;
+		out_spectrum[h][1] = 0;
+	}
+
+	fftwf_execute(plan_c2r);
+
+	const float scale = 1.0f / in_size;
+	for (uint32_t i = 0; i < out_size; ++i) {
+		out[i] = out_buf[i] * scale;
+	}
+
+	return 1;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+
+#include "fftw3.h"
+
+// Resamples one period of a periodic signal to another length through its spectrum: an r2c FFT at the input
+// size, the bins copied (zero-padded or truncated) into a spectrum of the output size, and a c2r back.
+// Exact for anything band-limited below the smaller of the two Nyquists; harmonics above the output's
+// Nyquist are dropped instead of aliasing. Used to hand the rasterized cycle to the spectrum analyzer
+// at its own resolution without evaluating the curve again.
+
+struct cycle_resampler_t {
+	uint32_t in_size, out_size;
+
+	cycle_resampler_t();
+	~cycle_resampler_t();
+
+	// out[0 .. out_size[ from in[0 .. in_size[. Plans on the first call and whenever a size changes.
+	int resample(const float *in, uint32_t in_size, float *out, uint32_t out_size);
+
+private:
+	fftwf_plan plan_r2c, plan_c2r;
+	float *in_buf, *out_buf;
+	fftwf_complex *in_spectrum, *out_spectrum;
+
+	void release_fft();
+
+	cycle_resampler_t(const cycle_resampler_t&);
+	cycle_resampler_t &operator=(const cycle_resampler_t&);
+};
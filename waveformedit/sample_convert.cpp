@@ -0,0 +1,373 @@
+#include "sample_convert.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+
+#include <emmintrin.h>
+#include <immintrin.h>
+
+#include "curve_simd.h" // TARGET_AVX2, simd_kernel_dispatch
+
+#define DITHER_UNIFORM_SCALE (1.0f / 65536.0f)
+
+void dither_t::seed(uint32_t s) {
+	for (int i = 0; i < 8; ++i) {
+		// splitmix-style scramble so neighbouring lanes don't start out correlated. xorshift must not start at 0
+		uint32_t z = s + 0x9E3779B9u * (i + 1);
+		z = (z ^ (z >> 16)) * 0x85EBCA6Bu;
+		z = (z ^ (z >> 13)) * 0xC2B2AE35u;
+		z ^= z >> 16;
+		state[i] = z ? z : 1;
+	}
+}
+
+int sample_format_from_wave_format(const wave_format_t &fmt, sample_format_t *out) {
+	if (fmt.is_float) {
+		if (fmt.bit_depth != 32) return 0;
+		*out = SAMPLE_FORMAT_FLOAT32;
+		return 1;
+	}
+
+	switch (fmt.bit_depth) {
+	case 16: *out = SAMPLE_FORMAT_INT16; return 1;
+	case 24: *out = SAMPLE_FORMAT_INT24; return 1;
+	case 32: *out = SAMPLE_FORMAT_INT32; return 1;
+	default: return 0;
+	}
+}
+
+void sample_format_to_wave_format(sample_format_t f, wave_format_t *fmt) {
+	fmt->bit_depth = (f == SAMPLE_FORMAT_INT16) ? 16 : (f == SAMPLE_FORMAT_INT24) ? 24 : 32;
+	fmt->is_float = (f == SAMPLE_FORMAT_FLOAT32);
+}
+
+int sample_format_from_name(const char *name, sample_format_t *out) {
+	static const struct { const char *name; sample_format_t format; } names[] = {
+		{ "s16", SAMPLE_FORMAT_INT16 },
+		{ "s24", SAMPLE_FORMAT_INT24 },
+		{ "s32", SAMPLE_FORMAT_INT32 },
+		{ "f32", SAMPLE_FORMAT_FLOAT32 },
+	};
+
+	for (const auto &n : names) {
+		if (strcmp(n.name, name) == 0) {
+			*out = n.format;
+			return 1;
+		}
+	}
+
+	printf("sample_format_from_name: unknown sample format \"%s\" (s16, s24, s32 or f32).\n", name);
+	return 0;
+}
+
+size_t sample_format_bytes(sample_format_t f) {
+	switch (f) {
+	case SAMPLE_FORMAT_INT16: return 2;
+	case SAMPLE_FORMAT_INT24: return 3;
+	default: return 4;
+	}
+}
+
+const char *sample_format_name(sample_format_t f) {
+	switch (f) {
+	case SAMPLE_FORMAT_INT16: return "int16";
+	case SAMPLE_FORMAT_INT24: return "int24";
+	case SAMPLE_FORMAT_INT32: return "int32";
+	default: return "float32";
+	}
+}
+
+void expand_channels(const float *mono, float *out, size_t num_frames, int num_channels) {
+	if (num_channels == 2) {
+		for (size_t i = 0; i < num_frames; ++i) {
+			out[2 * i] = mono[i];
+			out[2 * i + 1] = mono[i];
+		}
+		return;
+	}
+
+	for (size_t i = 0; i < num_frames; ++i) {
+		for (int c = 0; c < num_channels; ++c) {
+			*out++ = mono[i];
+		}
+	}
+}
+
+// scale to full range, and the limits applied after dithering (in the scaled domain, before rounding)
+struct format_limits_t {
+	float scale, lo, hi;
+};
+
+static format_limits_t format_limits(sample_format_t f) {
+	switch (f) {
+	case SAMPLE_FORMAT_INT16: return { 32767.0f, -32768.0f, 32767.0f };
+	case SAMPLE_FORMAT_INT24: return { 8388607.0f, -8388608.0f, 8388607.0f };
+	// 2147483647 isn't representable, the float is 2^31. 2147483520 is the largest float below that
+	case SAMPLE_FORMAT_INT32: return { 2147483647.0f, -2147483648.0f, 2147483520.0f };
+	default: return { 1.0f, -1.0f, 1.0f };
+	}
+}
+
+static inline uint32_t xorshift32(uint32_t &s) {
+	s ^= s << 13;
+	s ^= s >> 17;
+	s ^= s << 5;
+	return s;
+}
+
+// samples [begin, end[, sample i dithered from lane i % 8
+static void convert_range_scalar(const float *in, void *out, size_t begin, size_t end, sample_format_t f, dither_t *dither) {
+	const format_limits_t L = format_limits(f);
+	uint8_t *o = static_cast<uint8_t*>(out);
+
+	for (size_t i = begin; i < end; ++i) {
+		float v = in[i];
+		v = (v > -1.0f) ? v : -1.0f; // NaN goes to -1, like _mm_max_ps(v, -1)
+		v = (v < 1.0f) ? v : 1.0f;
+
+		if (f == SAMPLE_FORMAT_FLOAT32) {
+			memcpy(o + 4 * i, &v, 4);
+			continue;
+		}
+
+		v *= L.scale;
+
+		if (dither) {
+			const uint32_t r = xorshift32(dither->state[i & 7]);
+			v += (float)(r & 0xffff) * DITHER_UNIFORM_SCALE - (float)(r >> 16) * DITHER_UNIFORM_SCALE;
+		}
+
+		v = (v > L.lo) ? v : L.lo;
+		v = (v < L.hi) ? v : L.hi;
+
+		const int32_t s = (int32_t)lrintf(v);
+
+		switch (f) {
+		case SAMPLE_FORMAT_INT16: {
+			const int16_t s16 = (int16_t)s;
+			memcpy(o + 2 * i, &s16, 2);
+			break;
+		}
+		case SAMPLE_FORMAT_INT24:
+			o[3 * i] = (uint8_t)s;
+			o[3 * i + 1] = (uint8_t)(s >> 8);
+			o[3 * i + 2] = (uint8_t)(s >> 16);
+			break;
+		default:
+			memcpy(o + 4 * i, &s, 4);
+			break;
+		}
+	}
+}
+
+void convert_samples_scalar(const float *in, void *out, size_t n, sample_format_t f, dither_t *dither) {
+	convert_range_scalar(in, out, 0, n, f, dither);
+}
+
+static inline __m128i xorshift32_sse2(__m128i &s) {
+	s = _mm_xor_si128(s, _mm_slli_epi32(s, 13));
+	s = _mm_xor_si128(s, _mm_srli_epi32(s, 17));
+	s = _mm_xor_si128(s, _mm_slli_epi32(s, 5));
+	return s;
+}
+
+static inline __m128 tpdf_sse2(__m128i &s) {
+	const __m128i r = xorshift32_sse2(s);
+	const __m128 k = _mm_set1_ps(DITHER_UNIFORM_SCALE);
+	const __m128 u1 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(r, _mm_set1_epi32(0xffff))), k);
+	const __m128 u2 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(r, 16)), k);
+	return _mm_sub_ps(u1, u2);
+}
+
+void convert_samples_sse2(const float *in, void *out, size_t n, sample_format_t f, dither_t *dither) {
+	const format_limits_t L = format_limits(f);
+	uint8_t *o = static_cast<uint8_t*>(out);
+
+	const __m128 m1 = _mm_set1_ps(-1.0f), p1 = _mm_set1_ps(1.0f);
+	const __m128 scale = _mm_set1_ps(L.scale), lo = _mm_set1_ps(L.lo), hi = _mm_set1_ps(L.hi);
+
+	__m128i s0 = _mm_setzero_si128(), s1 = _mm_setzero_si128();
+	if (dither) {
+		s0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&dither->state[0]));
+		s1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&dither->state[4]));
+	}
+
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128 a = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i), m1), p1);
+		__m128 b = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i + 4), m1), p1);
+
+		if (f == SAMPLE_FORMAT_FLOAT32) {
+			_mm_storeu_ps(reinterpret_cast<float*>(o + 4 * i), a);
+			_mm_storeu_ps(reinterpret_cast<float*>(o + 4 * i + 16), b);
+			continue;
+		}
+
+		a = _mm_mul_ps(a, scale);
+		b = _mm_mul_ps(b, scale);
+
+		if (dither) {
+			a = _mm_add_ps(a, tpdf_sse2(s0));
+			b = _mm_add_ps(b, tpdf_sse2(s1));
+		}
+
+		const __m128i ia = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(a, lo), hi));
+		const __m128i ib = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(b, lo), hi));
+
+		switch (f) {
+		case SAMPLE_FORMAT_INT16:
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(o + 2 * i), _mm_packs_epi32(ia, ib));
+			break;
+		case SAMPLE_FORMAT_INT24: {
+			// no byte shuffle in SSE2, the packing goes through memory
+			int32_t t[8];
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(&t[0]), ia);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(&t[4]), ib);
+			uint8_t *d = o + 3 * i;
+			for (int k = 0; k < 8; ++k) {
+				d[3 * k] = (uint8_t)t[k];
+				d[3 * k + 1] = (uint8_t)(t[k] >> 8);
+				d[3 * k + 2] = (uint8_t)(t[k] >> 16);
+			}
+			break;
+		}
+		default:
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(o + 4 * i), ia);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(o + 4 * i + 16), ib);
+			break;
+		}
+	}
+
+	if (dither) {
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(&dither->state[0]), s0);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(&dither->state[4]), s1);
+	}
+
+	convert_range_scalar(in, out, i, n, f, dither);
+}
+
+TARGET_AVX2
+void convert_samples_avx2(const float *in, void *out, size_t n, sample_format_t f, dither_t *dither) {
+	const format_limits_t L = format_limits(f);
+	uint8_t *o = static_cast<uint8_t*>(out);
+
+	const __m256 m1 = _mm256_set1_ps(-1.0f), p1 = _mm256_set1_ps(1.0f);
+	const __m256 scale = _mm256_set1_ps(L.scale), lo = _mm256_set1_ps(L.lo), hi = _mm256_set1_ps(L.hi);
+	const __m256 k = _mm256_set1_ps(DITHER_UNIFORM_SCALE);
+	const __m256i low16 = _mm256_set1_epi32(0xffff);
+
+	// int32 -> 3 bytes within each 128-bit lane, the top 4 bytes of each lane are don't-care
+	const __m256i pack24 = _mm256_setr_epi8(
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+	__m256i s = dither ? _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dither->state)) : _mm256_setzero_si256();
+
+	// the int24 stores write 4 bytes past the 24 they fill, so that path stops one iteration early
+	const size_t end = (f == SAMPLE_FORMAT_INT24) ? (n >= 2 ? n - 2 : 0) : n;
+
+	size_t i = 0;
+	for (; i + 8 <= end; i += 8) {
+		__m256 a = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(in + i), m1), p1);
+
+		if (f == SAMPLE_FORMAT_FLOAT32) {
+			_mm256_storeu_ps(reinterpret_cast<float*>(o + 4 * i), a);
+			continue;
+		}
+
+		a = _mm256_mul_ps(a, scale);
+
+		if (dither) {
+			s = _mm256_xor_si256(s, _mm256_slli_epi32(s, 13));
+			s = _mm256_xor_si256(s, _mm256_srli_epi32(s, 17));
+			s = _mm256_xor_si256(s, _mm256_slli_epi32(s, 5));
+			const __m256 u1 = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(s, low16)), k);
+			const __m256 u2 = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(s, 16)), k);
+			a = _mm256_add_ps(a, _mm256_sub_ps(u1, u2));
+		}
+
+		const __m256i ia = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(a, lo), hi));
+
+		switch (f) {
+		case SAMPLE_FORMAT_INT16:
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(o + 2 * i),
+				_mm_packs_epi32(_mm256_castsi256_si128(ia), _mm256_extracti128_si256(ia, 1)));
+			break;
+		case SAMPLE_FORMAT_INT24: {
+			const __m256i p = _mm256_shuffle_epi8(ia, pack24);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(o + 3 * i), _mm256_castsi256_si128(p));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(o + 3 * i + 12), _mm256_extracti128_si256(p, 1));
+			break;
+		}
+		default:
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(o + 4 * i), ia);
+			break;
+		}
+	}
+
+	if (dither) {
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dither->state), s);
+	}
+
+	convert_range_scalar(in, out, i, n, f, dither);
+}
+
+void convert_samples_to_float(const void *in, float *out, size_t num_frames, int num_channels, int channel, sample_format_t f) {
+	const size_t bytes = sample_format_bytes(f), stride = bytes * num_channels;
+	const uint8_t *p = static_cast<const uint8_t*>(in) + bytes * channel;
+	const float inv_scale = 1.0f / format_limits(f).scale;
+
+	for (size_t i = 0; i < num_frames; ++i, p += stride) {
+		switch (f) {
+		case SAMPLE_FORMAT_INT16: {
+			int16_t v;
+			memcpy(&v, p, sizeof(v));
+			out[i] = v * inv_scale;
+			break;
+		}
+		case SAMPLE_FORMAT_INT24: {
+			// sign-extend through the top of an int32
+			const int32_t v = (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24) >> 8;
+			out[i] = v * inv_scale;
+			break;
+		}
+		case SAMPLE_FORMAT_INT32: {
+			int32_t v;
+			memcpy(&v, p, sizeof(v));
+			out[i] = v * inv_scale;
+			break;
+		}
+		default:
+			memcpy(&out[i], p, sizeof(float));
+			break;
+		}
+	}
+}
+
+typedef void(*convert_kernel_t)(const float*, void*, size_t, sample_format_t, dither_t*);
+
+struct convert_kernel_entry_t {
+	const char *name;
+	convert_kernel_t kernel;
+};
+
+static const convert_kernel_entry_t convert_kernels[] = {
+	{ "scalar", convert_samples_scalar },
+	{ "sse2", convert_samples_sse2 },
+	{ "avx2", convert_samples_avx2 },
+};
+
+static simd_kernel_dispatch<convert_kernel_entry_t> convert_dispatch(convert_kernels, "convert_samples_set_kernel");
+
+int convert_samples_set_kernel(const char *name) {
+	return convert_dispatch.set(name);
+}
+
+const char *convert_samples_kernel_name() {
+	return convert_dispatch.get().name;
+}
+
+void convert_samples(const float *in, void *out, size_t n, sample_format_t f, dither_t *dither) {
+	convert_dispatch.get().kernel(in, out, n, f, dither);
+}
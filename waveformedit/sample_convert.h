@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "audio_backend.h"
+
+// float [-1, 1] -> device sample conversion. Everything saturates: out-of-range input (and NaN, which goes
+// to -1) is clamped instead of wrapping around. Integer formats round to nearest.
+//
+// Optional TPDF dither adds the difference of two uniform random numbers, +-1 LSB triangular, before
+// rounding. The generator is eight xorshift32 lanes, sample i drawing from lane i % 8, so the scalar,
+// SSE2 and AVX2 kernels produce the same bits for the same seed.
+
+enum sample_format_t {
+	SAMPLE_FORMAT_INT16,
+	SAMPLE_FORMAT_INT24, // packed, 3 bytes little-endian
+	SAMPLE_FORMAT_INT32,
+	SAMPLE_FORMAT_FLOAT32,
+};
+
+struct dither_t {
+	uint32_t state[8];
+
+	dither_t() { seed(0x9E3779B9u); }
+	void seed(uint32_t s);
+};
+
+// 0 if the format isn't one of the above
+int sample_format_from_wave_format(const wave_format_t &fmt, sample_format_t *out);
+// sets bit_depth and is_float
+void sample_format_to_wave_format(sample_format_t f, wave_format_t *fmt);
+// "s16", "s24", "s32" or "f32", as given to --format. 0 if it's none of them
+int sample_format_from_name(const char *name, sample_format_t *out);
+size_t sample_format_bytes(sample_format_t f);
+const char *sample_format_name(sample_format_t f);
+
+// dither is worth it when the quantization step is audible, i.e. below 32 bits
+inline bool sample_format_wants_dither(sample_format_t f) { return f == SAMPLE_FORMAT_INT16 || f == SAMPLE_FORMAT_INT24; }
+
+// out[i*num_channels + c] = mono[i] for every channel c: the one place a mono signal becomes interleaved frames
+void expand_channels(const float *mono, float *out, size_t num_frames, int num_channels);
+
+// converts n samples (not frames). dither NULL = no dither.
+void convert_samples(const float *in, void *out, size_t n, sample_format_t f, dither_t *dither);
+
+void convert_samples_scalar(const float *in, void *out, size_t n, sample_format_t f, dither_t *dither);
+void convert_samples_sse2(const float *in, void *out, size_t n, sample_format_t f, dither_t *dither);
+void convert_samples_avx2(const float *in, void *out, size_t n, sample_format_t f, dither_t *dither);
+
+// the way back, for reading what was sent: one channel of num_frames interleaved frames in format f to float.
+// Integers are divided by the scale convert_samples multiplied with, so a conversion round-trips to within
+// its quantization (and dither) step. Not speed critical, scalar only.
+void convert_samples_to_float(const void *in, float *out, size_t num_frames, int num_channels, int channel, sample_format_t f);
+
+// forces a kernel ("scalar", "sse2" or "avx2"), NULL or "" goes back to the widest one the CPU supports
+int convert_samples_set_kernel(const char *name);
+const char *convert_samples_kernel_name();
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Immutable, reference-counted snapshots published by one producer to any number of consumers (RCU-style).
+//
+// The producer fills a free slot (begin_write) and publish()es it, which atomically makes it the current
+// snapshot. Consumers acquire() the current snapshot and hold on to it for as long as they like: a held
+// slot is never rewritten, so what they see stays consistent even while the producer moves on. Nobody
+// blocks. A consumer's acquire retries only if a publish slips in between reading the current index and
+// taking its reference. If every slot is held, begin_write returns NULL and the producer tries again later.
+//
+// The slots are reused, so publishing a T that owns memory (e.g. vectors) stops allocating once their
+// capacity has settled. N should be at least the number of consumers + 2.
+
+template <typename T, int N>
+class snapshot_pool {
+
+	struct slot_t {
+		T value;
+		uint64_t version;
+		std::atomic<int> refs;
+		slot_t() : version(0), refs(0) {}
+	};
+
+	mutable slot_t slots[N];
+	std::atomic<int> current; // -1 until the first publish
+	std::atomic<uint64_t> published_version; // of the current snapshot, for version() (slots[current] can be recycled under it)
+	int writing; // owned by the producer
+	uint64_t last_version; // owned by the producer
+
+public:
+	class ref {
+		friend class snapshot_pool;
+		slot_t *slot;
+		explicit ref(slot_t *s) : slot(s) {}
+
+		ref(const ref&);
+		ref &operator=(const ref&);
+	public:
+		ref() : slot(NULL) {}
+		ref(ref &&r) : slot(r.slot) { r.slot = NULL; }
+		ref &operator=(ref &&r) { if (this != &r) { reset(); slot = r.slot; r.slot = NULL; } return *this; }
+		~ref() { reset(); }
+
+		void reset() {
+			if (slot) slot->refs.fetch_sub(1, std::memory_order_release);
+			slot = NULL;
+		}
+
+		explicit operator bool() const { return slot != NULL; }
+		const T &operator*() const { return slot->value; }
+		const T *operator->() const { return &slot->value; }
+		uint64_t version() const { return slot ? slot->version : 0; }
+	};
+
+	snapshot_pool() : current(-1), published_version(0), writing(-1), last_version(0) {}
+
+	// producer side. The returned slot still holds whatever it was last published with.
+	T *begin_write() {
+		const int cur = current.load(std::memory_order_relaxed);
+		for (int i = 0; i < N; ++i) {
+			// seq_cst pairs with the consumers' increment-then-recheck in acquire()
+			if (i != cur && slots[i].refs.load(std::memory_order_seq_cst) == 0) {
+				writing = i;
+				return &slots[i].value;
+			}
+		}
+		return NULL;
+	}
+
+	uint64_t publish() {
+		slots[writing].version = ++last_version;
+		current.store(writing, std::memory_order_seq_cst);
+		published_version.store(last_version, std::memory_order_release);
+		writing = -1;
+		return last_version;
+	}
+
+	// consumer side, any thread. Empty until the first publish.
+	ref acquire() const {
+		for (;;) {
+			const int i = current.load(std::memory_order_seq_cst);
+			if (i < 0) return ref();
+
+			slots[i].refs.fetch_add(1, std::memory_order_seq_cst);
+			// still current after taking the reference: the producer can't pick the slot anymore
+			if (current.load(std::memory_order_seq_cst) == i) return ref(&slots[i]);
+			slots[i].refs.fetch_sub(1, std::memory_order_release);
+		}
+	}
+
+	// the version of the current snapshot, 0 before the first publish. cheap, for "has anything changed" polling
+	uint64_t version() const {
+		return published_version.load(std::memory_order_acquire);
+	}
+};
@@ -1,48 +1,59 @@
 #include "sound.h"
 
-#include <Audioclient.h>
-#include <audiopolicy.h>
-#include <mmdeviceapi.h>
-#include <ksmedia.h>
 #include <stdio.h>
+#include <cstring>
 #include <cmath>
-#include <limits>
-#include <mutex>
+#include <vector>
+#include <algorithm>
 
-#include <Avrt.h>
+#include <atomic>
 
-#include "wfedit.h"
-
-// REFERENCE_TIME time units per second and per millisecond
-#define REFTIMES_PER_SEC  10000000.0
-#define REFTIMES_PER_MILLISEC  10000.0
-
-#define IF_ERROR_EXIT(hr) do {\
-		if (FAILED(hr)){\
-			printf("sound.cpp:%d: WASAPI code error %lX\n", __LINE__, hr);\
-			goto exit_err;\
-		}\
-} while(0)
-
-#define SAFE_RELEASE(punk)  \
-              if ((punk) != NULL)  \
-                { (punk)->Release(); (punk) = NULL; }
-
-const CLSID CLSID_MMDeviceEnumerator = __uuidof(MMDeviceEnumerator);
-const IID IID_IMMDeviceEnumerator = __uuidof(IMMDeviceEnumerator);
-const IID IID_IAudioClient = __uuidof(IAudioClient);
-const IID IID_IAudioRenderClient = __uuidof(IAudioRenderClient);
-
-#define SMPL_TYPE short
+#include "triple_buffer.h"
+#include "spsc_ring.h"
+#include "wavetable.h"
+#include "oscillator.h"
+#include "block_adapter.h"
+#include "sample_convert.h"
 
 static wave_format_t wformat;
-static UINT32 frame_size;
+static sample_format_t sample_format; // wformat as a convert_samples format
+static uint32_t frame_size; // the device period
+static uint32_t block_size; // the synthesis block, see block_adapter.h
+static uint32_t cycle_length; // the rasterized cycle, independent of both
 static int sound_system_initialized = 0;
 
-static SMPL_TYPE *main_buffer = NULL;
-static std::mutex main_buffer_lock;
-
-UINT32 SND_get_frame_size() {
+static AudioBackend *backend = NULL;
+
+// the mip-mapped cycle as handed to the audio thread
+struct wavetable_levels_t {
+	uint32_t size;
+	int num_levels;
+	std::vector<float> tables;
+};
+
+// the render thread publishes a new wavetable per edit here, the audio thread picks up the newest one without ever blocking
+static triple_buffer<wavetable_levels_t> cycle_tables;
+static wavetable_t wavetable; // only touched by the render thread
+
+// voice parameters as set by SND_note_on/off. gain 0 = free. voice_serial is bumped after every change so the
+// audio thread only rescans them when something happened.
+static std::atomic<float> voice_freq[OSC_MAX_VOICES], voice_gain[OSC_MAX_VOICES];
+static std::atomic<uint32_t> voice_serial(0);
+
+// only touched by the audio thread
+static oscillator_bank_t oscillator;
+static uint32_t voice_serial_seen = 0;
+static std::vector<float> mix_buffer;
+static block_adapter_t adapter;
+static dither_t dither;
+static bool use_dither;
+
+// the converted periods, as sent, for SND_read_output_tap. pushed by the audio thread, popped by one reader
+static spsc_ring<uint8_t> output_tap;
+static bool tap_enabled = false;
+static std::vector<uint8_t> tap_scratch; // only touched by the reader
+
+uint32_t SND_get_frame_size() {
 	return frame_size;
 }
 
@@ -54,218 +65,205 @@ int SND_initialized() {
 	return sound_system_initialized;
 }
 
-size_t SND_write_to_buffer(const float *data) {
-	// data should contain 2*frame_size worth of floats normalized to [-1;1]
-	constexpr float max = (std::numeric_limits<short>::max)();
-	
-	main_buffer_lock.lock();
-
-	for (int i = 0; i < frame_size; ++i) {
-		SMPL_TYPE vl = (SMPL_TYPE)(max*data[2*i]);
-		SMPL_TYPE vr = (SMPL_TYPE)(max*data[2*i + 1]);
-		
-		main_buffer[2*i] = vl;
-		main_buffer[2*i + 1] = vr;
-	}
-	main_buffer_lock.unlock();
+size_t SND_read_output_tap(float *out, size_t max_frames) {
+	if (!tap_enabled || max_frames == 0) return 0; // nothing to pop into, and &tap_scratch[0] would be out of range
 
-	return 1;
+	const size_t frame_bytes = wformat.num_channels * sample_format_bytes(sample_format);
+	tap_scratch.resize(max_frames * frame_bytes);
+
+	// the audio thread only pushes whole frames, so this pops whole frames too
+	const size_t num_frames = output_tap.pop(&tap_scratch[0], max_frames * frame_bytes) / frame_bytes;
+	convert_samples_to_float(&tap_scratch[0], out, num_frames, wformat.num_channels, 0, sample_format);
+	return num_frames;
 }
 
+uint64_t SND_output_tap_dropped() {
+	return output_tap.num_dropped();
+}
 
-static int construct_wave_format_info(int samplerate, int nchannels, int bitdepth, WAVEFORMATEX *WFEX, wave_format_t *wft) {
+size_t SND_write_to_buffer(const float *data) {
+	// data should contain cycle_length floats normalized to [-1;1]
+	if (!wavetable.build(data, cycle_length)) {
+		return 0;
+	}
 
-	WFEX->wFormatTag = WAVE_FORMAT_PCM;
-	WFEX->nChannels = nchannels;
-	WFEX->nSamplesPerSec = samplerate;
-	WFEX->nAvgBytesPerSec = samplerate * 2 * bitdepth / 8;
-	WFEX->nBlockAlign = 2 * bitdepth / 8;
-	WFEX->wBitsPerSample = bitdepth;
+	wavetable_levels_t &w = cycle_tables.write_buffer();
+	w.size = wavetable.size;
+	w.num_levels = wavetable.num_levels;
+	w.tables.assign(wavetable.tables.begin(), wavetable.tables.end()); // same size every time, so no allocation after the first
 
-	wft->num_channels = nchannels;
-	wft->sample_rate = samplerate;
-	wft->bit_depth = bitdepth;
+	cycle_tables.publish();
 
 	return 1;
-
 }
 
+int SND_note_on(float freq, float gain) {
+	if (gain == 0) return -1;
 
-#define TWO_PI (3.14159265359*2)
-
-static inline float sin01(float alpha) {
-	return 0.5*sin(alpha) + 0.5;
-}
+	for (int i = 0; i < OSC_MAX_VOICES; ++i) {
+		if (voice_gain[i].load(std::memory_order_relaxed) == 0) {
+			voice_freq[i].store(freq, std::memory_order_relaxed);
+			voice_gain[i].store(gain, std::memory_order_relaxed);
+			voice_serial.fetch_add(1, std::memory_order_release);
+			return i;
+		}
+	}
 
-static inline float sin_minmax_Hz(float min, float max, float freq_Hz, float t) {
-	return (max - min) / 2.0 * sin01(t * freq_Hz * TWO_PI);
+	return -1;
 }
 
-static HRESULT find_smallest_128_aligned(IMMDevice *pDevice, IAudioClient *pAudioClient, const WAVEFORMATEX *wave_format) {
-
-	REFERENCE_TIME DefaultDevicePeriod = 0, MinimumDevicePeriod = 0;
-	HRESULT hr = pAudioClient->GetDevicePeriod(&DefaultDevicePeriod, &MinimumDevicePeriod);
+void SND_note_off(int voice) {
+	if (voice < 0 || voice >= OSC_MAX_VOICES) return;
 
-	if (FAILED(hr)) return hr;
-
-	printf("MinimumDevicePeriod: %lld, DefaultDevicePeriod: %lld\n", MinimumDevicePeriod, DefaultDevicePeriod);
-
-	// TODO: explain this? :D
-	//int n = ((int)(floorf(((float)MinimumDevicePeriod / REFTIMES_PER_SEC * wave_format->nSamplesPerSec) / 32.0) + 1)) * 32;
-	int n = 1024;
-//	n *= 3;
-
-	REFERENCE_TIME hnsPeriod = (REFERENCE_TIME)(REFTIMES_PER_SEC * (float)n / (float)wave_format->nSamplesPerSec + 0.5);
+	voice_gain[voice].store(0, std::memory_order_relaxed);
+	voice_serial.fetch_add(1, std::memory_order_release);
+}
 
-	hr = pAudioClient->Initialize(AUDCLNT_SHAREMODE_EXCLUSIVE, AUDCLNT_STREAMFLAGS_EVENTCALLBACK, hnsPeriod, hnsPeriod, wave_format, NULL);
+void SND_all_notes_off() {
+	for (auto &g : voice_gain) g.store(0, std::memory_order_relaxed);
+	voice_serial.fetch_add(1, std::memory_order_release);
+}
 
-	if (FAILED(hr)) {
-		printf("IAudioClient::Initialize(): failed to set device period to minimum 128-byte-aligned value (%lld === %.4f ms), aborting.\n", hnsPeriod, (float)hnsPeriod / 10000.0);
-		return hr;
+// renders one synthesis block. Edits and voice changes are picked up here, so they take effect on block
+// boundaries: the smaller the block, the sooner a change is heard.
+static void render_block(float *out, uint32_t num_frames, void * /*userdata*/) {
+	if (cycle_tables.has_new()) {
+		const wavetable_levels_t &w = cycle_tables.read_buffer(); // stays put until the next read_buffer
+		if (w.size) {
+			oscillator.set_table(&w.tables[0], w.size, w.num_levels);
+		}
 	}
-	else {
-		printf("IAudioClient::Initialize(): success with n = %d (period = %lld === %.4f ms)\n", n, hnsPeriod, (float)hnsPeriod / 10000.0);
-		return hr;
+
+	const uint32_t serial = voice_serial.load(std::memory_order_acquire);
+	if (serial != voice_serial_seen) {
+		voice_serial_seen = serial;
+		for (int i = 0; i < OSC_MAX_VOICES; ++i) {
+			const float f = voice_freq[i].load(std::memory_order_relaxed);
+			const float g = voice_gain[i].load(std::memory_order_relaxed);
+			if (f != oscillator.freq[i] || g != oscillator.gain[i]) {
+				oscillator.set_voice(i, f, g);
+			}
+		}
 	}
-	
+
+	oscillator.render(out, num_frames, wformat.num_channels);
 }
 
-HRESULT PlayAudioStream() {
+// the backend's pull callback. the adapter turns however many frames the device wants into synthesis blocks,
+// which are converted straight into the device buffer.
+static void pull_audio(void *dst, uint32_t num_frames, void * /*userdata*/) {
+	const int nch = wformat.num_channels;
+	const size_t frame_bytes = nch * sample_format_bytes(sample_format);
+	uint8_t *out = static_cast<uint8_t*>(dst);
 
-	HRESULT hr;
-	IMMDeviceEnumerator *pEnumerator = NULL;
-	IMMDevice *pDevice = NULL;
-	IAudioClient *pAudioClient = NULL;
-	IAudioRenderClient *pRenderClient = NULL;
-	BYTE *pData = NULL;
-	DWORD flags = 0;
-	HANDLE hEvent = NULL;
-	HANDLE hTask = NULL;
+	while (num_frames > 0) {
+		const uint32_t n = (std::min)(num_frames, frame_size);
+		adapter.pull(&mix_buffer[0], n);
 
-	WAVEFORMATEX wave_format = {};
+		convert_samples(&mix_buffer[0], out, (size_t)n * nch, sample_format, use_dither ? &dither : NULL);
 
-	hr = CoInitialize(NULL);
-	IF_ERROR_EXIT(hr);
+		if (tap_enabled) {
+			output_tap.push(out, n * frame_bytes); // dropped whole if the reader is behind
+		}
 
-	hr = CoCreateInstance(CLSID_MMDeviceEnumerator, NULL, CLSCTX_ALL, IID_IMMDeviceEnumerator, (void**)&pEnumerator);
-	IF_ERROR_EXIT(hr);
+		out += n * frame_bytes;
+		num_frames -= n;
+	}
+}
 
-	hr = pEnumerator->GetDefaultAudioEndpoint(eRender, eConsole, &pDevice);
-	IF_ERROR_EXIT(hr);
+uint32_t SND_get_block_size() {
+	return block_size;
+}
 
-	hr = pDevice->Activate(IID_IAudioClient, CLSCTX_ALL, NULL, (void**)&pAudioClient);
-	IF_ERROR_EXIT(hr);
+uint32_t SND_get_cycle_length() {
+	return cycle_length;
+}
 
-	construct_wave_format_info(48000, 2, 16, &wave_format, &wformat);
+int SND_start(const char *backend_name, const char *backend_arg, const snd_options_t *options) {
 
-	hr = pAudioClient->IsFormatSupported(AUDCLNT_SHAREMODE_EXCLUSIVE, &wave_format, NULL);
+	const snd_options_t opts = options ? *options : snd_options_t();
 
-	if (AUDCLNT_E_UNSUPPORTED_FORMAT == hr) {
-		printf("WASAPI: default audio device does not support the requested WAVEFORMATEX (%d/%dch/%d bit)\n", wave_format.nSamplesPerSec, wave_format.nChannels, wave_format.wBitsPerSample);
-		pAudioClient->Release();
-		return hr;
+	if (opts.block_frames == 0 || opts.cycle_length < 2) {
+		printf("SND_start: bad block size (%u) or cycle length (%u).\n", opts.block_frames, opts.cycle_length);
+		return 0;
 	}
 
-	IF_ERROR_EXIT(hr);
-	hr = find_smallest_128_aligned(pDevice, pAudioClient, &wave_format);
-	IF_ERROR_EXIT(hr);
-	
-	hr = pAudioClient->GetBufferSize(&frame_size);
-	IF_ERROR_EXIT(hr);
+	backend = create_audio_backend(backend_name, backend_arg);
+	if (!backend) {
+		return 0;
+	}
 
-	INT32 frame_size_bytes = frame_size * wave_format.nChannels * wave_format.wBitsPerSample / 8;
+	wave_format_t requested = {};
+	requested.num_channels = 2;
+	requested.sample_rate = 48000;
+	requested.bit_depth = opts.bit_depth;
+	requested.is_float = opts.is_float;
+
+	if (!backend->open(requested, opts.period_frames)) {
+		printf("SND_start: couldn't open audio backend \"%s\".\n", backend->name());
+		delete backend;
+		backend = NULL;
+		return 0;
+	}
 
-	hr = pAudioClient->GetService(IID_IAudioRenderClient, (void**)&pRenderClient);
-	IF_ERROR_EXIT(hr);
+	wformat = backend->get_format();
+	frame_size = backend->get_buffer_size();
 
-	hEvent = CreateEvent(nullptr, false, false, nullptr);
-	if (hEvent == INVALID_HANDLE_VALUE) { printf("CreateEvent failed\n");  return -1; }
-	
-	hr = pAudioClient->SetEventHandle(hEvent);
-	IF_ERROR_EXIT(hr);
+	if (!sample_format_from_wave_format(wformat, &sample_format)) {
+		printf("SND_start: backend \"%s\" negotiated %d-bit%s output, which isn't supported.\n", backend->name(), wformat.bit_depth, wformat.is_float ? " float" : "");
+		delete backend;
+		backend = NULL;
+		return 0;
+	}
 
+	use_dither = sample_format_wants_dither(sample_format);
 
-	const size_t num_samples = frame_size_bytes / sizeof(SMPL_TYPE);
+	block_size = opts.block_frames;
+	cycle_length = opts.cycle_length;
 
-	main_buffer = new SMPL_TYPE[num_samples];
-	memset(main_buffer, 0, sizeof(SMPL_TYPE) * num_samples);
+	cycle_tables.init(wavetable_levels_t());
+	oscillator.init(wformat.sample_rate);
+	mix_buffer.assign(frame_size * wformat.num_channels, 0);
 
-	float min = (float)(std::numeric_limits<SMPL_TYPE>::min)();
-	float max = (float)(std::numeric_limits<SMPL_TYPE>::max)();
-	float halfmax = max / 2.0;
-	float dt = 1.0 / (float)wave_format.nSamplesPerSec;
+	tap_enabled = opts.tap_frames > 0;
+	if (tap_enabled) {
+		output_tap.init((size_t)(std::max)(opts.tap_frames, frame_size) * wformat.num_channels * sample_format_bytes(sample_format));
+	}
+	adapter.init(block_size, wformat.num_channels, render_block, NULL);
 
-	float freq = 1*(float)wave_format.nSamplesPerSec / (float)frame_size;
+	float freq = 1*(float)wformat.sample_rate / (float)cycle_length;
 
 	wformat.wave_freq = freq;
 	wformat.cycle_duration_ms = 1.0 / freq * 1000.0;
-	
-//float freq = 440;
-
-	//for (int i = 0; i < num_samples/2; ++i) {
-	//	float t = (float)i * dt;
-	//	main_buffer[2*i] = sin_minmax_Hz(min, max, freq, t); // L channel
-	//	main_buffer[2*i + 1] = sin_minmax_Hz(min, max, freq, t); // R channel
-	//}
-
-	hr = pRenderClient->GetBuffer(frame_size, &pData);
-	IF_ERROR_EXIT(hr);
-
-	memcpy(pData, main_buffer, frame_size_bytes);
 
-	hr = pRenderClient->ReleaseBuffer(frame_size, flags);
-	IF_ERROR_EXIT(hr);
+	SND_all_notes_off();
+	voice_serial_seen = voice_serial.load();
+	SND_note_on(freq, 1.0f);
 
-	printf("frame_size: %d, frame_size_bytes: %d\n", frame_size, frame_size_bytes);
+	printf("SND_start: backend %s, format %s (%s), frame_size: %u, frame_size_bytes: %u, block_size: %u, cycle_length: %u\n", backend->name(),
+		sample_format_name(sample_format), convert_samples_kernel_name(), frame_size,
+		(uint32_t)(frame_size * wformat.num_channels * sample_format_bytes(sample_format)), block_size, cycle_length);
 
-	// increase thread priority for optimal av performance
-	DWORD taskIndex = 0;
-	hTask = AvSetMmThreadCharacteristics(TEXT("Pro Audio"), &taskIndex);
-	if (hTask == NULL) {
-		hr = E_FAIL;
-		IF_ERROR_EXIT(hr);
+	if (!backend->start(pull_audio, NULL)) {
+		printf("SND_start: couldn't start audio backend \"%s\".\n", backend->name());
+		delete backend;
+		backend = NULL;
+		return 0;
 	}
 
 	sound_system_initialized = 1;
 
-	hr = pAudioClient->Start();  // Start playing.
-	IF_ERROR_EXIT(hr);
-
-	while (wfedit_running()) {
-
-		WaitForSingleObject(hEvent, INFINITE);
-
-		hr = pRenderClient->GetBuffer(frame_size, &pData);
-		IF_ERROR_EXIT(hr);
-
-		main_buffer_lock.lock();
-		memcpy(pData, main_buffer, frame_size_bytes);
-		main_buffer_lock.unlock();
-
-		hr = pRenderClient->ReleaseBuffer(frame_size, 0);
-		IF_ERROR_EXIT(hr);
-	}
-
+	return 1;
+}
 
-	hr = pAudioClient->Stop();  // Stop playing.
-	IF_ERROR_EXIT(hr);
+void SND_stop() {
+	if (!backend) return;
 
-exit_err:
+	backend->stop();
+	delete backend;
+	backend = NULL;
 
-	SAFE_RELEASE(pEnumerator)
-	SAFE_RELEASE(pDevice)
-	SAFE_RELEASE(pAudioClient)
-	SAFE_RELEASE(pRenderClient)
+	sound_system_initialized = 0;
 
-	if (hEvent != NULL) {
-		CloseHandle(hEvent);
-	}
-	
-	if (hTask != NULL) {
-		AvRevertMmThreadCharacteristics(hTask);
-	}
-	
 	printf("Exiting sound system...\n");
-
-	return hr;
 }
@@ -1,20 +1,57 @@
 #pragma once
 
-#include <Windows.h>
+#include <cstdint>
+#include <cstddef>
 
-#pragma comment(lib, "Avrt.lib")
+#include "audio_backend.h"
 
-HRESULT PlayAudioStream();
+#define SND_DEFAULT_PERIOD 1024 // frames
+#define SND_DEFAULT_BLOCK 64 // frames
+#define SND_DEFAULT_CYCLE_LENGTH 1024 // frames
 
-struct wave_format_t {
-	int num_channels;
-	int sample_rate;
+// The three sizes in the audio path, none of which has to divide another:
+//   period_frames  what we ask the device for. the backend may negotiate something else, see SND_get_frame_size
+//   block_frames   what the synthesis renders at a time. changes (edits, notes) are heard at block granularity
+//   cycle_length   the resolution the curve is rasterized at. the cycle plays back sample for sample at rate/cycle_length Hz
+struct snd_options_t {
+	uint32_t period_frames;
+	uint32_t block_frames;
+	uint32_t cycle_length;
+
+	// requested device sample format: 16/24/32-bit integer or 32-bit float. the backend may negotiate another one,
+	// anything sample_convert.h handles is accepted
 	int bit_depth;
-	float wave_freq;
-	float cycle_duration_ms;
+	int is_float;
+
+	// room for this many frames in the output tap (see SND_read_output_tap), 0 = no tap
+	uint32_t tap_frames;
+
+	snd_options_t() : period_frames(SND_DEFAULT_PERIOD), block_frames(SND_DEFAULT_BLOCK), cycle_length(SND_DEFAULT_CYCLE_LENGTH),
+		bit_depth(16), is_float(0), tap_frames(0) {}
 };
 
-UINT32 SND_get_frame_size();
+// Opens and starts the named audio backend (see create_audio_backend). Non-blocking, the backend runs on its own thread.
+int SND_start(const char *backend_name, const char *backend_arg = NULL, const snd_options_t *options = NULL);
+void SND_stop();
+
+uint32_t SND_get_frame_size(); // the device period
+uint32_t SND_get_block_size();
+uint32_t SND_get_cycle_length();
 wave_format_t SND_get_format_info();
 int SND_initialized();
+
+// The output tap: every period pull_audio sent to the device, after conversion, for analysis on another thread
+// (see stft.h). Reads up to max_frames of channel 0, decoded back to float. One reader only; when it falls
+// behind, the audio thread drops whole periods instead of waiting, counted by SND_output_tap_dropped.
+size_t SND_read_output_tap(float *out, size_t max_frames);
+uint64_t SND_output_tap_dropped();
+// Hands a freshly rasterized cycle (cycle_length mono samples) to the audio thread. The cycle is
+// mip-mapped into a band-limited wavetable here, on the caller's thread, and played by the voices below.
 size_t SND_write_to_buffer(const float *data);
+
+// Voices playing the cycle (see oscillator.h). SND_start starts one voice at wave_freq, the pitch at which the
+// cycle plays back sample for sample. Call these from one thread only, the audio thread picks changes up
+// at its next period.
+int SND_note_on(float freq, float gain); // returns a voice id, or -1 if all OSC_MAX_VOICES are playing
+void SND_note_off(int voice);
+void SND_all_notes_off();
@@ -0,0 +1,401 @@
+#define _CRT_SECURE_NO_WARNINGS // strncpy
+
+#include "spectrum.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include <xmmintrin.h>
+#include <immintrin.h>
+
+#include "fft_util.h"
+#include "curve_simd.h" // TARGET_AVX2, simd_kernel_dispatch
+
+// TARGET_AVX2 without the FMA: keeps gcc from fusing the mul/adds, which would change the bits
+#ifdef _MSC_VER
+#define TARGET_AVX2_NO_FMA
+#else
+#define TARGET_AVX2_NO_FMA __attribute__((target("avx2")))
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static const struct { const char *name; spectrum_window_t window; } windows[] = {
+	{ "rect", SPECTRUM_WINDOW_RECT },
+	{ "hann", SPECTRUM_WINDOW_HANN },
+	{ "blackman-harris", SPECTRUM_WINDOW_BLACKMAN_HARRIS },
+	{ "kaiser", SPECTRUM_WINDOW_KAISER },
+};
+
+int spectrum_window_from_name(const char *name, spectrum_window_t *out, float *kaiser_beta) {
+	char base[32];
+	strncpy(base, name, sizeof(base) - 1);
+	base[sizeof(base) - 1] = '\0';
+
+	// kaiser:beta
+	char *colon = strchr(base, ':');
+	if (colon) { *colon = '\0'; }
+
+	for (const auto &w : windows) {
+		if (strcmp(w.name, base) != 0) continue;
+
+		if (colon) {
+			const float beta = (float)atof(colon + 1);
+			if (w.window != SPECTRUM_WINDOW_KAISER || !(beta >= 0)) {
+				printf("spectrum_window_from_name: bad window parameter in \"%s\".\n", name);
+				return 0;
+			}
+			*kaiser_beta = beta;
+		}
+		*out = w.window;
+		return 1;
+	}
+
+	printf("spectrum_window_from_name: unknown window \"%s\" (rect, hann, blackman-harris or kaiser[:beta]).\n", name);
+	return 0;
+}
+
+const char *spectrum_window_name(spectrum_window_t w) {
+	for (const auto &e : windows) {
+		if (e.window == w) return e.name;
+	}
+	return "?";
+}
+
+// zeroth order modified Bessel function of the first kind, by its power series. converges for any x, in
+// about x terms
+static double bessel_i0(double x) {
+	double sum = 1, term = 1;
+	const double q = 0.25 * x * x;
+	for (int k = 1; k < 500; ++k) {
+		term *= q / ((double)k * k);
+		sum += term;
+		if (term < 1e-17 * sum) break;
+	}
+	return sum;
+}
+
+void spectrum_fill_window(float *w, uint32_t n, spectrum_window_t type, float kaiser_beta) {
+	const double step = 2 * M_PI / n;
+	const double i0_beta = bessel_i0(kaiser_beta);
+
+	for (uint32_t i = 0; i < n; ++i) {
+		const double x = step * i;
+		double v = 1;
+		switch (type) {
+		case SPECTRUM_WINDOW_HANN:
+			v = 0.5 - 0.5 * cos(x);
+			break;
+		case SPECTRUM_WINDOW_BLACKMAN_HARRIS:
+			v = 0.35875 - 0.48829 * cos(x) + 0.14128 * cos(2 * x) - 0.01168 * cos(3 * x);
+			break;
+		case SPECTRUM_WINDOW_KAISER: {
+			const double r = 2.0 * i / n - 1.0;
+			v = bessel_i0(kaiser_beta * sqrt(1.0 - r * r)) / i0_beta;
+			break;
+		}
+		default:
+			break;
+		}
+		w[i] = (float)v;
+	}
+}
+
+int spectrum_parse_sizes(const char *list, spectrum_config_t *config) {
+	char buf[256];
+	strncpy(buf, list, sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = '\0';
+
+	spectrum_config_t c = *config;
+	c.num_sizes = 0;
+
+	for (char *tok = strtok(buf, ","); tok; tok = strtok(NULL, ",")) {
+		const unsigned long n = strtoul(tok, NULL, 10);
+		if (n < SPECTRUM_MIN_SIZE || n > SPECTRUM_MAX_SIZE || n % 2 != 0) {
+			printf("spectrum_parse_sizes: FFT size \"%s\" should be even and within [%d, %d].\n", tok, SPECTRUM_MIN_SIZE, SPECTRUM_MAX_SIZE);
+			return 0;
+		}
+		if (c.num_sizes == SPECTRUM_MAX_RESOLUTIONS) {
+			printf("spectrum_parse_sizes: at most %d sizes.\n", SPECTRUM_MAX_RESOLUTIONS);
+			return 0;
+		}
+		c.sizes[c.num_sizes++] = (uint32_t)n;
+	}
+
+	if (c.num_sizes == 0) {
+		printf("spectrum_parse_sizes: no sizes in \"%s\".\n", list);
+		return 0;
+	}
+
+	*config = c;
+	return 1;
+}
+
+spectrum_analyzer_t::spectrum_analyzer_t()
+	: size(0), window_type(SPECTRUM_WINDOW_RECT), kaiser_beta(SPECTRUM_DEFAULT_KAISER_BETA), floor_dB(SPECTRUM_DEFAULT_FLOOR_DB),
+	plan(NULL), in_buf(NULL), window(NULL), spectrum(NULL), window_sum(0) {
+
+	dB = static_cast<float*>(fftwf_malloc(SPECTRUM_MAX_SIZE / 2 * sizeof(float)));
+	memset(dB, 0, SPECTRUM_MAX_SIZE / 2 * sizeof(float));
+}
+
+spectrum_analyzer_t::~spectrum_analyzer_t() {
+	release_fft();
+	fftwf_free(dB);
+}
+
+void spectrum_analyzer_t::release_fft() {
+	if (plan) { fft_destroy_plan(plan); }
+	if (in_buf) { fftwf_free(in_buf); }
+	if (window) { fftwf_free(window); }
+	if (spectrum) { fftwf_free(spectrum); }
+
+	plan = NULL;
+	in_buf = window = NULL;
+	spectrum = NULL;
+}
+
+int spectrum_analyzer_t::configure(uint32_t a_size, spectrum_window_t a_window, float a_kaiser_beta, unsigned planner_flags) {
+
+	if (a_size < SPECTRUM_MIN_SIZE || a_size > SPECTRUM_MAX_SIZE || a_size % 2 != 0) {
+		printf("spectrum_analyzer_t::configure: bad size %u.\n", a_size);
+		return 0;
+	}
+
+	const bool resize = a_size != size || !plan;
+	const bool rewindow = resize || a_window != window_type || (a_window == SPECTRUM_WINDOW_KAISER && a_kaiser_beta != kaiser_beta);
+
+	if (resize) {
+		release_fft();
+		size = a_size;
+
+		in_buf = static_cast<float*>(fftwf_malloc(size * sizeof(float)));
+		window = static_cast<float*>(fftwf_malloc(size * sizeof(float)));
+		spectrum = static_cast<fftwf_complex*>(fftwf_malloc((size / 2 + 1) * sizeof(fftwf_complex)));
+
+		// MEASURE/PATIENT scribble over in_buf while planning, which is fine since nothing's in it yet
+		plan = fft_plan_r2c(size, in_buf, spectrum, planner_flags);
+		if (!plan) {
+			printf("spectrum_analyzer_t::configure: couldn't create an FFT plan for %u.\n", size);
+			release_fft();
+			size = 0;
+			return 0;
+		}
+	}
+
+	if (rewindow) {
+		window_type = a_window;
+		kaiser_beta = a_kaiser_beta;
+		spectrum_fill_window(window, size, window_type, kaiser_beta);
+
+		double sum = 0;
+		for (uint32_t i = 0; i < size; ++i) sum += window[i];
+		window_sum = (float)sum;
+	}
+
+	return 1;
+}
+
+void spectrum_analyzer_t::analyze() {
+	if (window_type != SPECTRUM_WINDOW_RECT) {
+		spectrum_window_multiply(in_buf, window, in_buf, size);
+	}
+
+	fftwf_execute(plan);
+
+	// a sinusoid of amplitude A peaks at A * window_sum / 2
+	const float norm = 2.0f / window_sum;
+
+	spectrum_power_dB(spectrum + 1, dB, size / 2, norm * norm, floor_dB);
+}
+
+void spectrum_window_multiply_scalar(const float *in, const float *w, float *out, size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		out[i] = in[i] * w[i];
+	}
+}
+
+void spectrum_window_multiply_sse(const float *in, const float *w, float *out, size_t n) {
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(in + i), _mm_loadu_ps(w + i)));
+	}
+	spectrum_window_multiply_scalar(in + i, w + i, out + i, n - i);
+}
+
+TARGET_AVX2
+void spectrum_window_multiply_avx2(const float *in, const float *w, float *out, size_t n) {
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		const __m256 a = _mm256_mul_ps(_mm256_loadu_ps(in + i), _mm256_loadu_ps(w + i));
+		const __m256 b = _mm256_mul_ps(_mm256_loadu_ps(in + i + 8), _mm256_loadu_ps(w + i + 8));
+		_mm256_storeu_ps(out + i, a);
+		_mm256_storeu_ps(out + i + 8, b);
+	}
+	// gcc turns the call below into a jump without clearing the upper halves first, and every SSE instruction
+	// after that (FFTW, libm) pays the AVX-SSE transition penalty
+	_mm256_zeroupper();
+	spectrum_window_multiply_sse(in + i, w + i, out + i, n - i);
+}
+
+// log2(1 + x) = x * P(x) for x in [sqrt(1/2) - 1, sqrt(2) - 1[, fitted at the Chebyshev nodes
+#define LOG2_C0 1.442700386e+00f
+#define LOG2_C1 -7.211957574e-01f
+#define LOG2_C2 4.799255729e-01f
+#define LOG2_C3 -3.669257760e-01f
+#define LOG2_C4 3.168981969e-01f
+#define LOG2_C5 -2.022892684e-01f
+
+#define DB_PER_LOG2 3.010299957f // 10*log10(2)
+#define SQRT2_F 1.414213562f
+
+static float floor_power(float floor_dB) {
+	return powf(10.0f, 0.1f * (std::max)(floor_dB, SPECTRUM_MIN_FLOOR_DB));
+}
+
+// the vector kernels below do exactly these operations, in this order, so they all give the same bits
+static void power_dB_range_scalar(const fftwf_complex *bins, float *out, size_t begin, size_t end, float scale, float fp) {
+	for (size_t i = begin; i < end; ++i) {
+		float p = (bins[i][0] * bins[i][0] + bins[i][1] * bins[i][1]) * scale;
+		p = p > fp ? p : fp; // NaN fails the compare too
+
+		// p = 2^e * m, m in [1, 2[, then moved to [sqrt(1/2), sqrt(2)[ so the polynomial's range is centered on 1
+		uint32_t bits;
+		memcpy(&bits, &p, sizeof(bits));
+		float e = (float)((int32_t)(bits >> 23) - 127);
+		bits = (bits & 0x007FFFFF) | 0x3F800000;
+		float m;
+		memcpy(&m, &bits, sizeof(m));
+		if (m > SQRT2_F) { m = m * 0.5f; e = e + 1.0f; }
+
+		const float x = m - 1.0f;
+		float q = LOG2_C5;
+		q = q * x + LOG2_C4;
+		q = q * x + LOG2_C3;
+		q = q * x + LOG2_C2;
+		q = q * x + LOG2_C1;
+		q = q * x + LOG2_C0;
+
+		out[i] = (e + q * x) * DB_PER_LOG2;
+	}
+}
+
+void spectrum_power_dB_scalar(const fftwf_complex *bins, float *out, size_t n, float scale, float floor_dB) {
+	power_dB_range_scalar(bins, out, 0, n, scale, floor_power(floor_dB));
+}
+
+static inline __m128 log2_dB_sse(__m128 p) {
+	const __m128i bits = _mm_castps_si128(p);
+	__m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+	__m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF)), _mm_set1_epi32(0x3F800000)));
+
+	const __m128 big = _mm_cmpgt_ps(m, _mm_set1_ps(SQRT2_F));
+	m = _mm_or_ps(_mm_and_ps(big, _mm_mul_ps(m, _mm_set1_ps(0.5f))), _mm_andnot_ps(big, m));
+	e = _mm_add_ps(e, _mm_and_ps(big, _mm_set1_ps(1.0f)));
+
+	const __m128 x = _mm_sub_ps(m, _mm_set1_ps(1.0f));
+	__m128 q = _mm_set1_ps(LOG2_C5);
+	q = _mm_add_ps(_mm_mul_ps(q, x), _mm_set1_ps(LOG2_C4));
+	q = _mm_add_ps(_mm_mul_ps(q, x), _mm_set1_ps(LOG2_C3));
+	q = _mm_add_ps(_mm_mul_ps(q, x), _mm_set1_ps(LOG2_C2));
+	q = _mm_add_ps(_mm_mul_ps(q, x), _mm_set1_ps(LOG2_C1));
+	q = _mm_add_ps(_mm_mul_ps(q, x), _mm_set1_ps(LOG2_C0));
+
+	return _mm_mul_ps(_mm_add_ps(e, _mm_mul_ps(q, x)), _mm_set1_ps(DB_PER_LOG2));
+}
+
+void spectrum_power_dB_sse(const fftwf_complex *bins, float *out, size_t n, float scale, float floor_dB) {
+	const float fp = floor_power(floor_dB);
+	const __m128 vscale = _mm_set1_ps(scale), vfloor = _mm_set1_ps(fp);
+	const float *b = &bins[0][0];
+
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		const __m128 v0 = _mm_loadu_ps(b + 2 * i), v1 = _mm_loadu_ps(b + 2 * i + 4);
+		const __m128 re = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(2, 0, 2, 0));
+		const __m128 im = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(3, 1, 3, 1));
+		__m128 p = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(re, re), _mm_mul_ps(im, im)), vscale);
+		p = _mm_max_ps(p, vfloor); // the second operand if either is NaN
+
+		_mm_storeu_ps(out + i, log2_dB_sse(p));
+	}
+
+	power_dB_range_scalar(bins, out, i, n, scale, fp);
+}
+
+TARGET_AVX2_NO_FMA
+void spectrum_power_dB_avx2(const fftwf_complex *bins, float *out, size_t n, float scale, float floor_dB) {
+	const float fp = floor_power(floor_dB);
+	const __m256 vscale = _mm256_set1_ps(scale), vfloor = _mm256_set1_ps(fp);
+	const float *b = &bins[0][0];
+
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		// the in-lane shuffles leave the bins in the order 0 1 4 5 2 3 6 7, put right once the power is done
+		const __m256 v0 = _mm256_loadu_ps(b + 2 * i), v1 = _mm256_loadu_ps(b + 2 * i + 8);
+		const __m256 re = _mm256_shuffle_ps(v0, v1, _MM_SHUFFLE(2, 0, 2, 0));
+		const __m256 im = _mm256_shuffle_ps(v0, v1, _MM_SHUFFLE(3, 1, 3, 1));
+		__m256 p = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(re, re), _mm256_mul_ps(im, im)), vscale);
+		p = _mm256_max_ps(p, vfloor);
+		p = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(p), _MM_SHUFFLE(3, 1, 2, 0)));
+
+		const __m256i bits = _mm256_castps_si256(p);
+		__m256 e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127)));
+		__m256 m = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF)), _mm256_set1_epi32(0x3F800000)));
+
+		const __m256 big = _mm256_cmp_ps(m, _mm256_set1_ps(SQRT2_F), _CMP_GT_OQ);
+		m = _mm256_blendv_ps(m, _mm256_mul_ps(m, _mm256_set1_ps(0.5f)), big);
+		e = _mm256_add_ps(e, _mm256_and_ps(big, _mm256_set1_ps(1.0f)));
+
+		const __m256 x = _mm256_sub_ps(m, _mm256_set1_ps(1.0f));
+		__m256 q = _mm256_set1_ps(LOG2_C5);
+		q = _mm256_add_ps(_mm256_mul_ps(q, x), _mm256_set1_ps(LOG2_C4));
+		q = _mm256_add_ps(_mm256_mul_ps(q, x), _mm256_set1_ps(LOG2_C3));
+		q = _mm256_add_ps(_mm256_mul_ps(q, x), _mm256_set1_ps(LOG2_C2));
+		q = _mm256_add_ps(_mm256_mul_ps(q, x), _mm256_set1_ps(LOG2_C1));
+		q = _mm256_add_ps(_mm256_mul_ps(q, x), _mm256_set1_ps(LOG2_C0));
+
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_add_ps(e, _mm256_mul_ps(q, x)), _mm256_set1_ps(DB_PER_LOG2)));
+	}
+
+	_mm256_zeroupper(); // see spectrum_window_multiply_avx2
+	power_dB_range_scalar(bins, out, i, n, scale, fp);
+}
+
+typedef void(*window_kernel_t)(const float*, const float*, float*, size_t);
+typedef void(*power_dB_kernel_t)(const fftwf_complex*, float*, size_t, float, float);
+
+struct spectrum_kernel_entry_t {
+	const char *name;
+	window_kernel_t window;
+	power_dB_kernel_t power_dB;
+};
+
+static const spectrum_kernel_entry_t spectrum_kernels[] = {
+	{ "scalar", spectrum_window_multiply_scalar, spectrum_power_dB_scalar },
+	{ "sse", spectrum_window_multiply_sse, spectrum_power_dB_sse },
+	{ "avx2", spectrum_window_multiply_avx2, spectrum_power_dB_avx2 },
+};
+
+static simd_kernel_dispatch<spectrum_kernel_entry_t> spectrum_dispatch(spectrum_kernels, "spectrum_set_kernel");
+
+int spectrum_set_kernel(const char *name) {
+	return spectrum_dispatch.set(name);
+}
+
+const char *spectrum_kernel_name() {
+	return spectrum_dispatch.get().name;
+}
+
+void spectrum_window_multiply(const float *in, const float *w, float *out, size_t n) {
+	spectrum_dispatch.get().window(in, w, out, n);
+}
+
+void spectrum_power_dB(const fftwf_complex *bins, float *out, size_t n, float scale, float floor_dB) {
+	spectrum_dispatch.get().power_dB(bins, out, n, scale, floor_dB);
+}
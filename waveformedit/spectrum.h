@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "fftw3.h"
+
+// The editor's spectrum analyzer: window, r2c FFT and dB magnitude of one block of samples, at a size and
+// window chosen at runtime.
+//
+// The window is tabulated once per (size, window) and applied with a SIMD multiply. Its coherent gain is
+// divided out, so a sinusoid reads the same level whatever the window. For the cycle view the input is exactly
+// one period, every harmonic falls on a bin and the rectangular window is exact; the others trade that for
+// lower leakage when the input isn't periodic in the block.
+//
+// The magnitudes go to dB as 10*log10(re^2 + im^2) straight from the power, without a sqrt, through a
+// polynomial log2 (see spectrum_power_dB): within 1e-4 dB of the exact value, and never below the floor,
+// so silent bins read as the floor instead of -inf.
+
+#define SPECTRUM_MIN_SIZE 256
+#define SPECTRUM_MAX_SIZE 65536
+#define SPECTRUM_MAX_RESOLUTIONS 4 // sizes analyzed from the same input in one pass
+#define SPECTRUM_DEFAULT_SIZE 3072
+#define SPECTRUM_DEFAULT_KAISER_BETA 8.6f // sidelobes around -90 dB
+#define SPECTRUM_DEFAULT_FLOOR_DB -140.0f // the bottom of the spectrum view
+#define SPECTRUM_MIN_FLOOR_DB -370.0f // about the smallest normal float as a power
+
+enum spectrum_window_t {
+	SPECTRUM_WINDOW_RECT,
+	SPECTRUM_WINDOW_HANN,
+	SPECTRUM_WINDOW_BLACKMAN_HARRIS, // 4-term, -92 dB sidelobes
+	SPECTRUM_WINDOW_KAISER,
+};
+
+// "rect", "hann", "blackman-harris" or "kaiser[:beta]". 0 if it's none of them
+int spectrum_window_from_name(const char *name, spectrum_window_t *out, float *kaiser_beta);
+const char *spectrum_window_name(spectrum_window_t w);
+
+// the periodic (DFT-even) form, w[0 .. n[
+void spectrum_fill_window(float *w, uint32_t n, spectrum_window_t type, float kaiser_beta);
+
+struct spectrum_config_t {
+	uint32_t sizes[SPECTRUM_MAX_RESOLUTIONS]; // sizes[0] is the one on screen, the rest are computed alongside it for zoomed views
+	int num_sizes;
+	spectrum_window_t window;
+	float kaiser_beta;
+	float floor_dB;
+
+	spectrum_config_t() : num_sizes(1), window(SPECTRUM_WINDOW_RECT), kaiser_beta(SPECTRUM_DEFAULT_KAISER_BETA), floor_dB(SPECTRUM_DEFAULT_FLOOR_DB) {
+		for (int i = 0; i < SPECTRUM_MAX_RESOLUTIONS; ++i) sizes[i] = SPECTRUM_DEFAULT_SIZE;
+	}
+};
+
+// "4096" or "1024,4096,16384". Every size must be even and within [SPECTRUM_MIN_SIZE, SPECTRUM_MAX_SIZE]
+int spectrum_parse_sizes(const char *list, spectrum_config_t *config);
+
+struct spectrum_analyzer_t {
+	uint32_t size; // 0 until configured
+	spectrum_window_t window_type;
+	float kaiser_beta;
+	float floor_dB; // bins below it read as it, clamped to SPECTRUM_MIN_FLOOR_DB
+
+	// bins 1 .. size/2 in dB re. a full-scale sinusoid (DC is left out). Allocated for SPECTRUM_MAX_SIZE up
+	// front and never moved, so a reader holding the pointer survives a resize
+	float *dB;
+
+	spectrum_analyzer_t();
+	~spectrum_analyzer_t();
+
+	// replans and retabulates only what changed. The input buffer's contents are lost when the size does
+	int configure(uint32_t size, spectrum_window_t window, float kaiser_beta, unsigned planner_flags);
+
+	// size samples go here before analyze()
+	float *input() { return in_buf; }
+	uint32_t num_bins() const { return size / 2; }
+
+	// windows input() in place, transforms it and fills dB
+	void analyze();
+
+private:
+	fftwf_plan plan;
+	float *in_buf, *window;
+	fftwf_complex *spectrum;
+	float window_sum;
+
+	void release_fft();
+
+	spectrum_analyzer_t(const spectrum_analyzer_t&);
+	spectrum_analyzer_t &operator=(const spectrum_analyzer_t&);
+};
+
+// out[i] = in[i] * w[i], in place is fine
+void spectrum_window_multiply(const float *in, const float *w, float *out, size_t n);
+
+void spectrum_window_multiply_scalar(const float *in, const float *w, float *out, size_t n);
+void spectrum_window_multiply_sse(const float *in, const float *w, float *out, size_t n);
+void spectrum_window_multiply_avx2(const float *in, const float *w, float *out, size_t n);
+
+// out[i] = 10*log10(scale * (re^2 + im^2)) of bins[i], at least floor_dB. NaN bins read as the floor too.
+// The log2 is the exponent plus a degree 5 polynomial of the mantissa reduced to [sqrt(1/2), sqrt(2)[,
+// off by at most 1.3e-5 dB; the rest of the error is float rounding of the result.
+void spectrum_power_dB(const fftwf_complex *bins, float *out, size_t n, float scale, float floor_dB);
+
+void spectrum_power_dB_scalar(const fftwf_complex *bins, float *out, size_t n, float scale, float floor_dB);
+void spectrum_power_dB_sse(const fftwf_complex *bins, float *out, size_t n, float scale, float floor_dB);
+void spectrum_power_dB_avx2(const fftwf_complex *bins, float *out, size_t n, float scale, float floor_dB);
+
+// forces a kernel ("scalar", "sse" or "avx2"), NULL or "" goes back to the widest one the CPU supports
+int spectrum_set_kernel(const char *name);
+const char *spectrum_kernel_name();
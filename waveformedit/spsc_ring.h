@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+// Lock-free single producer / single consumer ring buffer of T.
+//
+// Unlike triple_buffer, nothing is overwritten: the consumer gets every element in order, or, when it falls
+// behind, the producer drops whole push()es and counts them. push() never blocks and never splits its data,
+// so a stream pushed in whole records (e.g. audio frames) is still aligned on them after a drop.
+//
+// head and tail are running counts, the capacity a power of two; each side owns one and only reads the other.
+
+template <typename T>
+class spsc_ring {
+
+	std::vector<T> buf;
+	size_t mask;
+
+	alignas(64) std::atomic<size_t> head; // written by the producer
+	alignas(64) std::atomic<size_t> tail; // written by the consumer
+	alignas(64) std::atomic<uint64_t> dropped;
+
+	void copy_in(size_t pos, const T *data, size_t n) {
+		const size_t i = pos & mask, first = (std::min)(n, buf.size() - i);
+		memcpy(&buf[i], data, first * sizeof(T));
+		memcpy(&buf[0], data + first, (n - first) * sizeof(T));
+	}
+
+	void copy_out(size_t pos, T *data, size_t n) const {
+		const size_t i = pos & mask, first = (std::min)(n, buf.size() - i);
+		memcpy(data, &buf[i], first * sizeof(T));
+		memcpy(data + first, &buf[0], (n - first) * sizeof(T));
+	}
+
+public:
+	spsc_ring() : mask(0), head(0), tail(0), dropped(0) {}
+
+	// not thread safe, call before handing the ring over to the producer/consumer threads. rounds up to a power of two
+	void init(size_t min_capacity) {
+		size_t c = 1;
+		while (c < min_capacity) c <<= 1;
+		buf.assign(c, T());
+		mask = c - 1;
+		head.store(0);
+		tail.store(0);
+		dropped.store(0);
+	}
+
+	size_t capacity() const { return buf.size(); }
+
+	// producer side. all of data or nothing
+	bool push(const T *data, size_t n) {
+		const size_t h = head.load(std::memory_order_relaxed);
+		const size_t t = tail.load(std::memory_order_acquire);
+		if (buf.size() - (h - t) < n) {
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		copy_in(h, data, n);
+		head.store(h + n, std::memory_order_release);
+		return true;
+	}
+
+	// consumer side. up to max elements, the count actually read
+	size_t pop(T *data, size_t max) {
+		const size_t t = tail.load(std::memory_order_relaxed);
+		const size_t n = (std::min)(max, head.load(std::memory_order_acquire) - t);
+		copy_out(t, data, n);
+		tail.store(t + n, std::memory_order_release);
+		return n;
+	}
+
+	size_t read_available() const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_relaxed); }
+
+	uint64_t num_dropped() const { return dropped.load(std::memory_order_relaxed); }
+};
@@ -0,0 +1,80 @@
+#include "stft.h"
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+stft_t::stft_t()
+	: hop(0), history_length(0), frames_produced(0), input_pos(0), until_next_frame(0) {}
+
+int stft_t::init(uint32_t size, uint32_t a_hop, spectrum_window_t window, float kaiser_beta, uint32_t a_history_length, unsigned planner_flags) {
+
+	if (a_hop < 1 || a_hop > size || a_history_length < 1) {
+		printf("stft_t::init: bad hop (%u) or history length (%u) for size %u.\n", a_hop, a_history_length, size);
+		return 0;
+	}
+
+	if (!analyzer.configure(size, window, kaiser_beta, planner_flags)) {
+		return 0;
+	}
+
+	hop = a_hop;
+	history_length = a_history_length;
+	frames_produced = 0;
+
+	input.assign(size, 0.0f);
+	input_pos = 0;
+	until_next_frame = size;
+
+	history.assign((size_t)history_length * num_bins(), analyzer.floor_dB);
+
+	return 1;
+}
+
+uint32_t stft_t::feed(const float *samples, size_t n) {
+	const uint32_t size = analyzer.size;
+	uint32_t produced = 0;
+
+	while (n > 0) {
+		const uint32_t m = (uint32_t)(std::min<size_t>)(n, until_next_frame); // <= size, so wraps at most once
+		const uint32_t first = (std::min)(m, size - input_pos);
+
+		memcpy(&input[input_pos], samples, first * sizeof(float));
+		memcpy(&input[0], samples + first, (m - first) * sizeof(float));
+		input_pos = (input_pos + m) % size;
+
+		samples += m;
+		n -= m;
+		until_next_frame -= m;
+
+		if (until_next_frame == 0) {
+			produce_frame();
+			until_next_frame = hop;
+			++produced;
+		}
+	}
+
+	return produced;
+}
+
+void stft_t::produce_frame() {
+	const uint32_t size = analyzer.size;
+
+	// oldest sample first: the ring from input_pos on, then its beginning
+	float *in = analyzer.input();
+	memcpy(in, &input[input_pos], (size - input_pos) * sizeof(float));
+	memcpy(in + (size - input_pos), &input[0], input_pos * sizeof(float));
+
+	analyzer.analyze();
+
+	const uint32_t bins = num_bins();
+	memcpy(&history[(size_t)(frames_produced % history_length) * bins], analyzer.dB, bins * sizeof(float));
+	++frames_produced;
+}
+
+const float *stft_t::frame(uint32_t age) const {
+	if (age >= history_length || age >= frames_produced) {
+		return NULL;
+	}
+	return &history[(size_t)((frames_produced - 1 - age) % history_length) * num_bins()];
+}
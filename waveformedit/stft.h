@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "spectrum.h"
+
+// Short-time Fourier transform of a stream: a spectrum_analyzer_t frame every hop samples over the last size
+// samples, kept in a fixed-size history for a waterfall (spectrogram) view.
+//
+// Samples come in through feed() in chunks of any length. A frame is computed whenever hop new samples
+// have arrived since the last one, once the first size have. The history is a ring of history_length
+// frames: the oldest frame is overwritten, nothing is allocated after init(). Everything here belongs to
+// the thread calling feed().
+
+#define STFT_DEFAULT_SIZE 2048
+#define STFT_DEFAULT_HOP 512
+#define STFT_DEFAULT_HISTORY 256 // frames, ~2.7 s at the defaults and 48 kHz
+
+struct stft_t {
+	uint32_t hop;
+	uint32_t history_length;
+	uint64_t frames_produced; // frame k covers input samples [k*hop, k*hop + size[
+
+	stft_t();
+
+	// hop in [1, size]. planner_flags as for spectrum_analyzer_t::configure
+	int init(uint32_t size, uint32_t hop, spectrum_window_t window, float kaiser_beta, uint32_t history_length, unsigned planner_flags);
+
+	// returns the number of frames this produced
+	uint32_t feed(const float *samples, size_t n);
+
+	uint32_t size() const { return analyzer.size; }
+	uint32_t num_bins() const { return analyzer.num_bins(); }
+
+	// the dB bins of a frame, 0 = the newest. NULL if it's older than the history or not produced yet
+	const float *frame(uint32_t age) const;
+
+	void set_floor(float floor_dB) { analyzer.floor_dB = floor_dB; }
+
+private:
+	spectrum_analyzer_t analyzer;
+	std::vector<float> input; // the last size samples, a ring at input_pos
+	uint32_t input_pos;
+	uint32_t until_next_frame;
+	std::vector<float> history; // history_length rows of num_bins()
+
+	void produce_frame();
+};
@@ -1,31 +1,49 @@
 #pragma once
 
+#ifdef _WIN32
 #include <Windows.h>
+#else
+#include <chrono>
+#endif
 #include <cstdio>
+#include <cstdint>
 
-struct timer_t {
+// (not called timer_t, that one's taken by <time.h> on POSIX systems)
+struct perf_timer_t {
 	double cpu_freq;	// in kHz
-	__int64 counter_start;
+	int64_t counter_start;
 
-	__int64 get() const {
+#ifdef _WIN32
+	int64_t get() const {
 		LARGE_INTEGER li;
 		QueryPerformanceCounter(&li);
 		return li.QuadPart;
 	}
-public:
-	bool init() {
+
+	static double get_freq() {
 		LARGE_INTEGER li;
 		QueryPerformanceFrequency(&li);
-		cpu_freq = double(li.QuadPart);	// in Hz. this is subject to dynamic frequency scaling, though
+		return double(li.QuadPart);	// in Hz. this is subject to dynamic frequency scaling, though
+	}
+#else
+	int64_t get() const {
+		return std::chrono::steady_clock::now().time_since_epoch().count();
+	}
+
+	static double get_freq() {
+		return double(std::chrono::steady_clock::period::den) / double(std::chrono::steady_clock::period::num);
+	}
+#endif
+
+public:
+	bool init() {
+		cpu_freq = get_freq();
 		begin();
 		return true;
 	}
 	void begin() {
-		LARGE_INTEGER li;
-		QueryPerformanceFrequency(&li);
-		cpu_freq = double(li.QuadPart);
-		QueryPerformanceCounter(&li);
-		counter_start = li.QuadPart;
+		cpu_freq = get_freq();
+		counter_start = get();
 	}
 
 
@@ -38,7 +56,7 @@ public:
 	inline double get_us() const {
 		return double(1000000 * (get_s()));
 	}
-	timer_t() {
-		if (!init()) { printf("timer_t: error: initialization failed.\n"); }
+	perf_timer_t() {
+		if (!init()) { printf("perf_timer_t: error: initialization failed.\n"); }
 	}
-};
\ No newline at end of file
+};
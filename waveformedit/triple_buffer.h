@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+
+// Wait-free single producer / single consumer triple buffer.
+//
+// The producer fills write_buffer() and publish()es it, the consumer picks up the newest published slot
+// with read_buffer(). Neither side ever blocks or waits on the other: the only shared state is the index
+// of the middle slot, swapped with a single atomic exchange on both ends. Frames the consumer never got
+// around to reading are simply overwritten, and the consumer keeps seeing its last frame until a new
+// one is published.
+
+template <typename T>
+class triple_buffer {
+
+	enum { INDEX_MASK = 0x3, FRESH_BIT = 0x4 };
+
+	T slots[3];
+	int back;  // owned by the producer
+	int front; // owned by the consumer
+	std::atomic<int> middle; // index of the middle slot | FRESH_BIT if the producer published it since the last read
+
+public:
+	triple_buffer() : back(0), front(1), middle(2) {}
+
+	// not thread safe, call before handing the buffer over to the producer/consumer threads
+	void init(const T &value) {
+		for (auto &s : slots) s = value;
+		back = 0;
+		front = 1;
+		middle.store(2);
+	}
+
+	T &write_buffer() { return slots[back]; }
+
+	void publish() {
+		int prev = middle.exchange(back | FRESH_BIT, std::memory_order_acq_rel);
+		back = prev & INDEX_MASK;
+	}
+
+	bool has_new() const {
+		return (middle.load(std::memory_order_acquire) & FRESH_BIT) != 0;
+	}
+
+	const T &read_buffer() {
+		if (has_new()) {
+			int prev = middle.exchange(front, std::memory_order_acq_rel);
+			front = prev & INDEX_MASK;
+		}
+		return slots[front];
+	}
+};
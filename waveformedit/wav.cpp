@@ -0,0 +1,103 @@
+#define _CRT_SECURE_NO_WARNINGS // fopen
+
+#include "wav.h"
+
+#define WAVE_FORMAT_PCM_TAG 1
+#define WAVE_FORMAT_IEEE_FLOAT_TAG 3
+#define WAVE_FORMAT_EXTENSIBLE_TAG 0xFFFE
+
+// the tail of KSDATAFORMAT_SUBTYPE_PCM/_IEEE_FLOAT, whose first two bytes are the plain format tag
+static const uint8_t subformat_guid_tail[14] = { 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71 };
+
+// WAVEFORMATEXTENSIBLE's dwChannelMask for the usual layouts (mono = front center, quad, 5.1, 7.1),
+// otherwise the first n speaker positions
+static uint32_t default_channel_mask(int num_channels) {
+	switch (num_channels) {
+	case 1: return 0x4;
+	case 2: return 0x3;
+	case 4: return 0x33;
+	case 6: return 0x3F;
+	case 8: return 0x63F;
+	default: return num_channels < 32 ? (1u << num_channels) - 1 : 0xFFFFFFFFu;
+	}
+}
+
+static void put_u16(FILE *fp, uint16_t v) {
+	uint8_t b[2] = { (uint8_t)v, (uint8_t)(v >> 8) };
+	fwrite(b, 1, 2, fp);
+}
+
+static void put_u32(FILE *fp, uint32_t v) {
+	uint8_t b[4] = { (uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+	fwrite(b, 1, 4, fp);
+}
+
+// More than 2 channels or more than 16 bits per sample get a WAVE_FORMAT_EXTENSIBLE fmt chunk, which is what
+// readers expect for those (and need, to know the channel layout)
+static void write_header(FILE *fp, const wave_format_t &fmt, uint32_t data_bytes) {
+	const uint32_t block_align = fmt.num_channels * fmt.bit_depth / 8;
+	const uint16_t tag = fmt.is_float ? WAVE_FORMAT_IEEE_FLOAT_TAG : WAVE_FORMAT_PCM_TAG;
+	const bool extensible = fmt.num_channels > 2 || fmt.bit_depth > 16;
+	const uint32_t fmt_bytes = extensible ? 40 : 16;
+
+	fwrite("RIFF", 1, 4, fp);
+	put_u32(fp, 4 + (8 + fmt_bytes) + (8 + data_bytes));
+	fwrite("WAVE", 1, 4, fp);
+
+	fwrite("fmt ", 1, 4, fp);
+	put_u32(fp, fmt_bytes);
+	put_u16(fp, extensible ? WAVE_FORMAT_EXTENSIBLE_TAG : tag);
+	put_u16(fp, fmt.num_channels);
+	put_u32(fp, fmt.sample_rate);
+	put_u32(fp, fmt.sample_rate * block_align);
+	put_u16(fp, block_align);
+	put_u16(fp, fmt.bit_depth);
+
+	if (extensible) {
+		put_u16(fp, 22); // cbSize
+		put_u16(fp, fmt.bit_depth); // valid bits: s24 is packed, so all of them
+		put_u32(fp, default_channel_mask(fmt.num_channels));
+		put_u16(fp, tag);
+		fwrite(subformat_guid_tail, 1, sizeof(subformat_guid_tail), fp);
+	}
+
+	fwrite("data", 1, 4, fp);
+	put_u32(fp, data_bytes);
+}
+
+int wav_writer_t::open(const char *path, const wave_format_t &fmt) {
+	close();
+
+	fp = fopen(path, "wb");
+	if (!fp) {
+		printf("wav_writer_t::open: couldn't open %s for writing.\n", path);
+		return 0;
+	}
+
+	format = fmt;
+	frames_written = 0;
+
+	// placeholder sizes, close() rewrites the header
+	write_header(fp, format, 0);
+
+	return 1;
+}
+
+int wav_writer_t::write(const void *frames, uint32_t num_frames) {
+	if (!fp) return 0;
+
+	size_t n = fwrite(frames, bytes_per_frame(), num_frames, fp);
+	frames_written += (uint32_t)n;
+
+	return n == num_frames;
+}
+
+void wav_writer_t::close() {
+	if (!fp) return;
+
+	fseek(fp, 0, SEEK_SET);
+	write_header(fp, format, frames_written * bytes_per_frame());
+
+	fclose(fp);
+	fp = NULL;
+}
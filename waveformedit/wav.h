@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+
+#include "audio_backend.h"
+
+// Streams interleaved PCM frames to a RIFF/WAVE file. The chunk sizes are patched in by close().
+
+struct wav_writer_t {
+	FILE *fp;
+	wave_format_t format;
+	uint32_t frames_written;
+
+	wav_writer_t() : fp(NULL), frames_written(0) {}
+	~wav_writer_t() { close(); }
+
+	int open(const char *path, const wave_format_t &fmt);
+	int write(const void *frames, uint32_t num_frames);
+	void close();
+
+	bool is_open() const { return fp != NULL; }
+	uint32_t bytes_per_frame() const { return format.num_channels * format.bit_depth / 8; }
+};
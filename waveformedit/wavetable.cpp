@@ -0,0 +1,139 @@
+#include "wavetable.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include "fft_util.h"
+
+wavetable_t::wavetable_t()
+	: size(0), num_levels(0), plan_r2c(NULL), plan_c2r(NULL), time_buf(NULL), spectrum(NULL), scratch(NULL) {}
+
+wavetable_t::~wavetable_t() {
+	release_fft();
+}
+
+void wavetable_t::release_fft() {
+	if (plan_r2c) { fft_destroy_plan(plan_r2c); }
+	if (plan_c2r) { fft_destroy_plan(plan_c2r); }
+	if (time_buf) { fftwf_free(time_buf); }
+	if (spectrum) { fftwf_free(spectrum); }
+	if (scratch) { fftwf_free(scratch); }
+
+	plan_r2c = plan_c2r = NULL;
+	time_buf = NULL;
+	spectrum = scratch = NULL;
+}
+
+int wavetable_t::build(const float *cycle, uint32_t cycle_length, int stride) {
+
+	if (cycle_length < 2) {
+		printf("wavetable_t::build: cycle_length %u is too short.\n", cycle_length);
+		return 0;
+	}
+
+	if (cycle_length != size || !plan_r2c) {
+		release_fft();
+
+		size = cycle_length;
+		num_levels = 0;
+		while (num_levels < WAVETABLE_MAX_LEVELS && max_harmonic(num_levels) >= 1) {
+			++num_levels;
+		}
+
+		const uint32_t num_bins = size / 2 + 1;
+		time_buf = static_cast<float*>(fftwf_malloc(size * sizeof(float)));
+		spectrum = static_cast<fftwf_complex*>(fftwf_malloc(num_bins * sizeof(fftwf_complex)));
+		scratch = static_cast<fftwf_complex*>(fftwf_malloc(num_bins * sizeof(fftwf_complex)));
+
+		// ESTIMATE doesn't touch the arrays while planning, the other flags would
+		plan_r2c = fft_plan_r2c(size, time_buf, spectrum, FFTW_ESTIMATE);
+		plan_c2r = fft_plan_c2r(size, scratch, time_buf, FFTW_ESTIMATE);
+
+		if (!plan_r2c || !plan_c2r) {
+			printf("wavetable_t::build: couldn't create FFT plans for size %u.\n", size);
+			release_fft();
+			return 0;
+		}
+
+		tables.assign(num_levels * (size + 1), 0);
+	}
+
+	for (uint32_t i = 0; i < size; ++i) {
+		time_buf[i] = cycle[i * stride];
+	}
+
+	// level 0 is the cycle itself
+	float *t0 = &tables[0];
+	memcpy(t0, time_buf, size * sizeof(float));
+	t0[size] = t0[0];
+
+	fftwf_execute(plan_r2c);
+
+	const uint32_t num_bins = size / 2 + 1;
+	const float scale = 1.0f / size;
+
+	for (int l = 1; l < num_levels; ++l) {
+		const uint32_t h = max_harmonic(l);
+
+		// c2r destroys its input, so each level starts over from a copy of the full spectrum
+		memcpy(scratch, spectrum, (h + 1) * sizeof(fftwf_complex));
+		memset(scratch + h + 1, 0, (num_bins - h - 1) * sizeof(fftwf_complex));
+
+		fftwf_execute(plan_c2r);
+
+		float *t = &tables[l * (size + 1)];
+		for (uint32_t i = 0; i < size; ++i) {
+			t[i] = time_buf[i] * scale;
+		}
+		t[size] = t[0];
+	}
+
+	return 1;
+}
+
+// how far past its limit (in octaves, kf) level 0 fades out into level 1. What level 0 aliases in the meantime
+// folds back above sample_rate/2 * (2 - 2^(1/12)), i.e. above ~0.94 of Nyquist
+#define WAVETABLE_LEVEL0_FADE (1.0 / 12)
+
+wavetable_lookup_t wavetable_select(const float *tables, uint32_t size, int num_levels, double freq, double sample_rate) {
+	wavetable_lookup_t l;
+
+	// level k (harmonics up to size/2 >> k) is alias-free while kf <= k
+	const double kf = log2((double)size * fabs(freq) / sample_rate);
+
+	// at or below the native pitch the cycle plays as drawn
+	if (!(kf > 0)) {
+		l.lo = l.hi = tables;
+		l.hi_weight = 0;
+		return l;
+	}
+
+	// just above it, a quick fade to level 1 instead of a jump
+	if (num_levels > 1 && kf <= WAVETABLE_LEVEL0_FADE) {
+		l.lo = tables;
+		l.hi = tables + (size + 1);
+		l.hi_weight = (float)(kf / WAVETABLE_LEVEL0_FADE);
+		return l;
+	}
+
+	const int k = (int)ceil(kf); // lo = level k for kf in ]k - 1, k]
+
+	if (k >= num_levels - 1) {
+		l.lo = l.hi = tables + (num_levels - 1) * (size + 1);
+		l.hi_weight = 0;
+		return l;
+	}
+
+	l.lo = tables + k * (size + 1);
+	l.hi = tables + (k + 1) * (size + 1);
+	// level 1's crossfade starts where level 0's fade ends
+	l.hi_weight = (float)(k == 1 ? (kf - WAVETABLE_LEVEL0_FADE) / (1 - WAVETABLE_LEVEL0_FADE) : kf - (k - 1));
+
+	return l;
+}
+
+wavetable_lookup_t wavetable_t::select(double freq, double sample_rate) const {
+	return wavetable_select(&tables[0], size, num_levels, freq, sample_rate);
+}
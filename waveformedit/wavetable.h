@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "fftw3.h"
+
+// Band-limited mip chain of one waveform cycle. Level l keeps harmonics 1..(size/2 >> l), so every level is
+// half the bandwidth of the previous one, and level l plays alias-free up to sample_rate * 2^l / size Hz.
+// All levels have the same length, so a phase indexes every level the same way.
+//
+// Built once per edit from the rasterized cycle (one r2c FFT and one c2r per level), never per sample.
+
+#define WAVETABLE_MAX_LEVELS 16
+
+struct wavetable_lookup_t {
+	const float *lo, *hi; // the two levels being crossfaded, size + 1 floats each
+	float hi_weight;
+};
+
+struct wavetable_t {
+	uint32_t size; // samples per cycle, in every level
+	int num_levels;
+	std::vector<float> tables; // level l at &tables[l * (size + 1)]. the extra sample repeats sample 0, so reads don't wrap
+
+	wavetable_t();
+	~wavetable_t();
+
+	// cycle[i * stride], i < cycle_length. e.g. stride 2 takes one channel of an interleaved stereo buffer
+	int build(const float *cycle, uint32_t cycle_length, int stride = 1);
+
+	uint32_t max_harmonic(int level) const { return (size / 2) >> level; }
+	const float *level(int l) const { return &tables[l * (size + 1)]; }
+
+	// The two levels to crossfade for a given pitch. Both are alias-free at freq; the weight moves towards the
+	// duller level as freq approaches the brighter one's limit, so there's no jump when the pair changes.
+	// At or below level 0's limit (the native pitch, sample_rate / size) it's level 0 alone, so the cycle
+	// plays verbatim; above it level 0 fades into level 1 over a semitone.
+	// Constant for a constant pitch, so call it once per block rather than per sample.
+	wavetable_lookup_t select(double freq, double sample_rate) const;
+
+private:
+	fftwf_plan plan_r2c, plan_c2r;
+	float *time_buf;
+	fftwf_complex *spectrum, *scratch;
+
+	void release_fft();
+
+	wavetable_t(const wavetable_t&);
+	wavetable_t &operator=(const wavetable_t&);
+};
+
+// select() on a bare set of levels laid out like wavetable_t::tables, e.g. a copy handed to the audio thread
+wavetable_lookup_t wavetable_select(const float *tables, uint32_t size, int num_levels, double freq, double sample_rate);
+
+// phase in [0, 1[
+inline float wavetable_read(const wavetable_lookup_t &l, uint32_t size, double phase) {
+	const double p = phase * size;
+	const uint32_t i = (uint32_t)p;
+	const float f = (float)(p - i);
+
+	const float lo = l.lo[i] + f * (l.lo[i + 1] - l.lo[i]);
+	const float hi = l.hi[i] + f * (l.hi[i + 1] - l.hi[i]);
+
+	return lo + l.hi_weight * (hi - lo);
+}
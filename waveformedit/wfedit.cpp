@@ -1,37 +1,71 @@
+#define _CRT_SECURE_NO_WARNINGS // sscanf
+
 #include "wfedit.h"
 #include "glwindow.h"
 #include "lin_alg.h"
 #include "sound.h"
 #include "curve.h"
 #include "timer.h"
+#include "bench.h"
+#include "offline.h"
+#include "fft_util.h"
+#include "sample_convert.h"
+#include "resample.h"
+#include "spectrum.h"
+#include "stft.h"
+#include "triple_buffer.h"
 
 #include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <cassert>
 #include <fstream>
 #include <mutex>
+#include <atomic>
 #include <thread>
+#include <string>
+#include <vector>
+#include <algorithm>
 
 static int program_running = 1;
-static float *sampling_result = NULL;
-static float *FFT_result = NULL;
-static fftwf_complex *output_buffer = NULL;
 
+// The analysis is edit-driven. Once a frame the drawing thread compares the rasterized cycle's version with the
+// one it last handed over, and only wakes the FFT thread if it moved (or the config changed, or the output tap
+// needs draining). Edits made while an analysis runs pile up into the next one, so it runs at most once a frame.
 static std::condition_variable FFT_condition;
 static std::mutex FFT_wait_mutex;
-static bool FFT_ready = false;
+static bool FFT_ready = false; // guarded by FFT_wait_mutex, cleared by the FFT thread as it wakes
+static uint64_t FFT_requested_version = 0; // ditto, the cycle version last handed over
+
+static std::atomic<uint64_t> FFT_frames_skipped(0); // frames in which nothing changed
+
+static perf_timer_t wfedit_clock;
 
 static int FFT_init_done = 0;
 
 int FFT_initialized() { return FFT_init_done;  }
 
-static const int FFT_SIZE = 3072;
+// --fft-planner estimate|measure|patient. measured plans come from the wisdom file after the first run
+static unsigned FFT_planner_flags = FFTW_MEASURE;
 
-static HANDLE FFT_event;
+// --fft-size N[,N...] and --fft-window, changed at runtime from the editor's keys
+static std::mutex FFT_config_mutex;
+static spectrum_config_t FFT_config; // guarded by FFT_config_mutex
+static bool FFT_config_changed = true; // ditto
 
-static int sound_thread_proc() {
-	return PlayAudioStream();
-}
+// published by the FFT thread after every analysis, read by the drawing thread
+static triple_buffer<spectrum_frame_t> FFT_frames;
+
+// --stft N: a spectrogram of the device output, fed from the sound system's output tap by the FFT thread
+#define STFT_TAP_FRAMES 16384 // ~1/3 s at 48 kHz, enough for the FFT thread to fall a few frames behind
+static uint32_t STFT_size = 0, STFT_hop = STFT_DEFAULT_HOP; // STFT_size 0 = off
+static spectrum_window_t STFT_window = SPECTRUM_WINDOW_HANN;
+static float STFT_kaiser_beta = SPECTRUM_DEFAULT_KAISER_BETA;
+
+static std::mutex STFT_mutex;
+static stft_t *STFT = NULL; // guarded by STFT_mutex, owned by the FFT thread
+
+static HANDLE FFT_event;
 
 int wfedit_running() {
 	return program_running;
@@ -41,38 +75,152 @@ void wfedit_stop() {
 	program_running = 0;
 }
 
-float *get_FFT_result() { return FFT_result; }
-int get_FFT_size() { return FFT_SIZE; }
+double wfedit_clock_ms() { return wfedit_clock.get_ms(); }
 
-static void resample_curve() {
-	
-	SEGMENTED_BEZIER4 main = get_main_bezier_copy();
+static void wake_FFT_thread() {
+	std::unique_lock<std::mutex> lock(FFT_wait_mutex);
+	FFT_ready = true;
+	FFT_condition.notify_one();
+}
 
-	const float precision_modifier = 8.0;
+const spectrum_frame_t &get_FFT_frame() { return FFT_frames.read_buffer(); }
 
-	const float dx = 1.0 / FFT_SIZE;
-	const float dt = dx / precision_modifier;
-	float t = 0;
+spectrum_config_t get_FFT_config() {
+	std::lock_guard<std::mutex> lock(FFT_config_mutex);
+	return FFT_config;
+}
 
-	for (int i = 0; i < FFT_SIZE; ++i) {
-		float target_x = i * dx;
-		vec2 p = main.evaluate(t);
+void set_FFT_config(const spectrum_config_t &config) {
+	std::lock_guard<std::mutex> lock(FFT_config_mutex);
+	FFT_config = config;
+	FFT_config_changed = true;
+	wake_FFT_thread();
+}
 
-		while (p.x < target_x) {
-			if (t > 1) {
-				printf("FFT: while p.x < %.4f: t > 1. Invalid curve.\n", target_x);
-				return;
-			}
-			t += dt;
-			p = main.evaluate(t);
+// replans whatever the new config changed. Runs on the FFT thread, between analyses, so nothing else is using
+// the plans and buffers it frees; the drawing thread only sees the new sizes in the next frame published.
+static int apply_FFT_config(spectrum_analyzer_t *analyzers, int *num_resolutions) {
+	spectrum_config_t config;
+	{
+		std::lock_guard<std::mutex> lock(FFT_config_mutex);
+		if (!FFT_config_changed) return 0;
+		config = FFT_config;
+		FFT_config_changed = false;
+	}
+
+	int n = 0;
+	for (; n < config.num_sizes; ++n) {
+		perf_timer_t plan_timer;
+		if (!analyzers[n].configure(config.sizes[n], config.window, config.kaiser_beta, FFT_planner_flags)) {
+			break;
+		}
+		analyzers[n].floor_dB = config.floor_dB;
+		printf("FFT: size %u, %s window, %s plan took %.2f ms\n", config.sizes[n], spectrum_window_name(config.window),
+			fft_planner_name(FFT_planner_flags), plan_timer.get_ms());
+	}
+
+	*num_resolutions = n;
+
+	fft_save_wisdom(FFT_WISDOM_FILE);
+	return 1;
+}
+
+// what the analyses cost and how far behind the edits they ran, reported every couple of seconds. FFT thread only
+struct FFT_stats_t {
+	perf_timer_t since_report;
+	uint64_t analyses, coalesced, skipped_seen;
+	double latency_sum_ms, latency_max_ms;
+
+	FFT_stats_t() : analyses(0), coalesced(0), skipped_seen(0), latency_sum_ms(0), latency_max_ms(0) {}
+
+	void add(uint64_t versions_behind, double latency_ms) {
+		++analyses;
+		coalesced += versions_behind > 1 ? versions_behind - 1 : 0;
+		latency_sum_ms += latency_ms;
+		latency_max_ms = (std::max)(latency_max_ms, latency_ms);
+	}
+
+	void report() {
+		static const double report_interval_ms = 2000;
+		const double ms = since_report.get_ms();
+		if (ms < report_interval_ms || analyses == 0) return;
+
+		const uint64_t skipped = FFT_frames_skipped.load(std::memory_order_relaxed);
+		printf("FFT: %llu analyses, %llu edits coalesced, %llu unchanged frames skipped over %.1f s; edit->spectrum latency avg %.2f ms, max %.2f ms\n",
+			(unsigned long long)analyses, (unsigned long long)coalesced, (unsigned long long)(skipped - skipped_seen),
+			ms / 1000.0, latency_sum_ms / analyses, latency_max_ms);
+
+		*this = FFT_stats_t();
+		skipped_seen = skipped;
+	}
+};
+
+// copies the analyzers' results into the triple buffer's back slot. its vectors keep their capacity, so this
+// stops allocating after the first few frames at a size
+static void publish_FFT_frame(const spectrum_analyzer_t *analyzers, int num_resolutions, uint64_t cycle_version) {
+	static uint64_t serial = 0;
+
+	spectrum_frame_t &f = FFT_frames.write_buffer();
+	f.num_resolutions = num_resolutions;
+	for (int r = 0; r < num_resolutions; ++r) {
+		f.sizes[r] = analyzers[r].size;
+		f.dB[r].assign(analyzers[r].dB, analyzers[r].dB + analyzers[r].num_bins());
+	}
+	f.serial = ++serial;
+	f.cycle_version = cycle_version;
+
+	FFT_frames.publish();
+}
+
+// the spectrum is taken of the cycle the audio path rasterized (see get_rasterized_cycle), not of the curve
+// evaluated a second time. the cycle is cycle_length samples, resampled to each FFT size through its spectrum.
+// every resolution is computed from the same snapshot.
+static int analyze_cycle(cycle_resampler_t *resamplers, spectrum_analyzer_t *analyzers, int num_resolutions, uint64_t *analyzed_version, FFT_stats_t &stats) {
+	cycle_snapshot_ref cycle = get_rasterized_cycle();
+	if (!cycle || cycle->samples.empty()) return 0;
+
+	for (int r = 0; r < num_resolutions; ++r) {
+		spectrum_analyzer_t &a = analyzers[r];
+		if (!resamplers[r].resample(&cycle->samples[0], (uint32_t)cycle->samples.size(), a.input(), a.size)) {
+			return 0;
 		}
+		a.analyze();
+	}
+
+	// a replan analyzes the same cycle again, which isn't an edit
+	if (cycle.version() != *analyzed_version) {
+		stats.add(cycle.version() - *analyzed_version, wfedit_clock_ms() - cycle->edit_time_ms);
+		*analyzed_version = cycle.version();
+	}
+
+	publish_FFT_frame(analyzers, num_resolutions, cycle.version());
+
+	return 1;
+}
 
-		if (p.y > 1.0) { p.y = p.y - 2.0; }
-		else if (p.y < -1.0) { p.y = p.y + 2.0; }
+int get_STFT_bins() {
+	std::lock_guard<std::mutex> lock(STFT_mutex);
+	return STFT ? STFT->num_bins() : 0;
+}
+
+int get_STFT_history(float *dst, int max_frames) {
+	std::lock_guard<std::mutex> lock(STFT_mutex);
+	if (!STFT) return 0;
 
-		sampling_result[i] = p.y;
+	int n = 0;
+	for (const float *f; n < max_frames && (f = STFT->frame(n)) != NULL; ++n) {
+		memcpy(dst + (size_t)n * STFT->num_bins(), f, STFT->num_bins() * sizeof(float));
 	}
+	return n;
+}
 
+// everything the audio thread sent since the last call
+static void drain_output_tap(stft_t &stft, std::vector<float> &scratch) {
+	size_t n;
+	while ((n = SND_read_output_tap(&scratch[0], scratch.size())) > 0) {
+		std::lock_guard<std::mutex> lock(STFT_mutex);
+		stft.feed(&scratch[0], n);
+	}
 }
 
 static int FFT_thread_proc() {
@@ -81,56 +229,70 @@ static int FFT_thread_proc() {
 
 	while (!SND_initialized()) Sleep(250);
 
-	size_t input_size = FFT_SIZE;
-	size_t output_size = input_size / 2 + 1;
-
-	output_buffer = static_cast<fftwf_complex*>(fftwf_malloc(output_size*sizeof(fftwf_complex)));
-	sampling_result = new float[input_size];
-	printf("FFT: output_size = %lu\n", output_size);
-	FFT_result = new float[output_size - 1];
-	
+	spectrum_analyzer_t analyzers[SPECTRUM_MAX_RESOLUTIONS];
+	cycle_resampler_t resamplers[SPECTRUM_MAX_RESOLUTIONS];
 
-	int flags = FFTW_ESTIMATE;
-	fftwf_plan plan = fftwf_plan_dft_r2c_1d(input_size, sampling_result, output_buffer, flags);
+	int num_resolutions = 0;
+	apply_FFT_config(analyzers, &num_resolutions);
 
-	timer_t lock_timer;
+	stft_t stft;
+	std::vector<float> tap_scratch(4096);
+	if (STFT_size > 0 && stft.init(STFT_size, STFT_hop, STFT_window, STFT_kaiser_beta, STFT_DEFAULT_HISTORY, FFT_planner_flags)) {
+		stft.set_floor(get_FFT_config().floor_dB);
+		std::lock_guard<std::mutex> lock(STFT_mutex);
+		STFT = &stft;
+	}
 
 	FFT_init_done = 1;
 
+	FFT_stats_t stats;
+	uint64_t analyzed_version = 0;
+
 	while (wfedit_running()) {
 
 		{
 			std::unique_lock<std::mutex> lock(FFT_wait_mutex);
 			FFT_condition.wait(lock, [] { return FFT_ready; });
+			FFT_ready = false; // under the lock, so a wake-up arriving while we're busy below isn't lost
 		}
 
-		resample_curve();
-
-		fftwf_execute(plan);
+		if (!wfedit_running()) break;
 
-		float input_size_recip = 1.0 / (float)input_size;
+		const int replanned = apply_FFT_config(analyzers, &num_resolutions);
+		if (replanned || get_rasterized_cycle_version() != analyzed_version) {
+			analyze_cycle(resamplers, analyzers, num_resolutions, &analyzed_version, stats);
+			stats.report();
+		}
 
-		for (int i = 1; i < output_size; ++i) {
-			float mag = 2 * sqrt(output_buffer[i][0] * output_buffer[i][0] + output_buffer[i][1] * output_buffer[i][1]) * input_size_recip;
-			float a = 20 * log10f(mag);
-			//float freq = (i * (48000 / 2)) / (input_size / 2);
-			FFT_result[i - 1] = a;
+		if (STFT) {
+			drain_output_tap(stft, tap_scratch);
 		}
+	}
 
-		FFT_ready = false;
+	// the analyzers go away with this frame; nothing draws anymore by the time the thread is joined
+	FFT_init_done = 0;
+	{
+		std::lock_guard<std::mutex> lock(STFT_mutex);
+		STFT = NULL;
 	}
-	
-	fftwf_free(output_buffer);
-	fftwf_destroy_plan(plan);
 
 	return 1;
 }
 
+// once a frame: hands the FFT thread the current cycle version if it moved
 static void notify_FFT_thread() {
+	const uint64_t version = get_rasterized_cycle_version();
 
 	std::unique_lock<std::mutex> lock(FFT_wait_mutex);
-	FFT_ready = true;
-	FFT_condition.notify_one();
+	// the spectrogram analyzes what's playing, which changes whether or not the curve does
+	if (version != FFT_requested_version || STFT_size > 0) {
+		FFT_requested_version = version;
+		FFT_ready = true;
+		FFT_condition.notify_one();
+	}
+	else {
+		FFT_frames_skipped.fetch_add(1, std::memory_order_relaxed);
+	}
 }
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow) {
@@ -148,13 +310,125 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
 	}
 #endif
 
+	const char *bench_arg = strstr(lpCmdLine, "--bench");
+	if (bench_arg) {
+		char which[64] = "";
+		sscanf(bench_arg + strlen("--bench"), "%63s", which);
+		int r = wfedit_run_benchmarks(which);
+		// the console goes away with the process, so wait for a keypress before exiting
+		FILE *dummy_in;
+		freopen_s(&dummy_in, "CONIN$", "r", stdin);
+		printf("\nPress enter to exit.\n");
+		getchar();
+		return r ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	// headless: render the curve straight to a file, no window or audio device
+	if (strstr(lpCmdLine, "--render")) {
+		offline_render_options_t opts;
+		int r = parse_offline_render_options(lpCmdLine, &opts) && wfedit_render_offline(opts);
+		return r ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
 
 	GLFWwindow *window = NULL;
 
+	fft_load_wisdom(FFT_WISDOM_FILE);
+
 	long wait = 0;
 	static double time_per_frame_ms = 0;
 
-	std::thread sound_thread(sound_thread_proc);
+	// --audio backend[:arg], e.g. --audio null, --audio file:out.wav or --audio alsa:hw:0,0
+	std::string audio_backend = default_audio_backend_name(), audio_arg;
+	const char *audio_opt = strstr(lpCmdLine, "--audio");
+	if (audio_opt) {
+		char spec[256] = "";
+		sscanf(audio_opt + strlen("--audio"), "%255s", spec);
+		audio_backend = spec;
+
+		size_t colon = audio_backend.find(':');
+		if (colon != std::string::npos) {
+			audio_arg = audio_backend.substr(colon + 1);
+			audio_backend.resize(colon);
+		}
+	}
+
+	// --period N (device), --block N (synthesis) and --cycle N (waveform resolution), all in frames
+	snd_options_t snd_options;
+	const char *opt;
+	if ((opt = strstr(lpCmdLine, "--period"))) { sscanf(opt + strlen("--period"), "%u", &snd_options.period_frames); }
+	if ((opt = strstr(lpCmdLine, "--block"))) { sscanf(opt + strlen("--block"), "%u", &snd_options.block_frames); }
+	if ((opt = strstr(lpCmdLine, "--cycle"))) { sscanf(opt + strlen("--cycle"), "%u", &snd_options.cycle_length); }
+
+	if ((opt = strstr(lpCmdLine, "--fft-planner"))) {
+		char name[16] = "";
+		sscanf(opt + strlen("--fft-planner"), "%15s", name);
+		fft_planner_from_name(name, &FFT_planner_flags);
+	}
+
+	// --fft-size N[,N...]: the first size is drawn, the others are analyzed along with it. --fft-window rect|hann|blackman-harris|kaiser[:beta]
+	spectrum_config_t fft_config;
+	if ((opt = strstr(lpCmdLine, "--fft-size"))) {
+		char sizes[256] = "";
+		sscanf(opt + strlen("--fft-size"), "%255s", sizes);
+		spectrum_parse_sizes(sizes, &fft_config);
+	}
+	if ((opt = strstr(lpCmdLine, "--fft-window"))) {
+		char name[32] = "";
+		sscanf(opt + strlen("--fft-window"), "%31s", name);
+		spectrum_window_from_name(name, &fft_config.window, &fft_config.kaiser_beta);
+	}
+	// --stft N [--stft-hop N] [--stft-window w]: the spectrogram of what's sent to the device
+	if ((opt = strstr(lpCmdLine, "--stft "))) { sscanf(opt + strlen("--stft "), "%u", &STFT_size); }
+	if ((opt = strstr(lpCmdLine, "--stft-hop"))) { sscanf(opt + strlen("--stft-hop"), "%u", &STFT_hop); }
+	if ((opt = strstr(lpCmdLine, "--stft-window"))) {
+		char name[32] = "";
+		sscanf(opt + strlen("--stft-window"), "%31s", name);
+		spectrum_window_from_name(name, &STFT_window, &STFT_kaiser_beta);
+	}
+	if (STFT_size > 0) {
+		snd_options.tap_frames = STFT_TAP_FRAMES;
+	}
+
+	// --fft-floor dB: what silent bins read as
+	if ((opt = strstr(lpCmdLine, "--fft-floor"))) { sscanf(opt + strlen("--fft-floor"), "%f", &fft_config.floor_dB); }
+	set_FFT_config(fft_config);
+
+	// --format s16|s24|s32|f32: the device sample format
+	if ((opt = strstr(lpCmdLine, "--format"))) {
+		char name[16] = "";
+		sample_format_t f;
+		sscanf(opt + strlen("--format"), "%15s", name);
+		if (sample_format_from_name(name, &f)) {
+			wave_format_t w = {};
+			sample_format_to_wave_format(f, &w);
+			snd_options.bit_depth = w.bit_depth;
+			snd_options.is_float = w.is_float;
+		}
+	}
+
+	if (!SND_start(audio_backend.c_str(), audio_arg.c_str(), &snd_options)) {
+		printf("Couldn't start audio backend \"%s\", falling back to \"null\".\n", audio_backend.c_str());
+		SND_start("null", NULL, &snd_options);
+	}
+
+	// --notes f1,f2,...: play a chord on the cycle instead of the single voice at its native pitch
+	const char *notes_opt = strstr(lpCmdLine, "--notes");
+	if (notes_opt) {
+		char notes[512] = "";
+		sscanf(notes_opt + strlen("--notes"), "%511s", notes);
+
+		std::vector<float> freqs;
+		for (char *tok = strtok(notes, ","); tok; tok = strtok(NULL, ",")) {
+			freqs.push_back((float)atof(tok));
+		}
+
+		if (!freqs.empty()) {
+			SND_all_notes_off();
+			for (float f : freqs) {
+				SND_note_on(f, 1.0f / freqs.size());
+			}
+		}
+	}
 
 	window = create_GL_window("WFEDIT", WIN_W, WIN_H);
 
@@ -162,7 +436,17 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
 		return EXIT_FAILURE;
 	}
 
-	if (!init_GL()) {
+	// --curve path: start editing a saved curve instead of the default one
+	char curve_path[260] = "";
+	const char *curve_opt = strstr(lpCmdLine, "--curve");
+	if (curve_opt) {
+		sscanf(curve_opt + strlen("--curve"), "%259s", curve_path);
+	}
+
+	// --no-persistent-vbo: glBufferSubData uploads instead of the persistently mapped ring, to compare the two
+	const bool persistent_buffers = strstr(lpCmdLine, "--no-persistent-vbo") == NULL;
+
+	if (!init_GL(curve_path[0] ? curve_path : NULL, persistent_buffers)) {
 		return EXIT_FAILURE;
 	}
 	
@@ -180,10 +464,10 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
 
 	wfedit_stop(); // this is needed to stop the worker threadz
 
-	notify_FFT_thread(); // notify once more so we can break out
+	wake_FFT_thread(); // once more so it sees we've stopped
 
 	FFT_thread.join();
-	sound_thread.join();
+	SND_stop();
 	
 	glfwDestroyWindow(window);
 	glfwTerminate();
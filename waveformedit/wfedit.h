@@ -3,11 +3,38 @@
 #include "glwindow.h"
 
 #include "fftw3.h"
+#include "spectrum.h"
+
+#include <vector>
 
 int wfedit_running();
 
-float *get_FFT_result();
-int get_FFT_size();
+double wfedit_clock_ms(); // since startup, the same clock on every thread
+
+// One complete analysis of the edited cycle, at each of the configured sizes, as handed to the drawing thread.
+struct spectrum_frame_t {
+	int num_resolutions;
+	uint32_t sizes[SPECTRUM_MAX_RESOLUTIONS];
+	std::vector<float> dB[SPECTRUM_MAX_RESOLUTIONS]; // sizes[r]/2 bins each, see spectrum_analyzer_t::dB
+	uint64_t serial; // bumped per frame, 0 until the first analysis
+	uint64_t cycle_version; // the rasterized cycle's version it was computed from
+
+	spectrum_frame_t() : num_resolutions(0), serial(0), cycle_version(0) {
+		for (int r = 0; r < SPECTRUM_MAX_RESOLUTIONS; ++r) sizes[r] = 0;
+	}
+};
+
+// The newest complete frame; the FFT thread never waits for the reader, nor does the reader see a frame being
+// written. Drawing thread only (it's a triple buffer's one consumer), the reference is good until the next call.
+const spectrum_frame_t &get_FFT_frame();
+
+spectrum_config_t get_FFT_config();
+void set_FFT_config(const spectrum_config_t &config); // taken up by the FFT thread before its next run
+
+// the spectrogram of the device output (--stft), for a waterfall view: copies up to max_frames of the newest
+// frames, newest first, get_STFT_bins() floats each, and returns how many. 0 when it's off
+int get_STFT_history(float *dst, int max_frames);
+int get_STFT_bins();
 
 void wfedit_stop();
 int wfedit_running();